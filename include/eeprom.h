@@ -28,10 +28,19 @@
 //*** include ******************************************************************
 
 #include <xc.h>
+#include <stdbool.h>
 
 //*** define *******************************************************************
 
 #define EEPROM_CS               LATCbits.LATC2
+#define EEPROM_CS_MASK          0x04        // EEPROM_CS as bit mask of LATC
+
+// page size of the 25LC256 (a write must not cross a page boundary)
+#define EEPROM_PAGE             64
+
+// max. bytes read within one bus transaction (an lcd update may run between
+// two chunks)
+#define EEPROM_CHUNK            16
 
 // 25LC256 instruction set
 #define EEPROM_25LC256_READ     0b00000011  // Read data from memory array 
@@ -52,13 +61,19 @@
 #define EEPROM_25LC256_SR_BP1   0x08        // block protection
 #define EEPROM_25LC256_SR_WPEN  0x80        // write protect enable
 
+// internal data EEPROM (settings)
+#define EEPROM_INT_MAGIC        0xA5        // marks valid settings
+#define EEPROM_INT_ADDR_MAGIC   0x00
+#define EEPROM_INT_ADDR_PPM     0x01        // int16_t, little endian
+
 //*** prototypes ***************************************************************
 
 /**
  * You are able to read data out of the external EEPROM. You have to specify the 
  * start address and the length of bytes you want to read. Furthermore you need
  * to provide a pointer to a buffer with enough memory to store the requested
- * amount of data.
+ * amount of data. The function waits until all data was read (see 
+ * eeprom_25LC256_read_async).
  * 
  * @param addr Start address (16 bit).
  * @param pBuf Pointer to the data buffer.
@@ -67,11 +82,38 @@
 
 void eeprom_25LC256_read (uint16_t addr, uint8_t *pBuf, uint8_t len);
 
+/**
+ * This function starts reading data out of the external EEPROM and returns 
+ * immediately. The data is read by queued spi jobs in chunks of EEPROM_CHUNK
+ * bytes. Only one read can be in progress (see eeprom_25LC256_read_busy).
+ * 
+ * @param addr Start address (16 bit).
+ * @param pBuf Pointer to the data buffer (has to stay valid until done).
+ * @param len Number of bytes to read.
+ * @param cb Callback once all data was read (NULL: none), called from
+ *           spi_dispatch().
+ */
+
+void eeprom_25LC256_read_async (uint16_t addr, uint8_t *pBuf, uint8_t len,
+                                void (*cb)(void));
+
+/**
+ * Use this function to check if a read is still in progress.
+ * 
+ * @return True if a read is in progress.
+ */
+
+bool eeprom_25LC256_read_busy (void);
+
 /**
  * You are able write data into the external EEPROM. You have to specify the 
  * start address and the length of bytes you want to write. Furthermore you need
  * to provide a pointer to a buffer where the data is located.
- * amount of data.
+ * 
+ * The data is gathered in a write-back buffer of a whole page, so several
+ * small writes to the same page cost a single write cycle. The buffered data
+ * is written once a write goes to another page, otherwise by 
+ * eeprom_25LC256_flush. Reads always return the buffered data.
  * 
  * @param addr Start address (16 bit).
  * @param pBuf Pointer to the data buffer.
@@ -80,6 +122,24 @@ void eeprom_25LC256_read (uint16_t addr, uint8_t *pBuf, uint8_t len);
 
 void eeprom_25LC256_write (uint16_t addr, uint8_t *pBuf, uint8_t len);
 
+/**
+ * This function writes the buffered data into the EEPROM (a single write
+ * cycle). Call it if the stop watch becomes idle and before the pic goes to 
+ * sleep.
+ */
+
+void eeprom_25LC256_flush (void);
+
+/**
+ * This function sets all bytes of an EEPROM page to 0xFF within a single 
+ * write cycle (the 25LC256 has no erase instruction). Buffered write data of
+ * the page is dropped.
+ * 
+ * @param addr Any address inside the page.
+ */
+
+void eeprom_25LC256_erase_page (uint16_t addr);
+
 /**
  * This function will read the status register of the external EEPROM.
  * 
@@ -88,4 +148,23 @@ void eeprom_25LC256_write (uint16_t addr, uint8_t *pBuf, uint8_t len);
 
 uint8_t eeprom_25LC56_read_status_reg (void);
 
+/**
+ * This function will read one byte of the internal data EEPROM of the PIC.
+ * 
+ * @param addr Address (0..255).
+ * @return Content of the EEPROM cell.
+ */
+
+uint8_t eeprom_int_read (uint8_t addr);
+
+/**
+ * This function will write one byte into the internal data EEPROM of the PIC.
+ * The function returns after the write cycle was completed.
+ * 
+ * @param addr Address (0..255).
+ * @param val Value to write.
+ */
+
+void eeprom_int_write (uint8_t addr, uint8_t val);
+
 #endif
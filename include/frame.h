@@ -0,0 +1,116 @@
+/*******************************************************************************
+ *
+ * File:        frame.h
+ * Project:     PICLCD-Stopwatch
+ * Author:      Nicolas Pannwitz (https://pic-projekte.de/)
+ * Comment:
+ * Licence:     Copyrightn (C) 2018 Nicolas Pannwitz
+ * 
+ *              This program is free software: You can redistribute it and/or 
+ *              modify it under the terms of the GNU General Public License as
+ *              published by the Free Software Foundation, either version 3 of
+ *              the License, or (at your option) any later version.
+ *
+ *              This program is distributed in the hope that it will be useful,
+ *              but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *              MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *              GNU General Public License for more details.
+ * 
+ *              You should have received a copy of the GNU General Public
+ *              License along with this program.
+ *              If not, see https://www.gnu.org/licenses/
+ * 
+ ******************************************************************************/
+
+#ifndef FRAME_H
+#define FRAME_H
+
+//*** include ******************************************************************
+
+#include <xc.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//*** define *******************************************************************
+
+// SLIP framing: each frame ends (and starts) with FRAME_END, the bytes
+// FRAME_END and FRAME_ESC inside a frame are sent as FRAME_ESC + FRAME_ESC_x
+#define FRAME_END           0xC0
+#define FRAME_ESC           0xDB
+#define FRAME_ESC_END       0xDC
+#define FRAME_ESC_ESC       0xDD
+
+// CRC-16/CCITT (polynom 0x1021) over type, sequence, length and data, sent
+// little endian behind the data
+#define FRAME_CRC_INIT      0xFFFF
+#define FRAME_CRC_POLY      0x1021
+
+// max. data bytes of a received frame
+#define FRAME_DATA_MAX      8
+
+// max. bytes sent by frame_begin (without data) or frame_end (escaped)
+#define FRAME_BEGIN_LEN     7
+#define FRAME_END_LEN       5
+
+// results of frame_rx
+#define FRAME_RX_NONE       0       // frame not complete yet
+#define FRAME_RX_OK         1       // valid frame in frameRx
+#define FRAME_RX_ERR        2       // broken frame (crc, length) discarded
+
+//*** typedef ******************************************************************
+
+// a frame: type, sequence number, number of data bytes, data (+ crc)
+typedef struct frame_s
+{
+    uint8_t type;
+    uint8_t seq;
+    uint8_t len;
+    uint8_t data [FRAME_DATA_MAX + 2];
+    
+} frame_t;
+
+//*** extern *******************************************************************
+
+extern frame_t frameRx;
+
+//*** prototypes ***************************************************************
+
+/**
+ * Use this function to start sending a frame over the uart (see uart_print).
+ * The data bytes have to follow by frame_put, the frame is closed by 
+ * frame_end.
+ * 
+ * @param type Frame type.
+ * @param seq Sequence number.
+ * @param len Number of data bytes which will follow.
+ */
+
+void frame_begin (uint8_t type, uint8_t seq, uint8_t len);
+
+/**
+ * This function sends a data byte of the current frame (escaped, 1 or 2
+ * bytes on the line).
+ * 
+ * @param b Data byte.
+ */
+
+void frame_put (uint8_t b);
+
+/**
+ * This function closes the current frame (sends its crc and FRAME_END).
+ */
+
+void frame_end (void);
+
+/**
+ * This function decodes the received bytes. Once a complete frame with a
+ * valid length and crc was received it can be found in frameRx (until the
+ * next byte is passed).
+ * 
+ * @param c Received byte.
+ * @return FRAME_RX_NONE, FRAME_RX_OK or FRAME_RX_ERR.
+ */
+
+uint8_t frame_rx (uint8_t c);
+
+#endif
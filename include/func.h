@@ -30,12 +30,20 @@
 #include <xc.h>
 #include <stdint.h>
 #include "main.h"
+#include "timer.h"
+#include "frame.h"
+#include "uart.h"
+#include "eeprom.h"
 
 //*** define *******************************************************************
 
 #define USR PORTAbits.RA2
 #define PB  PORTAbits.RA4
 
+// photogate inputs (INT0 and INT1)
+#define TRIG_START  PORTAbits.RA0
+#define TRIG_STOP   PORTAbits.RA1
+
 // key events
 #define NO_KEY_EVENT            0
 #define KEY_PRESSED             1
@@ -45,6 +53,99 @@
 #define KEY_PB                  1
 #define KEY_USR                 2
 
+// captured PB edges (interrupt on change)
+#define PB_EDGE_RELEASE         0
+#define PB_EDGE_PRESS           1
+
+// max. age of a captured PB edge to be taken as start/stop time [10ms]
+#define PB_EDGE_MAX_AGE         3
+
+// photogates
+#define TRIG_GATE_START         0
+#define TRIG_GATE_STOP          1
+
+// trigger modes (see __func_set_trigger_mode)
+#define TRIG_MODE_OFF           0   // no photogates
+#define TRIG_MODE_GATES         1   // INT0 starts, INT1 stops the shown lane
+#define TRIG_MODE_LANES         2   // INT0/INT1 start & stop lane 0/1
+
+// independent lanes (one photogate per lane in TRIG_MODE_LANES)
+#define MAX_LANES               2
+
+// each lane has its own region inside the external EEPROM, it's written as
+// ring of log pages: header (log_hdr_t) + LOG_SLOTS records each
+#define LANE_EE_SIZE            (0x8000 / MAX_LANES)
+#define LANE_EE_BASE(ln)        ((uint16_t)(ln) * LANE_EE_SIZE)
+#define LOG_PAGES               (LANE_EE_SIZE / EEPROM_PAGE)
+#define LOG_HDR_SIZE            8
+#define LOG_SLOTS               ((EEPROM_PAGE - LOG_HDR_SIZE) / SIZE_OF_SW)
+#define LOG_PAGE_ADDR(ln,pg)    (LANE_EE_BASE(ln) + (pg) * EEPROM_PAGE)
+
+// sequence number of a log page (15 bit) and the flag of the first page of a
+// log (the pages before it were erased)
+#define LOG_SEQ_MASK            0x7FFF
+#define LOG_SEQ_FIRST           0x8000
+
+// check word of a page header over the sequence number and the record. Its
+// MSB is never set, so a header whose write was interrupted (the check word
+// still erased or half written) is never valid.
+#define LOG_CHK(seq,rec)        ((uint16_t)~((seq) ^ (uint16_t)(rec) ^    \
+                                 (uint16_t)((rec) >> 16)) & 0x7FFF)
+
+// content of an erased slot (no valid record, see SW_LAP_FLAG)
+#define SW_EMPTY                0xFFFFFFFFUL
+
+// default re-arm lockout of a gate after it was triggered [10ms]
+#define TRIG_LOCKOUT            50
+
+// calibration: min. reference time and max. correction
+#define CAL_MIN_TIME            60000   // [ms]
+#define CAL_MAX_PPM             20000
+
+// laps (split times) kept in ram until the measurement is stopped
+#define MAX_LAPS                8
+
+// laps are saved with this flag set
+#define SW_LAP_FLAG             0x80000000UL
+
+// lockout after a lap was captured and display time of a lap [10ms]
+#define LAP_LOCKOUT             30
+#define LAP_DISP_TIME           200
+
+// lcd refresh rate of a running measurement [Hz] (see remote command R),
+// the timekeeping itself doesn't depend on it
+#define DISP_RATE_DEF           25
+#define DISP_RATE_MAX           100
+
+// time to confirm a new baudrate with any command before the old one is
+// restored (see remote command S) [10ms]
+#define BAUD_CONFIRM_TIME       200
+
+// states of the export job (see remote command 4)
+#define EXP_STATE_IDLE          0
+#define EXP_STATE_READ          1   // reading the next records
+#define EXP_STATE_SEND          2   // sending the records read
+
+// min. free space in the tx-ringbuffer for one step of the export job: a
+// record "|LMM:SS:cc" (10), the start of a frame with its escaped index (11),
+// an escaped data byte (2) or the end of a frame (FRAME_END_LEN)
+#define EXP_ROOM                (FRAME_BEGIN_LEN + 4)
+
+// max. records per binary data frame (the length byte: 2 + 63 * 4 = 254)
+#define EXP_FRAME_RECS          63
+
+// remote protocol modes (see remote command P)
+#define REM_MODE_ASCII          0   // <X|123> messages
+#define REM_MODE_BIN            1   // SLIP frames with crc (see frame.h)
+
+// frame types of the binary protocol (request -> answer)
+#define FRAME_TYPE_PING         '0' // -> FRAME_TYPE_PING
+#define FRAME_TYPE_EXPORT       '4' // -> '4' (counts), data frames
+#define FRAME_TYPE_READ         'R' // (index, count) -> 'R' (counts), data
+#define FRAME_TYPE_ASCII        'P' // -> 'P', back to REM_MODE_ASCII
+#define FRAME_TYPE_DATA         'E' // index + up to EXP_FRAME_RECS records
+#define FRAME_TYPE_NAK          'N' // broken frame or unknown type
+
 // key press & hold time border values [10ms]
 #define KEY_HOLD_SAVE           300
 #define KEY_HOLD_CLR            500
@@ -60,12 +161,39 @@
 #define SW_STATE_SAVED          7
 #define SW_STATE_RECORD         8
 
-// remote message receive state
+// remote message receive state (<#id:OP|arg|arg>, see __func_remote_sm)
 #define REM_STATE_IDLE          0
 #define REM_STATE_START         1
-#define REM_STATE_END           2
+#define REM_STATE_ID            2
+#define REM_STATE_OP            3
+#define REM_STATE_ARG           4
+
+// max. length of an opcode and max. number of numeric arguments
+#define REM_OP_LEN              2
+#define REM_ARG_MAX             2
+
+// opcode of two chars (single char opcodes are the char itself)
+#define REM_OP2(a,b)            (((uint16_t)(a) << 8) | (uint8_t)(b))
+
+// telemetry (see remote command TS): range of the period of the time
+// messages [10ms] and the max. length of a message (ascii or frame)
+#define TELE_PERIOD_MIN         2
+#define TELE_PERIOD_MAX         1000
+#define TELE_ROOM               22
+
+// telemetry messages (ascii <x|a|0000000000> or frame type x with a + value)
+#define TELE_TIME               't' // lane, current time of the lane [ms]
+#define TELE_STATE              's' // lane, new state (SW_STATE_x)
+#define TELE_KEY                'k' // selected lane, pressed keys (KEY_x)
+
+// max. received bytes handled within one func_workload call
+#define REM_RX_MAX              UART_RX_MAX
+
+// max. re-arm lockout of the photogates (see remote command TL) [10ms]
+#define TRIG_LOCKOUT_MAX        1000
 
 // some time definitions (x*10ms) switch automatically from a to b after ..
+// (handled by the state timer, see __func_arm_state_timer)
 #define IDLE_TO_SLEEP_TIME      1500    // idle     -> sleep
 #define STOP_TO_IDLE_TIME       1000    // stop     -> idle
 #define CLEAR_TO_IDLE_TIME      800     // clear    -> idle
@@ -77,16 +205,58 @@
 
 //*** typedef ******************************************************************
 
-typedef struct sw_s
+// stop watch time in [ms] (bit 31: SW_LAP_FLAG), a single compare orders two
+// measurements. It is converted to minutes, seconds, .. only for the output.
+typedef uint32_t sw_t;
+
+// sizeof(sw_t)
+#define SIZE_OF_SW  4
+
+// time borders of the output formats [ms]
+#define SW_10_MIN   600000UL
+#define SW_100_MIN  6000000UL
+
+// stop watch time split into its output components (see __func_split_time)
+typedef struct split_s
 {
-    uint8_t ms;
-    uint8_t s;
-    uint8_t m;
+    uint8_t h;          // hours (wrap around after 99)
+    uint8_t m;          // minutes
+    uint8_t s;          // seconds
+    uint16_t ms;        // milliseconds
     
-} sw_t;
+} split_t;
 
-// sizeof(sw_t)
-#define SIZE_OF_SW  3
+// context of a single lane
+typedef struct lane_s
+{
+    uint8_t state;      // state of the stop watch' state machine
+    sw_t sw;            // current measurement
+    uint32_t base;      // value of the measurement when it was (re)started
+    ts_t start;         // timestamp of the (re)start
+    uint16_t measCnt;   // number of saved measurements (laps not counted)
+    uint16_t due;       // end of the state's timeout [10ms] (low word)
+    
+} lane_t;
+
+// header of a log page (see LOG_PAGES), the check word is written last
+typedef struct log_hdr_s
+{
+    sw_t rec;           // record when the page was started (or SW_EMPTY)
+    uint16_t seq;       // sequence number (+ LOG_SEQ_FIRST)
+    uint16_t chk;       // LOG_CHK, the page is valid only if it matches
+    
+} log_hdr_t;
+
+// log of a lane (rebuilt on boot from the page headers, see __func_log_scan)
+typedef struct log_s
+{
+    uint16_t seq;       // sequence number of the head page
+    uint16_t pages;     // number of pages of the log (0: no valid page)
+    uint16_t head;      // head page (the one written at the moment)
+    uint8_t used;       // used slots of the head page
+    sw_t rec;           // record (shortest measurement) or SW_EMPTY
+    
+} log_t;
 
 //*** extern *******************************************************************
 
@@ -94,6 +264,14 @@ extern uint8_t uartBuf;
 
 //*** prototypes ***************************************************************
 
+/**
+ * This function will initialize the stop watch (e.g. create its software 
+ * timers). You have to call this function on boot after the timers were 
+ * initialized.
+ */
+
+void func_init (void);
+
 /**
  * This function controlls the complete stop watch. The function has to be
  * called at least every 10ms.
@@ -102,9 +280,39 @@ extern uint8_t uartBuf;
 void func_workload (void);
 
 /**
- * This function will display the current stop watch value on the LCD.
+ * This function will display the current stop watch value of the selected lane
+ * on the LCD.
  */
 
 void func_disp_sw (void);
 
+/**
+ * This function will automatically be called from the high priority interrupt
+ * if the level of PB changed. It timestamps the first edge of each direction
+ * so the stop watch can be started/stopped with sub-tick resolution. Please
+ * don't call this function by your own.
+ */
+
+void func_pb_edge (void);
+
+/**
+ * This function will automatically be called from the high priority interrupt
+ * if a photogate (INT0 or INT1, see TRIG_MODE_x) was triggered. The edge will
+ * be timestamped and the gate is locked for the re-arm lockout time. Please
+ * don't call this function by your own.
+ * 
+ * @param gate TRIG_GATE_START (INT0) or TRIG_GATE_STOP (INT1).
+ */
+
+void func_trigger (uint8_t gate);
+
+/**
+ * This function will automatically be called from the high priority interrupt
+ * if USR (INT2) was pressed. While the stop watch is running the edge will be
+ * timestamped as lap (split time). Please don't call this function by your 
+ * own.
+ */
+
+void func_lap (void);
+
 #endif
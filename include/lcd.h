@@ -33,8 +33,11 @@
 //*** defines ******************************************************************
 
 #define LCD_CS  LATCbits.LC0    // chip select
+#define LCD_CS_MASK 0x01        // chip select as bit mask of LATC (spi jobs)
 #define LCD_RS  LATCbits.LC1    // register select (0: Instruction 1: Data)
 
+#define LCD_CHARS   8           // visible characters (DDRAM 0x00..0x07)
+
 //*** prototypes ***************************************************************
 
 /**
@@ -48,7 +51,10 @@ void lcd_init (void);
 //void lcd_return_home (void);
 
 /**
- * You can write a string to the lcd by using this function.
+ * You can write a string to the lcd by using this function. The visible 
+ * characters are mirrored in a shadow copy of the DDRAM, only the changed part
+ * will be sent to the lcd. The function doesn't wait for the transfer (queued
+ * spi jobs), characters beyond LCD_CHARS are ignored.
  * 
  * @param pStr  Pointer to a string which shall be written on the display.
  * @param addr  The DDRAM address to write the string to.
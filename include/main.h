@@ -27,6 +27,7 @@
 #define MAIN_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 //*** define *******************************************************************
 
@@ -42,9 +43,10 @@
 
 typedef struct status_s
 {
-    bool iXms       : 1;    // next 10ms passed
     bool iRx        : 1;    // data inside UART rx buffer available
-    bool iTx        : 1;    // data inside UART tx buffer available
+    bool iTrig      : 1;    // start/stop gate triggered
+    bool iLap       : 1;    // lap captured (USR pressed while running)
+    bool iSpi       : 1;    // spi job with completion callback done
     
 } status_t;
 
@@ -31,6 +31,46 @@
 #include <stdint.h>
 #include "main.h"
 
+//*** define *******************************************************************
+
+// devices on the bus (each with its own clock profile, see spi.c)
+#define SPI_DEV_LCD     0
+#define SPI_DEV_EEPROM  1
+#define SPI_DEV_CNT     2
+
+// priority of a device's jobs inside the queue
+#define SPI_PRIO_LOW    0
+#define SPI_PRIO_HIGH   1
+
+// register select line of the lcd (driven by the jobs, see spi_job_t)
+#define SPI_RS          LATCbits.LC1
+
+// register select level of a job
+#define SPI_RS_KEEP     0       // don't touch SPI_RS
+#define SPI_RS_CMD      1       // SPI_RS = 0 (lcd instruction)
+#define SPI_RS_DATA     2       // SPI_RS = 1 (lcd data)
+
+//*** typedef ******************************************************************
+
+// Descriptor of a queued (interrupt driven) transfer. The descriptor and its
+// buffers are owned by the spi driver until the job is done (see busy).
+
+typedef struct spi_job_s
+{
+    uint8_t dev : 1;            // device (SPI_DEV_x)
+    uint8_t rs : 2;             // register select level (SPI_RS_x)
+    uint8_t hold : 1;           // keep the chip select for the next job
+    uint8_t len;                // number of bytes (> 0)
+    uint8_t *pWr;               // write buffer (NULL: send 0x00)
+    uint8_t *pRd;               // read buffer (NULL: discard)
+    void (*cb)(void);           // completion callback (NULL: none)
+    
+    volatile bool busy;         // set until the job is done (own byte, the
+                                // interrupt clears it)
+    struct spi_job_s *pNext;    // (used by the driver)
+    
+} spi_job_t;
+
 //*** prototypes ***************************************************************
 
 /**
@@ -38,10 +78,31 @@
  */
 void spi_init (void);
 
+/**
+ * This function waits until all queued jobs are done, switches the SSP to the
+ * clock profile of the device and asserts its chip select. Use it in front of
+ * spi_transfer.
+ * 
+ * @param dev Device (SPI_DEV_x).
+ */
+
+void spi_select (uint8_t dev);
+
+/**
+ * This function releases the chip select of the device.
+ * 
+ * @param dev Device (SPI_DEV_x).
+ */
+
+void spi_deselect (uint8_t dev);
+
 /**
  * Use this function to send/receive data via the serial peripheral interface
  * (SPI). You have to define the length within the parameters as well as the
- * read and write pointers.
+ * read and write pointers. The data is transferred by polling to the device
+ * selected by spi_select, so it may be used with disabled interrupts (e.g. on
+ * boot) as long as no job is queued. See spi_tx, spi_rx and spi_txrx if the
+ * direction is known already.
  * 
  * @param pWr Pointer to the write buffer.
  * @param pRd Pointer to the read buffer.
@@ -50,4 +111,81 @@ void spi_init (void);
 
 void spi_transfer (uint8_t* pWr, uint8_t* pRd, uint8_t len);
 
+/**
+ * This function sends a burst of bytes to the selected device (polled, the
+ * received bytes are discarded).
+ * 
+ * @param pWr Pointer to the write buffer.
+ * @param len Number of bytes.
+ */
+
+void spi_tx (uint8_t *pWr, uint8_t len);
+
+/**
+ * This function reads a burst of bytes from the selected device (polled, 
+ * 0x00 is sent).
+ * 
+ * @param pRd Pointer to the read buffer.
+ * @param len Number of bytes.
+ */
+
+void spi_rx (uint8_t *pRd, uint8_t len);
+
+/**
+ * This function sends and receives a burst of bytes (polled, full duplex).
+ * 
+ * @param pWr Pointer to the write buffer.
+ * @param pRd Pointer to the read buffer (may be the write buffer).
+ * @param len Number of bytes.
+ */
+
+void spi_txrx (uint8_t *pWr, uint8_t *pRd, uint8_t len);
+
+/**
+ * This function adds a job to the transfer queue and returns immediately.
+ * The bytes are shifted by the SSP interrupt, the clock profile is switched 
+ * and the chip select asserted at the start and released at the end of the
+ * job (unless hold is set). The completion callback will be called from 
+ * spi_dispatch().
+ * 
+ * Jobs of a high priority device are served ahead of the queued low priority
+ * jobs, but never inside a transaction (jobs chained by hold). All jobs of a
+ * transaction have to be queued at once.
+ * 
+ * @param pJob Pointer to the job descriptor (has to stay valid until done).
+ */
+
+void spi_queue (spi_job_t *pJob);
+
+/**
+ * This function waits until all queued jobs are done.
+ */
+
+void spi_wait (void);
+
+/**
+ * This function calls the completion callbacks of the finished jobs. It has
+ * to be called from the main loop if status.iSpi is set.
+ */
+
+void spi_dispatch (void);
+
+/**
+ * This function returns the bus time a device occupied since the last call
+ * (the counter is cleared).
+ * 
+ * @param dev Device (SPI_DEV_x).
+ * @return Bus time in [us].
+ */
+
+uint32_t spi_get_busy_time (uint8_t dev);
+
+/**
+ * This function will automatically be called from the low priority interrupt
+ * if the SSP finished a byte of a queued job. Please don't call this function
+ * by your own.
+ */
+
+void spi_isr (void);
+
 #endif
@@ -33,86 +33,181 @@
 
 //*** struct *******************************************************************
 
-struct tOut_s
+// software timer (see timer_new)
+struct timer_s
 {
-    bool inUse;
-    uint16_t cnt;
+    uint8_t inUse : 1;
+    uint8_t active : 1;
+    uint8_t next;           // next timer in the same wheel slot
+    uint8_t slot;           // wheel slot the timer is linked into
+    uint16_t rounds;        // full wheel rounds left until expiry
+    uint16_t period;        // reload value [10ms] (0 for a one-shot timer)
+    void (*cb)(void);       // called from timer_dispatch on expiry
 };
 
+// timestamp (10ms tick + TIMER1 value in 0,25us)
+typedef struct ts_s
+{
+    uint32_t tick;
+    uint16_t sub;
+    
+} ts_t;
+
 //*** define *******************************************************************
 
-#define MAX_TOUT    4
+#define MAX_TIMER           4
+
+// number of timing wheel slots (power of two) and the end of list marker
+#define TIMER_WHEEL_BITS    3
+#define TIMER_WHEEL_SIZE    (1 << TIMER_WHEEL_BITS)
+#define TIMER_NONE          0xFF
+
+// max. time of one tickless idle period [10ms] (TIMER0 range: 4,19s)
+#define TIMER_IDLE_MAX      400
+
+// TIMER1 counts per 10ms tick and per millisecond
+#define TIMER1_TICK_CNT     40000
+#define TIMER1_CNT_PER_MS   4000
+
+// counts -> ms without a division: (counts >> 5) * 4195 >> 19 is exactly
+// counts / TIMER1_CNT_PER_MS for all counts < 2 * TIMER1_TICK_CNT
+#define TIMER1_MS_PRESHIFT  5
+#define TIMER1_MS_RECIP     4195UL
+#define TIMER1_MS_SHIFT     19
 
 //*** prototypes ***************************************************************
 
 /**
- * This function will be called to initialize the TIMER0. Furthermore the timer
- * overflow interrupt will be enabled (1ms tick).
+ * This function will initialize the TIMER0 which is used as one-shot wake up
+ * timer during the tickless idle (see timer_idle). Its interrupt is only
+ * enabled while the cpu idles.
  */
 
 void timer0_init (void);
 
 /**
- * Call this function if you need an timeout counter. You are able to define a
- * desired timeout value with an resolution of 1ms (max 65536ms). You will
- * receive an timeout index that can be used to call timer0_get_timeout. If no
- * internal memory is free to create a new timeout counter you will receive a
- * -1 as return value.
+ * This function will initialize the TIMER1 together with the CCP1 module (as
+ * special event trigger) which will be used to generate the 10ms timebase for
+ * the stop watch. Within this function the compare interrupt will be
+ * activated. You have to call this function on boot.
+ */
+
+void timer1_init (void);
+
+/**
+ * Start the TIMER1 after it was stopped (e.g. before gooing to sleep).
+ */
+
+void timer1_start (void);
+
+/**
+ * Stop the TIMER1 (e.g. to reduce current consumption during sleep-state).
+ */
+
+void timer1_stop (void);
+
+/**
+ * This function will automatically be called from the CCP1 compare interrupt
+ * (every 10ms). It increments the free-running 32 bit tick counter. Please 
+ * don't call this function by your own.
+ */
+
+void timer1_increase_ticks (void);
+
+/**
+ * Use this function to read the free-running 32 bit tick counter. The counter
+ * is incremented every 10ms by the CCP1 interrupt and never reset, so the
+ * difference of two readings is the exact time between them - even if the
+ * main loop was blocked for longer than one tick.
  * 
- * @param t Timeout value in [ms]. The range is 1..65536ms.
- * @return Timeout counter index or -1 if no timeout counter slot is free atm.
+ * @return Number of 10ms ticks since boot.
  */
 
-int8_t timer0_new_timeout (uint16_t ms);
+uint32_t timer1_get_ticks (void);
 
 /**
- * This function will automatically be called from the TIMER0 overflow 
- * inerrupt. Please don't call this function by your own. Otherwise your desired
- * timeout value will be differ!
+ * This function takes a timestamp with a resolution of 0,25us (tick counter 
+ * plus the current TIMER1 value). It may also be called from the high priority
+ * interrupt to timestamp external events (e.g. a key edge).
  * 
- * A once created timeout counter needs to be cleared with timer0_clear_timeout
- * if it is no longer needed.
+ * @param pTs Pointer to the timestamp struct to fill.
  */
 
-void timer0_decrease_timeout (void);
+void timer1_get_timestamp (ts_t *pTs);
 
 /**
- * Call this function to check if your timeout occured.
+ * Calculates the time between two timestamps (see timer1_get_timestamp).
  * 
- * @param i Timeout index (received by timer0_new_timeout).
- * @return True if your timeout occurred otherwise false.
+ * @param pStart Pointer to the earlier timestamp.
+ * @param pStop Pointer to the later timestamp.
+ * @return Elapsed time in [ms].
  */
 
-bool timer0_get_timeout (uint8_t i);
+uint32_t timer1_elapsed_ms (ts_t *pStart, ts_t *pStop);
 
 /**
- * A once created timeout counter needs to be cleared with timer0_clear_timeout
- * if it is no longer needed. You can clear a timeout counter with this
- * function and the timeout index (received by timer0_new_timeout).
+ * Call this function (on boot) if you need a software timer. The timer is
+ * driven by the 10ms tick. Timers are kept in a hashed timing wheel, so the
+ * work per tick doesn't depend on the number of timers. If no internal memory
+ * is free to create a new timer you will receive a -1 as return value.
  * 
- * @param i Timeout index value (this timeout shall be cleared).
+ * @param cb Callback which will be called (from timer_dispatch) on expiry.
+ * @return Timer index or -1 if no timer slot is free atm.
  */
 
-void timer0_clear_timeout (uint8_t i);
+int8_t timer_new (void (*cb)(void));
 
 /**
- * This function will initialize the TIMER2 which will be used to generate the
- * 10ms timebase for the stop watch. Within this function the overflow interrupt
- * will be activated. You have to call this function on boot.
+ * Use this function to (re)start a timer. A running timer will be restarted
+ * with the new values.
+ * 
+ * @param i Timer index (received by timer_new).
+ * @param ticks Time until the first expiry in [10ms] (min 1).
+ * @param period Reload value in [10ms] or 0 for a one-shot timer.
  */
 
-void timer2_init (void);
+void timer_start (uint8_t i, uint16_t ticks, uint16_t period);
 
 /**
- * Start the TIMER2 after it was stopped (e.g. before gooing to sleep).
+ * You can stop a running timer with this function. Its callback won't be
+ * called anymore.
+ * 
+ * @param i Timer index (received by timer_new).
  */
 
-void timer2_start (void);
+void timer_stop (uint8_t i);
 
 /**
- * Stop the TIMER2 (e.g. to reduce current consumption during sleep-state).
+ * This function advances the timing wheel up to the current tick and calls 
+ * the callbacks of all expired timers. It has to be called from the main loop
+ * (func_workload). Ticks that passed while the main loop was blocked will be
+ * caught up.
+ */
+
+void timer_dispatch (void);
+
+/**
+ * Call this function if nothing has to be done until the next software timer
+ * expires. The 10ms tick will be stopped, TIMER0 is programmed for the next
+ * expiry (max. TIMER_IDLE_MAX) and the cpu enters the idle mode. The function
+ * returns on any interrupt and adds the ticks which passed to the tick
+ * counter. 
+ * 
+ * The global interrupts (GIEH) have to be disabled by the caller after its
+ * last check for pending work. Interrupts still wake up the cpu and will be
+ * served once the caller enables GIEH again.
+ */
+
+void timer_idle (void);
+
+/**
+ * Use this function to read the number of wake ups from the idle mode (see
+ * timer_idle) since boot. The counter is only written by timer_idle, so it
+ * has to be read from the main loop only.
+ * 
+ * @return Number of wake ups (wraps around).
  */
 
-void timer2_stop (void);
+uint16_t timer_get_wakeups (void);
 
 #endif
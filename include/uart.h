@@ -28,16 +28,45 @@
 //*** include ******************************************************************
 
 #include <xc.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 //*** define *******************************************************************
 
-#define UART_BUF_MAX    48
+// size of the ring buffers (one byte stays free to tell full from empty): rx
+// takes two pipelined remote commands or binary frames (FRAME_DATA_MAX), tx
+// the longest message which is printed at once (uart_try_print)
+#define UART_RX_MAX     32
+#define UART_TX_MAX     24
+
+// baudrate after reset and the supported range [baud]
+#define UART_BAUD_DEF       9600
+#define UART_BAUD_MIN       1200
+#define UART_BAUD_MAX       250000
+
+// max. deviation of the generated baudrate [0,01%]
+#define UART_BAUD_MAX_ERR   200
+
+// max. time to send a full tx-ringbuffer, TXREG1 and the shift register at
+// the lowest baudrate (10 bits per byte) [ms]
+#define UART_FLUSH_TMO      ((UART_TX_MAX + 1) * 10000UL / UART_BAUD_MIN + 1)
+
+//*** typedef ******************************************************************
+
+// error counters of the uart (see uart_get_stat), saturating at 0xFFFF
+typedef struct uart_stat_s
+{
+    uint16_t txDropped;         // bytes rejected by uart_try_print
+    uint16_t rxDropped;         // received bytes lost (rx buffer full)
+    uint16_t overrun;           // overrun errors (OERR, bytes lost in hw)
+    uint16_t framing;           // bytes received with a framing error (FERR)
+    
+} uart_stat_t;
 
 //*** extern *******************************************************************
 
-extern char inBuf [UART_BUF_MAX];
-extern uint8_t inWr;
+extern char inBuf [UART_RX_MAX];
+extern volatile uint8_t inWr;
 extern uint8_t inRd;
 
 //*** prototypes ***************************************************************
@@ -52,7 +81,9 @@ void uart_init(void);
 /**
  * Please use this function to send messages over the uart interface. The data
  * will be moved into an internal fifo ringbuffer. Afterwards the data will be
- * shifted out if the cpu has some time left.
+ * shifted out in background by the tx interrupt (see uart_tx_isr). If the 
+ * ringbuffer is full the function waits for free space and calls the yield
+ * function meanwhile (see uart_set_yield), so no data gets lost.
  * 
  * @param pBuf Pointer to the message (string / char array with trailin zero).
  */
@@ -60,13 +91,125 @@ void uart_init(void);
 void uart_print (char *pBuf);
 
 /**
- * Don't call this function by your own. It will be called within the
- * func_workload function and automatically sends the tx-ringbuffer if data is
- * available and the cpu has some free time.
+ * This function sends a single byte (any value, e.g. of a binary frame). Like
+ * uart_print it waits for free space in the tx-ringbuffer.
+ * 
+ * @param c Byte to send.
+ */
+
+void uart_putc (char c);
+
+/**
+ * Non-blocking variant of uart_print. The message is only taken over if the
+ * ringbuffer has room for all of it. Otherwise nothing is sent and the bytes
+ * are counted as dropped (see uart_get_stat).
+ * 
+ * @param pBuf Pointer to the message (string / char array with trailin zero).
+ * @return true if the message was taken over, false if it was dropped.
+ */
+
+bool uart_try_print (char *pBuf);
+
+/**
+ * Use this function to check how many bytes can be printed without waiting.
+ * 
+ * @return Free bytes in the tx-ringbuffer (0..UART_TX_MAX-1).
+ */
+
+uint8_t uart_tx_free (void);
+
+/**
+ * Use this function to set the function which is called while uart_print
+ * waits for free space (e.g. to serve the spi jobs). The function must not
+ * print itself and must not change the message which is printed.
+ * 
+ * @param cb Yield function (NULL: none).
+ */
+
+void uart_set_yield (void (*cb)(void));
+
+/**
+ * This function copies the error counters of the uart.
+ * 
+ * @param pStat Pointer to the destination.
+ */
+
+void uart_get_stat (uart_stat_t *pStat);
+
+/**
+ * This function calculates the baudrate generator value (BRG16 = 1, BRGH = 1)
+ * for the given baudrate and the deviation of the resulting baudrate.
  * 
- * @param tmo Timeout in [ms] for this transceive (0 for no timeout)
+ * @param baud Requested baudrate (UART_BAUD_MIN..UART_BAUD_MAX).
+ * @param pBrg Pointer to the generator value (SPBRGH:SPBRG) or NULL.
+ * @return Deviation of the generated baudrate in [0,01%].
+ */
+
+int16_t uart_calc_baud (uint32_t baud, uint16_t *pBrg);
+
+/**
+ * Use this function to change the baudrate. The tx-ringbuffer will be sent
+ * with the old baudrate first (up to the stop bit of the last byte inside the
+ * shift register), so an answer printed before the call still uses the old
+ * baudrate completely.
+ * 
+ * @param baud New baudrate (UART_BAUD_MIN..UART_BAUD_MAX).
+ * @return false if the baudrate is out of range or its deviation is bigger
+ *         than UART_BAUD_MAX_ERR (the baudrate isn't changed).
+ */
+
+bool uart_set_baud (uint32_t baud);
+
+/**
+ * Use this function to read the current baudrate.
+ * 
+ * @return Baudrate (as requested by uart_set_baud).
+ */
+
+uint32_t uart_get_baud (void);
+
+/**
+ * Call this function right before the pic goes to sleep. The tx-ringbuffer
+ * will be sent and the auto wake up (WUE) is enabled, so a received byte
+ * wakes up the pic. The baudrate generator keeps its value during sleep.
+ */
+
+void uart_sleep (void);
+
+/**
+ * Call this function after the pic woke up (see uart_sleep). The auto wake up
+ * is disabled (it is still enabled if another source woke up the pic).
+ */
+
+void uart_wake (void);
+
+/**
+ * This function waits until the tx-ringbuffer is empty and the last byte was
+ * shifted out (TXREG1 and the shift register are empty, e.g. before the pic
+ * goes to sleep or the baudrate is changed).
+ * 
+ * @param tmo Timeout in [ms] (0 for no timeout)
+ */
+
+void uart_flush (uint16_t tmo);
+
+/**
+ * This function will automatically be called from the high priority interrupt
+ * if a byte was received. It moves the byte into the rx-ringbuffer (if there
+ * is room) and handles the receive errors: a framing error discards the byte,
+ * an overrun error restarts the receiver. Please don't call this function by
+ * your own.
+ */
+
+void uart_rx_isr (void);
+
+/**
+ * This function will automatically be called from the low priority interrupt
+ * if the uart is ready for the next byte. It loads the next byte of the
+ * tx-ringbuffer and disables the interrupt once the buffer is empty. Please
+ * don't call this function by your own.
  */
 
-void uart_tx (uint16_t tmo);
+void uart_tx_isr (void);
 
 #endif
@@ -57,17 +57,17 @@ OBJECTDIR=build/${CND_CONF}/${IMAGE_TYPE}
 DISTDIR=dist/${CND_CONF}/${IMAGE_TYPE}
 
 # Source Files Quoted if spaced
-SOURCEFILES_QUOTED_IF_SPACED=source/main.c source/spi.c source/lcd.c source/timer.c source/func.c source/isr.c source/uart.c source/eeprom.c
+SOURCEFILES_QUOTED_IF_SPACED=source/main.c source/spi.c source/lcd.c source/timer.c source/func.c source/isr.c source/uart.c source/eeprom.c source/frame.c
 
 # Object Files Quoted if spaced
-OBJECTFILES_QUOTED_IF_SPACED=${OBJECTDIR}/source/main.p1 ${OBJECTDIR}/source/spi.p1 ${OBJECTDIR}/source/lcd.p1 ${OBJECTDIR}/source/timer.p1 ${OBJECTDIR}/source/func.p1 ${OBJECTDIR}/source/isr.p1 ${OBJECTDIR}/source/uart.p1 ${OBJECTDIR}/source/eeprom.p1
-POSSIBLE_DEPFILES=${OBJECTDIR}/source/main.p1.d ${OBJECTDIR}/source/spi.p1.d ${OBJECTDIR}/source/lcd.p1.d ${OBJECTDIR}/source/timer.p1.d ${OBJECTDIR}/source/func.p1.d ${OBJECTDIR}/source/isr.p1.d ${OBJECTDIR}/source/uart.p1.d ${OBJECTDIR}/source/eeprom.p1.d
+OBJECTFILES_QUOTED_IF_SPACED=${OBJECTDIR}/source/main.p1 ${OBJECTDIR}/source/spi.p1 ${OBJECTDIR}/source/lcd.p1 ${OBJECTDIR}/source/timer.p1 ${OBJECTDIR}/source/func.p1 ${OBJECTDIR}/source/isr.p1 ${OBJECTDIR}/source/uart.p1 ${OBJECTDIR}/source/eeprom.p1 ${OBJECTDIR}/source/frame.p1
+POSSIBLE_DEPFILES=${OBJECTDIR}/source/main.p1.d ${OBJECTDIR}/source/spi.p1.d ${OBJECTDIR}/source/lcd.p1.d ${OBJECTDIR}/source/timer.p1.d ${OBJECTDIR}/source/func.p1.d ${OBJECTDIR}/source/isr.p1.d ${OBJECTDIR}/source/uart.p1.d ${OBJECTDIR}/source/eeprom.p1.d ${OBJECTDIR}/source/frame.p1.d
 
 # Object Files
-OBJECTFILES=${OBJECTDIR}/source/main.p1 ${OBJECTDIR}/source/spi.p1 ${OBJECTDIR}/source/lcd.p1 ${OBJECTDIR}/source/timer.p1 ${OBJECTDIR}/source/func.p1 ${OBJECTDIR}/source/isr.p1 ${OBJECTDIR}/source/uart.p1 ${OBJECTDIR}/source/eeprom.p1
+OBJECTFILES=${OBJECTDIR}/source/main.p1 ${OBJECTDIR}/source/spi.p1 ${OBJECTDIR}/source/lcd.p1 ${OBJECTDIR}/source/timer.p1 ${OBJECTDIR}/source/func.p1 ${OBJECTDIR}/source/isr.p1 ${OBJECTDIR}/source/uart.p1 ${OBJECTDIR}/source/eeprom.p1 ${OBJECTDIR}/source/frame.p1
 
 # Source Files
-SOURCEFILES=source/main.c source/spi.c source/lcd.c source/timer.c source/func.c source/isr.c source/uart.c source/eeprom.c
+SOURCEFILES=source/main.c source/spi.c source/lcd.c source/timer.c source/func.c source/isr.c source/uart.c source/eeprom.c source/frame.c
 
 
 CFLAGS=
@@ -162,6 +162,13 @@ ${OBJECTDIR}/source/eeprom.p1: source/eeprom.c  nbproject/Makefile-${CND_CONF}.m
 	${MP_CC} $(MP_EXTRA_CC_PRE) -mcpu=$(MP_PROCESSOR_OPTION) -c  -D__DEBUG=1  -fno-short-double -fno-short-float -memi=wordwrite -mrom=default,-1CFC-1FFE -O0 -fasmfile -maddrqual=ignore -xassembler-with-cpp -I"include" -Wa,-a -DXPRJ_default=$(CND_CONF)  -msummary=-psect,-class,+mem,-hex,-file  -ginhx032 -Wl,--data-init -mno-keep-startup -mno-download -mdefault-config-bits $(COMPARISON_BUILD)  -std=c99 -gdwarf-3 -mstack=compiled:auto:auto:auto     -o ${OBJECTDIR}/source/eeprom.p1 source/eeprom.c 
 	@${FIXDEPS} ${OBJECTDIR}/source/eeprom.p1.d $(SILENT) -rsi ${MP_CC_DIR}../  
 	
+${OBJECTDIR}/source/frame.p1: source/frame.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}/source" 
+	@${RM} ${OBJECTDIR}/source/frame.p1.d 
+	@${RM} ${OBJECTDIR}/source/frame.p1 
+	${MP_CC} $(MP_EXTRA_CC_PRE) -mcpu=$(MP_PROCESSOR_OPTION) -c  -D__DEBUG=1  -fno-short-double -fno-short-float -memi=wordwrite -mrom=default,-1CFC-1FFE -O0 -fasmfile -maddrqual=ignore -xassembler-with-cpp -I"include" -Wa,-a -DXPRJ_default=$(CND_CONF)  -msummary=-psect,-class,+mem,-hex,-file  -ginhx032 -Wl,--data-init -mno-keep-startup -mno-download -mdefault-config-bits $(COMPARISON_BUILD)  -std=c99 -gdwarf-3 -mstack=compiled:auto:auto:auto     -o ${OBJECTDIR}/source/frame.p1 source/frame.c 
+	@${FIXDEPS} ${OBJECTDIR}/source/frame.p1.d $(SILENT) -rsi ${MP_CC_DIR}../  
+	
 else
 ${OBJECTDIR}/source/main.p1: source/main.c  nbproject/Makefile-${CND_CONF}.mk
 	@${MKDIR} "${OBJECTDIR}/source" 
@@ -219,6 +226,13 @@ ${OBJECTDIR}/source/eeprom.p1: source/eeprom.c  nbproject/Makefile-${CND_CONF}.m
 	${MP_CC} $(MP_EXTRA_CC_PRE) -mcpu=$(MP_PROCESSOR_OPTION) -c  -fno-short-double -fno-short-float -memi=wordwrite -mrom=default,-1CFC-1FFE -O0 -fasmfile -maddrqual=ignore -xassembler-with-cpp -I"include" -Wa,-a -DXPRJ_default=$(CND_CONF)  -msummary=-psect,-class,+mem,-hex,-file  -ginhx032 -Wl,--data-init -mno-keep-startup -mno-download -mdefault-config-bits $(COMPARISON_BUILD)  -std=c99 -gdwarf-3 -mstack=compiled:auto:auto:auto     -o ${OBJECTDIR}/source/eeprom.p1 source/eeprom.c 
 	@${FIXDEPS} ${OBJECTDIR}/source/eeprom.p1.d $(SILENT) -rsi ${MP_CC_DIR}../  
 	
+${OBJECTDIR}/source/frame.p1: source/frame.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}/source" 
+	@${RM} ${OBJECTDIR}/source/frame.p1.d 
+	@${RM} ${OBJECTDIR}/source/frame.p1 
+	${MP_CC} $(MP_EXTRA_CC_PRE) -mcpu=$(MP_PROCESSOR_OPTION) -c  -fno-short-double -fno-short-float -memi=wordwrite -mrom=default,-1CFC-1FFE -O0 -fasmfile -maddrqual=ignore -xassembler-with-cpp -I"include" -Wa,-a -DXPRJ_default=$(CND_CONF)  -msummary=-psect,-class,+mem,-hex,-file  -ginhx032 -Wl,--data-init -mno-keep-startup -mno-download -mdefault-config-bits $(COMPARISON_BUILD)  -std=c99 -gdwarf-3 -mstack=compiled:auto:auto:auto     -o ${OBJECTDIR}/source/frame.p1 source/frame.c 
+	@${FIXDEPS} ${OBJECTDIR}/source/frame.p1.d $(SILENT) -rsi ${MP_CC_DIR}../  
+	
 endif
 
 # ------------------------------------------------------------------------------------
@@ -26,7 +26,32 @@
 #include <stdint.h>
 #include "eeprom.h"
 #include "spi.h"
-#include "func.h"
+
+//*** static variables *********************************************************
+
+// read in progress (see eeprom_25LC256_read_async)
+static uint16_t rdAddr;
+static uint8_t *pRdBuf;
+static uint8_t rdLen;
+static void (*rdCb)(void);
+static volatile bool rdBusy = false;
+
+// start of the current read (the buffered write data is copied over it)
+static uint16_t rdStart;
+static uint8_t *pRdStart;
+static uint8_t rdTotal;
+
+// write-back buffer: a copy of the page at wbPage, the bytes wbLo..wbHi-1
+// weren't written into the EEPROM yet (none if wbLo == wbHi)
+static uint8_t wbBuf[EEPROM_PAGE];
+static uint16_t wbPage = 0;
+static uint8_t wbLo = 0;
+static uint8_t wbHi = 0;
+
+// spi jobs of the current chunk (READ instruction + address, data)
+static uint8_t rdCmd[3];
+static spi_job_t rdCmdJob;
+static spi_job_t rdDataJob;
 
 //*** prototypes ***************************************************************
 
@@ -37,111 +62,393 @@
 
 static void __eeprom_25LC56_set_wel (void);
 
+/**
+ * This function queues the next chunk of the current read. It is the
+ * completion callback of the previous chunk as well.
+ */
+
+static void __eeprom_25LC256_read_chunk (void);
+
+/**
+ * This function copies the buffered write data over the data of a read.
+ * 
+ * @param addr Start address of the read.
+ * @param pBuf Pointer to the read data.
+ * @param len Number of bytes read.
+ */
+
+static void __eeprom_wb_overlay (uint16_t addr, uint8_t *pBuf, uint8_t len);
+
+/**
+ * This function takes over write data (within a single page) into the 
+ * write-back buffer. The buffered bytes of another page are written before.
+ * A gap between the new and the buffered bytes is read from the EEPROM, so
+ * the buffered range can be written at once.
+ * 
+ * @param addr Start address.
+ * @param pBuf Pointer to the data.
+ * @param len Number of bytes.
+ */
+
+static void __eeprom_wb_put (uint16_t addr, uint8_t *pBuf, uint8_t len);
+
+/**
+ * This function writes data within a single page into the EEPROM (WREN, 
+ * write instruction, wait for the end of the write cycle).
+ * 
+ * @param addr Start address.
+ * @param pBuf Pointer to the data (NULL: the bytes are set to 0xFF).
+ * @param len Number of bytes (must not cross a page boundary).
+ */
+
+static void __eeprom_25LC256_write_page (uint16_t addr, uint8_t *pBuf, 
+                                         uint8_t len);
+
 //*** functions ****************************************************************
 
 void eeprom_25LC256_read (uint16_t addr, uint8_t *pBuf, uint8_t len)
 {
-    uint8_t buf [3];
-    uint8_t *p = pBuf;
-    uint8_t next_len;
+    eeprom_25LC256_read_async(addr, pBuf, len, NULL);
+    
+    // serve the callbacks meanwhile (e.g. the next chunk, lcd updates)
+    while(rdBusy)
+    {
+        spi_dispatch();
+    }
+}
+
+//..............................................................................
+
+void eeprom_25LC256_read_async (uint16_t addr, uint8_t *pBuf, uint8_t len,
+                                void (*cb)(void))
+{
+    // wait for the previous read
+    while(rdBusy)
+    {
+        spi_dispatch();
+    }
+    
+    rdAddr = addr;
+    pRdBuf = pBuf;
+    rdLen = len;
+    rdCb = cb;
+    rdBusy = true;
     
-    // copy READ instruction and read address into buffer
-    buf[0] = EEPROM_25LC256_READ;
+    rdStart = addr;
+    pRdStart = pBuf;
+    rdTotal = len;
+    
+    __eeprom_25LC256_read_chunk();
+}
+
+//..............................................................................
+
+bool eeprom_25LC256_read_busy (void)
+{
+    return rdBusy;
+}
+
+//..............................................................................
+
+void eeprom_25LC256_write (uint16_t addr, uint8_t *pBuf, uint8_t len)
+{
+    uint8_t n;
     
     while(len)
     {
-        // check how many bytes can be written within the next command
-        next_len = 64 - (addr % 64);
-        
-        // if less bytes shall be send, take this as next length
-        if(next_len > len) next_len = len;
+        // up to the end of the page
+        n = EEPROM_PAGE - (addr % EEPROM_PAGE);
         
-        // copy the next address into the buffer
-        buf[1] = (uint8_t)((addr >> 8) & 0xFF);
-        buf[2] = (uint8_t)(addr & 0xFF);
+        if(n > len) n = len;
         
-        EEPROM_CS = 0;
-        spi_transfer(buf, NULL, 3);
-        spi_transfer(NULL, p, next_len);
-        EEPROM_CS = 1;
+        __eeprom_wb_put(addr, pBuf, n);
         
-        // update the remaining length and the address
-        len -= next_len;
-        addr += next_len;
+        len -= n;
+        addr += n;
+        pBuf += n;
     }
 }
 
 //..............................................................................
 
-void eeprom_25LC256_write (uint16_t addr, uint8_t *pBuf, uint8_t len)
+void eeprom_25LC256_flush (void)
 {
-    uint8_t buf [3];
-    uint8_t *p = pBuf;
-    uint8_t next_len;
- 
-    // set the write instruction
-    buf[0] = EEPROM_25LC256_WRITE;
+    if( wbLo == wbHi )
+    {
+        return;
+    }
     
-    // write until all data has been written
-    while(len)
+    // a read in progress must not see the data half written
+    while( rdBusy )
     {
-        // check how many bytes can be written within the next command
-        next_len = 64 - (addr % 64);
-        
-        // if less bytes shall be send, take this as next length
-        if(next_len > len) next_len = len;
-        
-        // enable the write latch by sending WREN
-        __eeprom_25LC56_set_wel();
+        spi_dispatch();
+    }
+    
+    __eeprom_25LC256_write_page(wbPage + wbLo, &wbBuf[wbLo], wbHi - wbLo);
+    wbLo = wbHi = 0;
+}
 
-        // check if WEL bit is really set
-        while( !(eeprom_25LC56_read_status_reg() & EEPROM_25LC256_SR_WEL) );
-        
-        // copy the (next) address to the buffer
-        buf[1] = (uint8_t)((addr >> 8) & 0xFF);
-        buf[2] = (uint8_t)(addr & 0xFF);
-        
-        // send the command and address
-        EEPROM_CS = 0;
-        spi_transfer(buf, NULL, 3);
-        
-        // continue by sending the data
-        spi_transfer(p, NULL, next_len);
-        EEPROM_CS = 1;
-        
-        // update the remaining length and the address
-        len -= next_len;
-        addr += next_len;
-        
-        // wait until WIP bit is cleared
-        while( eeprom_25LC56_read_status_reg() & EEPROM_25LC256_SR_WIP );
+//..............................................................................
+
+void eeprom_25LC256_erase_page (uint16_t addr)
+{
+    addr &= ~(uint16_t)(EEPROM_PAGE - 1);
+    
+    // a read in progress still gets the old data
+    while( rdBusy )
+    {
+        spi_dispatch();
+    }
+    
+    // buffered data of this page is overwritten anyway, the one of another
+    // page goes first
+    if( addr == wbPage )
+    {
+        wbLo = wbHi = 0;
+    }
+    else
+    {
+        eeprom_25LC256_flush();
     }
+    
+    // a write cycle of its own, the following writes of the page can't
+    // change the old data by a torn cycle
+    __eeprom_25LC256_write_page(addr, NULL, EEPROM_PAGE);
 }
 
 //..............................................................................
 
 uint8_t eeprom_25LC56_read_status_reg (void)
 {
-    uint8_t buf;
+    uint8_t buf [2];
     
-    buf = EEPROM_25LC256_RDSR;
+    // instruction and a dummy byte to clock the status register out
+    buf[0] = EEPROM_25LC256_RDSR;
+    buf[1] = 0x00;
     
-    EEPROM_CS = 0;
-    spi_transfer(&buf, NULL, 1);
-    spi_transfer(NULL, &buf, 1);
-    EEPROM_CS = 1;
+    spi_select(SPI_DEV_EEPROM);
+    spi_txrx(buf, buf, 2);
+    spi_deselect(SPI_DEV_EEPROM);
     
-    return buf;
+    return buf[1];
 }
+
+//..............................................................................
+
+uint8_t eeprom_int_read (uint8_t addr)
+{
+    EEADR = addr;
+    
+    // access the data EEPROM
+    EECON1bits.EEPGD = 0;
+    EECON1bits.CFGS = 0;
+    EECON1bits.RD = 1;
+    
+    return EEDATA;
+}
+
+//..............................................................................
+
+void eeprom_int_write (uint8_t addr, uint8_t val)
+{
+    bool gie = INTCONbits.GIEH;
+    
+    EEADR = addr;
+    EEDATA = val;
+    
+    // access the data EEPROM and enable writes
+    EECON1bits.EEPGD = 0;
+    EECON1bits.CFGS = 0;
+    EECON1bits.WREN = 1;
+    
+    // the unlock sequence must not be interrupted
+    INTCONbits.GIEH = 0;
+    EECON2 = 0x55;
+    EECON2 = 0xAA;
+    EECON1bits.WR = 1;
+    INTCONbits.GIEH = gie;
+    
+    // wait until the write cycle completed
+    while( EECON1bits.WR );
+    
+    EECON1bits.WREN = 0;
+}
+
 //*** static functions *********************************************************
 
+static void __eeprom_25LC256_read_chunk (void)
+{
+    uint8_t n = rdLen;
+    
+    // all data read?
+    if( !n )
+    {
+        // the buffered data is newer than the one inside the EEPROM
+        __eeprom_wb_overlay(rdStart, pRdStart, rdTotal);
+        
+        rdBusy = false;
+        
+        if(rdCb)
+        {
+            rdCb();
+        }
+        
+        return;
+    }
+    
+    if(n > EEPROM_CHUNK)
+    {
+        n = EEPROM_CHUNK;
+    }
+    
+    rdCmd[0] = EEPROM_25LC256_READ;
+    rdCmd[1] = (uint8_t)((rdAddr >> 8) & 0xFF);
+    rdCmd[2] = (uint8_t)(rdAddr & 0xFF);
+    
+    // instruction + address, the chip select is kept for the data
+    rdCmdJob.dev  = SPI_DEV_EEPROM;
+    rdCmdJob.rs   = SPI_RS_KEEP;
+    rdCmdJob.pWr  = rdCmd;
+    rdCmdJob.pRd  = NULL;
+    rdCmdJob.len  = 3;
+    rdCmdJob.cb   = NULL;
+    rdCmdJob.hold = true;
+    
+    rdDataJob.dev  = SPI_DEV_EEPROM;
+    rdDataJob.rs   = SPI_RS_KEEP;
+    rdDataJob.pWr  = NULL;
+    rdDataJob.pRd  = pRdBuf;
+    rdDataJob.len  = n;
+    rdDataJob.cb   = __eeprom_25LC256_read_chunk;
+    rdDataJob.hold = false;
+    
+    // next chunk (queued once this one is done)
+    rdAddr += n;
+    pRdBuf += n;
+    rdLen  -= n;
+    
+    spi_queue(&rdCmdJob);
+    spi_queue(&rdDataJob);
+}
+
+//..............................................................................
+
 static void __eeprom_25LC56_set_wel (void)
 {
     uint8_t buf = EEPROM_25LC256_WREN;
     
-    EEPROM_CS = 0;
-    spi_transfer(&buf, NULL, 1);
-    EEPROM_CS = 1;
+    spi_select(SPI_DEV_EEPROM);
+    spi_tx(&buf, 1);
+    spi_deselect(SPI_DEV_EEPROM);
+}
+
+//..............................................................................
+
+static void __eeprom_wb_overlay (uint16_t addr, uint8_t *pBuf, uint8_t len)
+{
+    uint16_t lo = wbPage + wbLo;
+    uint16_t hi = wbPage + wbHi;
+    
+    // the part of the read inside the buffered range
+    if( lo < addr )
+    {
+        lo = addr;
+    }
+    
+    if( hi > addr + len )
+    {
+        hi = addr + len;
+    }
+    
+    for(; lo<hi; lo++)
+    {
+        pBuf[lo - addr] = wbBuf[lo - wbPage];
+    }
+}
+
+//..............................................................................
+
+static void __eeprom_wb_put (uint16_t addr, uint8_t *pBuf, uint8_t len)
+{
+    uint8_t lo = addr % EEPROM_PAGE;
+    uint8_t hi = lo + len;
+    uint8_t i;
+    
+    // another page is buffered? -> write it first
+    if( (addr - lo) != wbPage )
+    {
+        eeprom_25LC256_flush();
+        wbPage = addr - lo;
+    }
+    
+    if( wbLo == wbHi )
+    {
+        wbLo = lo;
+        wbHi = hi;
+    }
+    else
+    {
+        // fill a gap between the new and the buffered data from the EEPROM
+        if( hi < wbLo )
+        {
+            eeprom_25LC256_read(wbPage + hi, &wbBuf[hi], wbLo - hi);
+        }
+        else if( lo > wbHi )
+        {
+            eeprom_25LC256_read(wbPage + wbHi, &wbBuf[wbHi], lo - wbHi);
+        }
+        
+        if( lo < wbLo ) wbLo = lo;
+        if( hi > wbHi ) wbHi = hi;
+    }
+    
+    for(i=0; i<len; i++)
+    {
+        wbBuf[lo + i] = pBuf[i];
+    }
+}
+
+//..............................................................................
+
+static void __eeprom_25LC256_write_page (uint16_t addr, uint8_t *pBuf, 
+                                         uint8_t len)
+{
+    uint8_t buf [3];
+    
+    // enable the write latch by sending WREN
+    __eeprom_25LC56_set_wel();
+
+    // check if WEL bit is really set
+    while( !(eeprom_25LC56_read_status_reg() & EEPROM_25LC256_SR_WEL) );
+    
+    // set the write instruction and the address
+    buf[0] = EEPROM_25LC256_WRITE;
+    buf[1] = (uint8_t)((addr >> 8) & 0xFF);
+    buf[2] = (uint8_t)(addr & 0xFF);
+    
+    // send the command and address
+    spi_select(SPI_DEV_EEPROM);
+    spi_tx(buf, 3);
+    
+    // continue by sending the data (or the erased value)
+    if( pBuf )
+    {
+        spi_tx(pBuf, len);
+    }
+    else
+    {
+        buf[0] = 0xFF;
+        
+        while(len--)
+        {
+            spi_tx(buf, 1);
+        }
+    }
+    
+    spi_deselect(SPI_DEV_EEPROM);
+    
+    // wait until WIP bit is cleared
+    while( eeprom_25LC56_read_status_reg() & EEPROM_25LC256_SR_WIP );
 }
 
 //..............................................................................
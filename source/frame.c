@@ -0,0 +1,207 @@
+/*******************************************************************************
+ *
+ * File:        frame.c
+ * Project:     PICLCD-Stopwatch
+ * Author:      Nicolas Pannwitz (https://pic-projekte.de/)
+ * Comment:
+ * Licence:     Copyrightn (C) 2018 Nicolas Pannwitz
+ * 
+ *              This program is free software: You can redistribute it and/or 
+ *              modify it under the terms of the GNU General Public License as
+ *              published by the Free Software Foundation, either version 3 of
+ *              the License, or (at your option) any later version.
+ *
+ *              This program is distributed in the hope that it will be useful,
+ *              but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *              MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *              GNU General Public License for more details.
+ * 
+ *              You should have received a copy of the GNU General Public
+ *              License along with this program.
+ *              If not, see https://www.gnu.org/licenses/
+ * 
+ ******************************************************************************/
+
+#include <xc.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "frame.h"
+#include "uart.h"
+
+//*** global variables *********************************************************
+
+// last received frame (see frame_rx)
+frame_t frameRx;
+
+//*** static variables *********************************************************
+
+// crc of the frame which is sent right now
+static uint16_t txCrc;
+
+// receive state: number of bytes in frameRx (0xFF: frame too long) and the
+// last byte was FRAME_ESC
+static uint8_t rxCnt = 0;
+static bool rxEsc = false;
+
+//*** prototypes ***************************************************************
+
+/**
+ * This function adds a byte to a CRC-16/CCITT (bitwise, no table).
+ * 
+ * @param crc Current crc.
+ * @param b Byte to add.
+ * @return New crc.
+ */
+
+static uint16_t __frame_crc (uint16_t crc, uint8_t b);
+
+/**
+ * This function sends a byte escaped (see FRAME_ESC).
+ * 
+ * @param b Byte to send.
+ */
+
+static void __frame_send (uint8_t b);
+
+//*** functions ****************************************************************
+
+void frame_begin (uint8_t type, uint8_t seq, uint8_t len)
+{
+    // the leading FRAME_END discards line noise in front of the frame
+    uart_putc((char)FRAME_END);
+    
+    txCrc = FRAME_CRC_INIT;
+    
+    frame_put(type);
+    frame_put(seq);
+    frame_put(len);
+}
+
+//..............................................................................
+
+void frame_put (uint8_t b)
+{
+    txCrc = __frame_crc(txCrc, b);
+    __frame_send(b);
+}
+
+//..............................................................................
+
+void frame_end (void)
+{
+    __frame_send((uint8_t)txCrc);
+    __frame_send((uint8_t)(txCrc >> 8));
+    
+    uart_putc((char)FRAME_END);
+}
+
+//..............................................................................
+
+uint8_t frame_rx (uint8_t c)
+{
+    uint8_t *p = (uint8_t*)&frameRx;
+    uint16_t crc;
+    uint8_t i, n;
+    
+    if( c == FRAME_END )
+    {
+        n = rxCnt;
+        rxCnt = 0;
+        rxEsc = false;
+        
+        // nothing in between? (e.g. the leading FRAME_END)
+        if( !n )
+        {
+            return FRAME_RX_NONE;
+        }
+        
+        // type, sequence, length, crc and the announced data received?
+        if( n < 5 || n > sizeof(frame_t) || frameRx.len != n - 5 )
+        {
+            return FRAME_RX_ERR;
+        }
+        
+        crc = FRAME_CRC_INIT;
+        
+        for(i=0; i<n-2; i++)
+        {
+            crc = __frame_crc(crc, p[i]);
+        }
+        
+        if( p[n-2] != (uint8_t)crc || p[n-1] != (uint8_t)(crc >> 8) )
+        {
+            return FRAME_RX_ERR;
+        }
+        
+        return FRAME_RX_OK;
+    }
+    
+    if( c == FRAME_ESC )
+    {
+        rxEsc = true;
+        return FRAME_RX_NONE;
+    }
+    
+    if( rxEsc )
+    {
+        rxEsc = false;
+        c = (c == FRAME_ESC_END) ? FRAME_END : FRAME_ESC;
+    }
+    
+    // too long? -> wait for the end and discard it (0xFF never matches)
+    if( rxCnt < sizeof(frame_t) )
+    {
+        p[rxCnt++] = c;
+    }
+    else
+    {
+        rxCnt = 0xFF;
+    }
+    
+    return FRAME_RX_NONE;
+}
+
+//*** static functions *********************************************************
+
+static uint16_t __frame_crc (uint16_t crc, uint8_t b)
+{
+    uint8_t i;
+    
+    crc ^= (uint16_t)b << 8;
+    
+    for(i=0; i<8; i++)
+    {
+        if( crc & 0x8000 )
+        {
+            crc = (crc << 1) ^ FRAME_CRC_POLY;
+        }
+        else
+        {
+            crc <<= 1;
+        }
+    }
+    
+    return crc;
+}
+
+//..............................................................................
+
+static void __frame_send (uint8_t b)
+{
+    if( b == FRAME_END )
+    {
+        uart_putc((char)FRAME_ESC);
+        uart_putc((char)FRAME_ESC_END);
+    }
+    else if( b == FRAME_ESC )
+    {
+        uart_putc((char)FRAME_ESC);
+        uart_putc((char)FRAME_ESC_ESC);
+    }
+    else
+    {
+        uart_putc((char)b);
+    }
+}
+
+//..............................................................................
@@ -31,19 +31,42 @@
 #include "timer.h"
 #include "uart.h"
 #include "eeprom.h"
+#include "spi.h"
 #include "build.h"
 
 //*** global variables *********************************************************
 
 uint8_t uartBuf;
 
+//*** constants ****************************************************************
+
+// packed BCD of 0..99 (two digit fields without a division)
+static const uint8_t bcdTab[100] =
+{
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19,
+    0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29,
+    0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+    0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+    0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99
+};
+
 //*** static variables *********************************************************
 
-// stop watch' state machine
-static uint8_t state = SW_STATE_IDLE;
+// lanes (state machine, measurement) and the lane shown on the lcd
+static lane_t lanes[MAX_LANES];
+static uint8_t laneSel = 0;
+static lane_t *pLane = &lanes[0];
+
+// log of the records inside the EEPROM region of each lane
+static log_t logs[MAX_LANES];
 
-// holds the current measurement
-static __pack sw_t sWatch = {0};
+// running lanes (bitfield), only these cost time each tick
+static uint8_t laneRun = 0;
 
 // last pressed/released key bitfields
 static uint8_t lastPressedKey = 0;
@@ -53,31 +76,376 @@ static uint8_t lastReleasedKey = 0;
 static uint16_t debCntUSR = 0;
 static uint16_t debCntPB = 0;
 
-// state counter
-static uint16_t state_cnt = 0;
+// software timer for the automatic state transitions (see func_init)
+static int8_t stateTimer;
+
+// remaining display toggles in the record state
+static uint8_t recToggleCnt = 0;
+
+// PB edges captured by the interrupt on change
+static volatile ts_t pbEdgeTs[2];
+static volatile uint8_t pbEdgeValid = 0;
+
+// timestamp of the last PB change detected by __func_debounce
+static ts_t pbTs;
+
+// trigger mode (start/stop by photogates, see TRIG_MODE_x)
+static uint8_t trigMode = TRIG_MODE_OFF;
+static uint16_t trigLockout = TRIG_LOCKOUT;
+
+// laps (ring buffer) and the last lap captured by INT2
+static sw_t laps[MAX_LAPS];
+static uint8_t lapWr = 0;
+static uint8_t lapCnt = 0;
+static volatile ts_t lapTs;
+
+// software timer to show a lap or the lane for LAP_DISP_TIME (see func_init)
+static int8_t lapTimer;
+static bool lapShown = false;
+
+// software timer to refresh the lcd while running and its period [10ms]
+static int8_t dispTimer;
+static uint8_t dispPeriod = 100 / DISP_RATE_DEF;
+
+// export job: state, lane and its oldest log page, indices of the records
+// not read yet [expLow, expHigh) and the part of them read into expBuf 
+// (expLen bytes, expPos bytes left to send)
+static uint8_t expState = EXP_STATE_IDLE;
+static uint8_t expLn;
+static uint16_t expTail;
+static uint16_t expHigh;
+static uint16_t expLow;
+static uint8_t expBuf[EEPROM_PAGE];
+static uint8_t expLen;
+static uint8_t expPos;
+
+// binary export: number of records, sequence number of the last frame, a 
+// data frame was started and its bytes not read yet
+static bool expBin = false;
+static uint16_t expCnt;
+static uint8_t expSeq;
+static bool expFrame;
+static uint8_t expLeft;
+
+// telemetry: period of the time messages (0: not subscribed), tick of the
+// last time message, last sent states and keys and the frame sequence number
+static uint16_t telePeriod = 0;
+static uint32_t teleLast;
+static uint8_t teleState[MAX_LANES];
+static uint8_t teleKeys;
+static uint8_t teleSeq = 0;
+
+// remote protocol (see REM_MODE_x)
+static uint8_t remMode = REM_MODE_ASCII;
+
+// software timer to restore the old baudrate (0: new baudrate confirmed)
+static int8_t baudTimer;
+static uint32_t baudOld = 0;
+
+// clock correction [ppm] (positive: the oscillator is too fast) and its
+// magnitude as fraction of 2^32 (see __func_set_ppm)
+static int16_t calPpm = 0;
+static uint32_t calFactor = 0;
+
+// calibration session: first host reference time [ms] and own timestamp
+static bool calActive = false;
+static uint32_t calHost;
+static ts_t calTs;
+
+// opcode, numeric arguments and request id of the current remote message
+// (<#id:OP|123|456>)
+static uint16_t remOp;
+static uint32_t remArg[REM_ARG_MAX];
+static uint8_t remArgCnt;
+static uint16_t remId;
+static bool remHasId;
+
+// gate edges captured by INT0/INT1 and the tick of the last accepted edge
+static volatile ts_t trigTs[2];
+static volatile uint32_t trigLast[2];
+static volatile uint8_t trigValid = 0;
+
+// last converted time and its components (see __func_split_time)
+static sw_t splitVal = 0;
+static split_t split;
 
 // this buffer is used for converting numbers to its string representation
-static char gBuf[9];
+static char gBuf[11];
 
 //*** prototypes ***************************************************************
 
 /**
- * This function will update tthe stop watch and also display the new stop watch
- * value on the lcd (by calling func_disp_sw).
+ * This function will update tthe selected lane and also display the new stop
+ * watch value on the lcd (by calling func_disp_sw). All ticks between the last
+ * update and the given tick count will be added to the measurement, so no time
+ * gets lost if the main loop was blocked for more than 10ms. It is called by
+ * the display timer (see __func_disp_timeout), not every tick.
+ * 
+ * @param now Current value of the free-running tick counter.
+ */
+
+static void __func_update_stopwatch (uint32_t now);
+
+/**
+ * This function will (re)start the measurement of a lane at the given 
+ * timestamp. The current value of the measurement will be continued.
+ * 
+ * @param ln Lane number (0..MAX_LANES-1).
+ * @param pTs Pointer to the start timestamp.
+ */
+
+static void __func_start_stopwatch (uint8_t ln, ts_t *pTs);
+
+/**
+ * This function will stop the measurement of a lane at the given timestamp. 
+ * The final value is calculated from the start and stop timestamps with a
+ * resolution of 1ms and displayed on the lcd (selected lane only).
+ * 
+ * @param ln Lane number (0..MAX_LANES-1).
+ * @param pTs Pointer to the stop timestamp.
+ */
+
+static void __func_stop_stopwatch (uint8_t ln, ts_t *pTs);
+
+/**
+ * This function selects the lane shown on the lcd and controlled by PB, USR 
+ * and the remote commands. The lane number is shown for LAP_DISP_TIME.
+ * 
+ * @param ln Lane number (0..MAX_LANES-1).
+ */
+
+static void __func_select_lane (uint8_t ln);
+
+/**
+ * This function takes over the lap captured by func_lap into the lap ring
+ * buffer and shows it on the lcd for LAP_DISP_TIME. It has to be called if 
+ * status.iLap is set.
+ */
+
+static void __func_handle_lap (void);
+
+/**
+ * This function is the callback of the lap timer. The time of the selected
+ * lane will be displayed again.
+ */
+
+static void __func_lap_timeout (void);
+
+/**
+ * This function (re)starts the display timer if the selected lane is running
+ * and stops it otherwise. It has to be called whenever the selected lane 
+ * starts, stops or changes.
+ */
+
+static void __func_arm_disp_timer (void);
+
+/**
+ * This function is the callback of the display timer. The time of the 
+ * selected lane will be updated and displayed (every dispPeriod ticks).
+ */
+
+static void __func_disp_timeout (void);
+
+/**
+ * This function sets the lcd refresh rate of a running measurement. The rate
+ * is rounded to a whole number of 10ms ticks.
+ * 
+ * @param hz Refresh rate in [Hz] (1..DISP_RATE_MAX).
+ */
+
+static void __func_set_disp_rate (uint8_t hz);
+
+/**
+ * This function is called while uart_print waits for free space in the
+ * tx-ringbuffer. It serves the finished spi jobs (e.g. the lcd updates). 
+ * Everything else waits for the next func_workload call, because it may use
+ * gBuf (which may be printed right now) or print itself.
+ */
+
+static void __func_yield (void);
+
+/**
+ * This function is the callback of the baudrate timer. The new baudrate was
+ * not confirmed by the host in time, so the old baudrate is restored.
+ */
+
+static void __func_baud_timeout (void);
+
+/**
+ * This function starts the export of the records (measurements and laps)
+ * saved inside an EEPROM region. The header (<4|n or a frame with the number
+ * of measurements and the number of records) is sent at once, the records
+ * follow in background (see __func_export_step). The ascii export sends them
+ * newest first, laps get an L. In REM_MODE_BIN they are sent oldest first as
+ * FRAME_TYPE_DATA frames (index of the first record + up to EXP_FRAME_RECS
+ * raw records, laps have SW_LAP_FLAG set), the export ends with an empty one
+ * (index behind the last record).
+ * 
+ * @param ln Lane number (0..MAX_LANES-1).
+ * @param first Index of the first record to export (0: oldest).
+ * @param n Max. number of records to export.
+ * @param type Frame type of the header (REM_MODE_BIN only).
+ * @param seq Sequence number of the header (REM_MODE_BIN only).
+ */
+
+static void __func_export_start (uint8_t ln, uint16_t first, uint16_t n,
+                                 uint8_t type, uint8_t seq);
+
+/**
+ * This function starts reading the next records into expBuf: the ascii export
+ * reads the log page with the newest record not read yet (down to expLow), 
+ * the binary one reads upwards from expLow to the end of the log page or of 
+ * the frame.
+ */
+
+static void __func_export_read (void);
+
+/**
+ * This function is the callback of the page read. The measurements of expBuf
+ * are ready to be sent.
+ */
+
+static void __func_export_read_done (void);
+
+/**
+ * This function advances the export job. It sends as many measurements of
+ * expBuf as fit into the tx-ringbuffer right now and never waits for the 
+ * uart. It has to be called from func_workload while expState is 
+ * EXP_STATE_SEND.
+ */
+
+static void __func_export_step (void);
+
+/**
+ * This function advances the binary export job (see __func_export_step). A
+ * frame is sent over several calls while the uart has no room and over 
+ * several reads of expBuf.
+ */
+
+static void __func_export_step_bin (void);
+
+/**
+ * This function writes all laps of the ring buffer (oldest first) into the
+ * EEPROM region of the selected lane and empties the ring buffer. The laps 
+ * are saved like measurements but with SW_LAP_FLAG set.
  */
 
-static void __func_update_stopwatch (void);
+static void __func_flush_laps (void);
 
 /**
- * This function will convert the stop watch time (milli seconds, seconds and
- * minutes) to an string (char array) of the formar <M><M>:<m><m>:<ms><ms>.
+ * This function will convert the stop watch time to an string (char array) of
+ * the format <M><M>:<s><s>:<cs><cs> (hundredths of a second). From 100 minutes
+ * on the format <H><H>:<M><M>:<s><s> is used.
  * 
- * @param pSw Pointer to the stop watch struct containing the stop watch values.
+ * @param pSw Pointer to the stop watch time.
  * @return Pointer to the string (char array).
  */
 
 static char* __func_time_to_str (sw_t *pSw);
 
+/**
+ * This function will convert the stop watch time to the string shown on the
+ * lcd. Below 10 minutes the format <M>:<s><s>.<ms><ms><ms> is used in order to
+ * display the full resolution, otherwise see __func_time_to_str.
+ * 
+ * @param pSw Pointer to the stop watch time.
+ * @return Pointer to the string (char array).
+ */
+
+static char* __func_time_to_disp_str (sw_t *pSw);
+
+/**
+ * This function splits the stop watch time into hours, minutes, seconds and
+ * milliseconds (see split). The last result is kept, so a time slightly above
+ * the last one (e.g. the running time) is split by adding the difference. 
+ * Otherwise the components are counted by subtraction. Both ways don't need a
+ * division.
+ * 
+ * @param t Stop watch time in [ms] (without SW_LAP_FLAG).
+ */
+
+static void __func_split_time (sw_t t);
+
+/**
+ * This function writes a number (0..99) as two digits.
+ * 
+ * @param p Pointer to the destination (2 chars).
+ * @param val Number (0..99).
+ */
+
+static void __func_2_digits (char *p, uint8_t val);
+
+/**
+ * This function converts a value into decimal digits by the double dabble
+ * algorithm (shift and add 3, no division) and writes them into gBuf.
+ * 
+ * @param val Value to convert.
+ * @param bits Number of valid bits of val (16 or 32).
+ * @param digits Number of digits to write (with leading zeros, max. 10).
+ * @return Pointer to the null terminated decimal string of val
+ */
+
+static char* __func_dabble (uint32_t val, uint8_t bits, uint8_t digits);
+
+/**
+ * This function writes three two-digit numbers seperated by ':' into gBuf.
+ * 
+ * @param a First number (0..99).
+ * @param b Second number (0..99).
+ * @param c Third number (0..99).
+ * @return Pointer to the string (char array).
+ */
+
+static char* __func_3x2_to_str (uint8_t a, uint8_t b, uint8_t c);
+
+/**
+ * Use this function to get the time of the last PB edge in the given 
+ * direction. If the interrupt on change didn't capture a (recent) edge the
+ * current time is taken instead. All captured edges will be discarded.
+ * 
+ * @param pTs Pointer to the timestamp struct to fill.
+ * @param edge PB_EDGE_PRESS or PB_EDGE_RELEASE.
+ */
+
+static void __func_get_pb_edge (ts_t *pTs, uint8_t edge);
+
+/**
+ * This function will set the trigger mode. In TRIG_MODE_GATES the selected
+ * lane will be started by the start gate (INT0) and stopped by the stop gate
+ * (INT1). In TRIG_MODE_LANES each gate starts and stops its own lane (INT0: 
+ * lane 0, INT1: lane 1). PB remains usable.
+ * 
+ * @param mode TRIG_MODE_OFF, TRIG_MODE_GATES or TRIG_MODE_LANES.
+ */
+
+static void __func_set_trigger_mode (uint8_t mode);
+
+/**
+ * This function handles the gate edges captured by func_trigger and has to
+ * be called if status.iTrig is set.
+ */
+
+static void __func_handle_trigger (void);
+
+/**
+ * This function starts a lane by a gate if it is idle or stopped.
+ * 
+ * @param ln Lane number (0..MAX_LANES-1).
+ * @param pTs Pointer to the timestamp of the gate.
+ */
+
+static void __func_gate_start (uint8_t ln, ts_t *pTs);
+
+/**
+ * This function stops a lane by a gate if it is running and checks for a new
+ * record of this lane.
+ * 
+ * @param ln Lane number (0..MAX_LANES-1).
+ * @param pTs Pointer to the timestamp of the gate.
+ */
+
+static void __func_gate_stop (uint8_t ln, ts_t *pTs);
+
 /**
  * This function will debounce the external switches (PB and USR). When a key
  * was pressed or released the function will return this whith an event code.
@@ -142,101 +510,333 @@ static char* __func_uint16_to_dec (uint16_t val);
 /**
  * This function manages the automatical time behaviour of the stop watch. One
  * example is the automatically switch to sleep state after the stop watch was
- * idle for some time. The function must be called every 10ms (system tick)
- * within the function func_workload().
+ * idle for some time. The function is the callback of the state timer and 
+ * will be called from timer_dispatch() once the timeout of a lane expired.
+ * The lanes in the background return from their stop states to idle, too.
+ */
+
+static void __func_state_timeout (void);
+
+/**
+ * This function (re)starts the timeout of the current state of the selected
+ * lane (e.g. IDLE_TO_SLEEP_TIME in the idle state). It has to be called after
+ * every state change and user activity.
+ */
+
+static void __func_arm_state_timer (void);
+
+/**
+ * This function switches a lane back to the idle state once the timeout of
+ * its state expired. The measurement is cleared. Only the selected lane
+ * updates the display and reports the idle state to the host.
+ * 
+ * @param ln Lane number (0..MAX_LANES-1).
+ */
+
+static void __func_lane_idle (uint8_t ln);
+
+/**
+ * This function returns the timeout of a state.
+ * 
+ * @param state State of the stop watch' state machine (SW_STATE_x).
+ * @return Timeout in [10ms] (0: no automatic time behaviour).
+ */
+
+static uint16_t __func_state_time (uint8_t state);
+
+/**
+ * This function starts the state timer with the earliest timeout of all lanes
+ * (see lane_t.due) or stops it if no lane has a timeout.
  */
 
-static void __func_auto_time_behaviour (void);
+static void __func_next_state_timeout (void);
 
 /**
- * You can use this function to the latest stop watch measurement (which is not
- * yet erased due to automatically switching to the idle state) into the
- * external EEPROM.
+ * You can use this function to the latest stop watch measurement of a lane 
+ * (which is not yet erased due to automatically switching to the idle state) 
+ * into the EEPROM region of the lane.
  * 
- * @param pSw Stop watch measurement to save into the external EEPROM.
- * @return Address/Slot where the measurement was saved.
+ * @param ln Lane number (0..MAX_LANES-1).
+ * @return Number of saved measurements of the lane.
  */
 
-static uint16_t __func_save (sw_t *pSw);
+static uint16_t __func_save (uint8_t ln);
 
 /**
- * This function will check if a new measurement is a new record. If the new 
- * measurement is below the current record measurement (pRec) the function will
- * return true. Otherwise false (no new record).
+ * This function will check if a new measurement is a new record of its lane.
+ * If the new measurement is below the current record measurement the function
+ * will save it and return true. Otherwise false (no new record).
  * 
- * @param pSw Pointer to the latest measurement. 
+ * @param ln Lane number (0..MAX_LANES-1).
  * @return True if the last measurement is a new record otherwise false.
  */
 
-static bool __func_is_new_record (sw_t *pSw);
+static bool __func_is_new_record (uint8_t ln);
 
 /**
- * This function will read the current record.
+ * This function will read the current record of a lane.
  * 
+ * @param ln Lane number (0..MAX_LANES-1).
  * @param pRec Pointer to provided memory to store the record measurement at.
  * @return 0 if the record was read successfully or 1 if there is no record.
  */
 
-static uint8_t __func_get_record (sw_t *pRec);
+static uint8_t __func_get_record (uint8_t ln, sw_t *pRec);
+
+/**
+ * Call this function to clear all saved stop watch measurements of a lane. The
+ * function wont override all memory of the external EEPROM with e.g. zeros. 
+ * No.. it will only start a new log page which is marked as the first one 
+ * (LOG_SEQ_FIRST). The older pages remain unchanged until they are reused.
+ * 
+ * @param ln Lane number (0..MAX_LANES-1).
+ */
+
+static void __func_clear_eeprom (uint8_t ln);
+
+/**
+ * This function counts the saved measurements inside a log page of a lane. 
+ * The laps (SW_LAP_FLAG set) are skipped, the count ends at the first erased
+ * slot.
+ * 
+ * @param ln Lane number (0..MAX_LANES-1).
+ * @param pg Page number (0..LOG_PAGES-1).
+ * @return Number of saved measurements.
+ */
+
+static uint8_t __func_count_meas (uint8_t ln, uint16_t pg);
+
+/**
+ * This function rebuilds the log of a lane from its EEPROM region (on boot).
+ * The head is the valid page with the newest sequence number, the log reaches
+ * back over the pages with consecutive sequence numbers up to the first page
+ * (LOG_SEQ_FIRST). The record is taken from the header of the head page and 
+ * its measurements, the measurements of all pages are counted (measCnt).
+ * 
+ * @param ln Lane number (0..MAX_LANES-1).
+ */
+
+static void __func_log_scan (uint8_t ln);
+
+/**
+ * This function reads the header of a log page.
+ * 
+ * @param ln Lane number (0..MAX_LANES-1).
+ * @param pg Page number (0..LOG_PAGES-1).
+ * @param pHdr Pointer to provided memory to store the header at.
+ * @return True if the header is valid otherwise false.
+ */
+
+static bool __func_log_hdr (uint8_t ln, uint16_t pg, log_hdr_t *pHdr);
 
 /**
- * This function will read the address pointer to the first free address inside
- * the external EEPROM. This address (not a pointer) can be used to store the
- * next data into the external EEPROM.
+ * This function starts the next log page of a lane: the page is erased and 
+ * gets a header with the next sequence number and the current record. So 
+ * each cell is written once per pass through the ring only. The measurements
+ * of a reused page are no longer counted.
  * 
- * @return The 16 bit address to the next free slot inside the ext. EEPROM
+ * @param ln Lane number (0..MAX_LANES-1).
+ * @param first True if the log starts with this page (all older are erased).
  */
 
-static uint16_t __func_get_addr_ptr (void);
+static void __func_log_open (uint8_t ln, bool first);
 
 /**
- * You can update the address value that informs about the next free address
- * slot inside the external EEPROM. This function will be called if new data
- * was written into the external EEPROM.
+ * This function appends records (measurements or laps) to the log of a lane.
  * 
- * @param addr_ptr New address to the next free slot inside the ext. EEPROM
+ * @param ln Lane number (0..MAX_LANES-1).
+ * @param pSw Pointer to the records.
+ * @param n Number of records.
  */
 
-static void __func_set_addr_ptr (uint16_t addr_ptr);
+static void __func_log_append (uint8_t ln, sw_t *pSw, uint8_t n);
 
 /**
- * Call this function to clear all saved stop watch measurements. The function
- * wont override all memory of the external EEPROM with e.g. zeros. No.. it will
- * only set the internal address-pointer back to 0x0004. The data inside the
- * external EEPROM remains unchanged.
+ * This function returns the number of records inside the log of a lane.
+ * 
+ * @param ln Lane number (0..MAX_LANES-1).
+ * @return Number of records (measurements and laps).
  */
 
-static void __func_clear_eeprom (void);
+static uint16_t __func_log_cnt (uint8_t ln);
 
 /*
  * This function will handle the remote messages. If the stopwatch gets remote
  * Messages from the LCD-Stopwatch Remote (PC Tool) this messages will be
- * handled within this function.
+ * handled within this function. It handles one received byte per call (with
+ * a constant effort) and executes a message once it is complete, so several
+ * messages may be received in a row without waiting for the answers.
+ * 
+ * A message has the format <#id:OP|arg|..> with an optional request id
+ * (which is repeated in the answer, see __func_reply), an opcode of 1 or 
+ * REM_OP_LEN chars and up to REM_ARG_MAX decimal arguments.
  * 
  * @return True if the receive buffer is not yet empty otherwise false.
  */
 
 static bool __func_remote_sm (void);
 
+/**
+ * This function will execute a complete remote message. The numeric 
+ * arguments (<X|123|456>) can be found in remArg (see remArgCnt).
+ * 
+ * @param op Opcode of the message (char or REM_OP2).
+ */
+
+static void __func_remote_cmd (uint16_t op);
+
+/**
+ * This function starts the answer of a remote message: '<', the request id
+ * of the message (if any, e.g. <#12:) and the given text.
+ * 
+ * @param pBuf Text behind the start of the answer (e.g. "0>").
+ */
+
+static void __func_reply (char *pBuf);
+
+/**
+ * This function pushes the telemetry to the host (see remote command TS):
+ * the changed states of the lanes, the pressed keys and every telePeriod 
+ * ticks the time of the running lanes. Messages which don't fit into the
+ * tx-ringbuffer are never waited for: state and key changes are sent later,
+ * the time is skipped until the next period.
+ * 
+ * @param now Current value of the free-running tick counter.
+ */
+
+static void __func_tele (uint32_t now);
+
+/**
+ * This function sends a telemetry message (in the current protocol mode) if
+ * the tx-ringbuffer has room for it.
+ * 
+ * @param type Message type (TELE_x).
+ * @param a Lane number or selected lane.
+ * @param val Value (time, state or keys).
+ * @return True if the message was sent, false if there was no room.
+ */
+
+static bool __func_tele_send (uint8_t type, uint8_t a, uint32_t val);
+
+/**
+ * This function will be called if data over the UART was received in
+ * REM_MODE_BIN. It passes the next byte of the rx-ringbuffer to the frame
+ * decoder and executes complete frames (see __func_remote_frame).
+ * 
+ * @return True if there is more data to handle, otherwise false.
+ */
+
+static bool __func_remote_bin (void);
+
+/**
+ * This function will execute a valid frame of the binary protocol (frameRx).
+ * The answers carry the sequence number of the request.
+ */
+
+static void __func_remote_frame (void);
+
+/**
+ * This function sends a FRAME_TYPE_NAK frame (e.g. the host shall repeat a
+ * broken request).
+ * 
+ * @param seq Sequence number of the request.
+ * @param type Type of the request (0: unknown, e.g. crc error).
+ */
+
+static void __func_remote_nak (uint8_t seq, uint8_t type);
+
+/**
+ * This function applies the clock correction (calPpm) to a time measured with
+ * the internal oscillator.
+ * 
+ * @param ms Measured time in [ms].
+ * @return Corrected time in [ms].
+ */
+
+static uint32_t __func_correct (uint32_t ms);
+
+/**
+ * This function sets the clock correction and precalculates the factor used
+ * by __func_correct (|ppm| * 2^32 / 1000000), so the correction of a time 
+ * needs no division.
+ * 
+ * @param ppm Clock correction in [ppm].
+ */
+
+static void __func_set_ppm (int16_t ppm);
+
+/**
+ * This function handles a calibration message containing a reference time of
+ * the host. The first message starts a calibration session, the following ones
+ * compare the own elapsed time against the host time. Once the reference time
+ * is CAL_MIN_TIME or longer the correction is calculated and stored.
+ * 
+ * @param host Reference time of the host in [ms].
+ * @return True if a new correction was calculated.
+ */
+
+static bool __func_calibrate (uint32_t host);
+
+/**
+ * This function will convert a signed 16-bit value into its decimal 
+ * representation (sign and 5 digits).
+ * 
+ * @param val int16_t value to be convert
+ * @return Pointer to the null terminated decimal string of val
+ */
+
+static char* __func_int16_to_dec (int16_t val);
+
+/**
+ * This function will convert a 32-bit value into its decimal representation 
+ * (without leading zeros).
+ * 
+ * @param val uint32_t value to be convert
+ * @return Pointer to the null terminated decimal string of val
+ */
+
+static char* __func_uint32_to_dec (uint32_t val);
+
 //*** functions ****************************************************************
 
+void func_init (void)
+{
+    uint8_t i;
+    
+    for(i=0; i<MAX_LANES; i++)
+    {
+        lanes[i].state = SW_STATE_IDLE;
+        __func_log_scan(i);
+    }
+    
+    // read the stored clock correction
+    if( eeprom_int_read(EEPROM_INT_ADDR_MAGIC) == EEPROM_INT_MAGIC )
+    {
+        __func_set_ppm((int16_t)(eeprom_int_read(EEPROM_INT_ADDR_PPM) | 
+            ((uint16_t)eeprom_int_read(EEPROM_INT_ADDR_PPM+1) << 8)));
+    }
+    
+    stateTimer = timer_new(__func_state_timeout);
+    lapTimer = timer_new(__func_lap_timeout);
+    dispTimer = timer_new(__func_disp_timeout);
+    baudTimer = timer_new(__func_baud_timeout);
+    uart_set_yield(__func_yield);
+    __func_arm_state_timer();
+}
+
+//..............................................................................
+
 void func_workload (void)
 {    
     static uint8_t keyMem;
+    static uint32_t lastTick = 0;
+    uint32_t now = timer1_get_ticks();
+    uint8_t i;
     
     // check if another 10ms are passed
-    if( status.iXms )
+    if( now != lastTick )
     {
-        status.iXms = false;
-
-        // increase the state counter
-        state_cnt++;
-        
-        // update stop watch every 10ms
-        if(state == SW_STATE_RUN)
-        {
-            __func_update_stopwatch();
-        }
+        lastTick = now;
         
         // check for an key released event
         keyMem |= __func_debounce();
@@ -249,871 +849,2718 @@ void func_workload (void)
             {
                 debCntPB = 0;
                 keyMem &= ~KEY_PB;
-                state_cnt = 0;
+                __func_arm_state_timer();
             }
         }
 
         if(keyMem & KEY_USR)
         {
+            // USR pressed outside of a measurement? -> show the next lane
+            // (while running USR takes the laps, see func_lap)
+            if( USR && (pLane->state == SW_STATE_IDLE || 
+                        pLane->state == SW_STATE_STOP) )
+            {
+                __func_select_lane((laneSel + 1) % MAX_LANES);
+            }
+            
             // reset the pressed & hold counter
             debCntUSR = 0;
             keyMem &= ~KEY_USR;
         }
     }
     
-    // call the uart tx-function if data is waiting out buffer
-    if( status.iTx )
+    // a lap was taken
+    if( status.iLap )
     {
-        // the iTX flag will be cleared inside uart_tx (if buffer is empty)
-        uart_tx(5);
+        __func_handle_lap();
     }
     
-    // some data over the UART interface was received
-    if( status.iRx )
+    // a photogate was triggered
+    if( status.iTrig )
     {
-        state_cnt = 0;
-        
-        // handle incomming messages
-        status.iRx = __func_remote_sm();
+        __func_handle_trigger();
     }
     
-    // manage the automatically time behaviour of the stop watch
-    // (e.g. automatically go sleeping after .. ms in idle state ..)
-    __func_auto_time_behaviour();
-}
-
-//..............................................................................
-
-void func_disp_sw (void)
-{
-    // display the new time
-    lcd_write( __func_time_to_str(&sWatch), 0x00 );
+    // a queued spi job is done (e.g. the lcd is ready for the next update)
+    if( status.iSpi )
+    {
+        spi_dispatch();
+    }
+    
+    // the export job is waiting for free space in the tx-ringbuffer
+    if( expState == EXP_STATE_SEND )
+    {
+        __func_export_step();
+    }
+    
+    // push the telemetry (if subscribed and not inbetween an export)
+    if( telePeriod && expState == EXP_STATE_IDLE )
+    {
+        __func_tele(now);
+    }
+    
+    // some data over the UART interface was received (the commands wait
+    // until an export is done, their replies would break it up)
+    if( status.iRx && expState == EXP_STATE_IDLE )
+    {
+        // handle all incomming messages (but limit the time spent here)
+        for(i=0; i<REM_RX_MAX && status.iRx && !expState; i++)
+        {
+            if( remMode == REM_MODE_BIN )
+            {
+                status.iRx = __func_remote_bin();
+            }
+            else
+            {
+                status.iRx = __func_remote_sm();
+            }
+        }
+        
+        __func_arm_state_timer();
+    }
+    
+    // manage the automatically time behaviour of the stop watch
+    // (e.g. automatically go sleeping after .. ms in idle state ..)
+    timer_dispatch();
+    
+    // nothing to do until the next timer expires? -> stop the tick and idle
+    if( !laneRun && !trigMode && !keyMem && !lastPressedKey )
+    {
+        // nothing may remain inside the eeprom write-back buffer (a lane 
+        // flushes on its own once it gets idle, see __func_lane_idle)
+        eeprom_25LC256_flush();
+        
+        // USR shall wake up the pic as well (PB by interrupt on change)
+        INTCON3bits.INT2IF = 0;
+        INTCON3bits.INT2IE = 1;
+        
+        // no interrupt may sneak in between the last check and the idle mode
+        INTCONbits.GIEH = 0;
+        
+        // (a waiting export job is woken up by the tx interrupt)
+        if( !status.iRx && !status.iTrig && !status.iSpi && !PB && !USR &&
+            (expState != EXP_STATE_SEND || uart_tx_free() < EXP_ROOM) )
+        {
+            timer_idle();
+        }
+        
+        INTCONbits.GIEH = 1;
+        INTCON3bits.INT2IE = 0;
+    }
+}
+
+//..............................................................................
+
+void func_disp_sw (void)
+{
+    // display the new time
+    lcd_write( __func_time_to_disp_str(&pLane->sw), 0x00 );
+}
+
+//..............................................................................
+
+void func_pb_edge (void)
+{
+    ts_t ts;
+    uint8_t edge;
+    
+    // take the timestamp first
+    timer1_get_timestamp(&ts);
+    
+    edge = PB ? PB_EDGE_PRESS : PB_EDGE_RELEASE;
+    
+    // only the first edge counts (ignore bouncing)
+    if( !(pbEdgeValid & (1 << edge)) )
+    {
+        pbEdgeTs[edge].tick = ts.tick;
+        pbEdgeTs[edge].sub  = ts.sub;
+        pbEdgeValid |= (1 << edge);
+    }
+}
+
+//..............................................................................
+
+void func_lap (void)
+{
+    ts_t ts;
+    
+    // take the timestamp first
+    timer1_get_timestamp(&ts);
+    
+    // not running or still locked since the last lap (bouncing)?
+    if( pLane->state != SW_STATE_RUN || (ts.tick - lapTs.tick) < LAP_LOCKOUT )
+    {
+        return;
+    }
+    
+    lapTs.tick = ts.tick;
+    lapTs.sub  = ts.sub;
+    
+    status.iLap = true;
+}
+
+//..............................................................................
+
+void func_trigger (uint8_t gate)
+{
+    ts_t ts;
+    
+    // take the timestamp first
+    timer1_get_timestamp(&ts);
+    
+    // gate still locked since its last trigger?
+    if( (ts.tick - trigLast[gate]) < trigLockout )
+    {
+        return;
+    }
+    
+    trigLast[gate] = ts.tick;
+    
+    trigTs[gate].tick = ts.tick;
+    trigTs[gate].sub  = ts.sub;
+    trigValid |= (1 << gate);
+    
+    status.iTrig = true;
+}
+
+//*** static functions *********************************************************
+
+static void __func_update_stopwatch (uint32_t now)
+{
+    ts_t ts;
+    
+    // the start may be within the current tick (see func_workload)
+    if( (int32_t)(now - pLane->start.tick) <= 0 )
+    {
+        return;
+    }
+    
+    // take the time up to the start of the current tick
+    ts.tick = now;
+    ts.sub  = 0;
+    pLane->sw = pLane->base + 
+        __func_correct( timer1_elapsed_ms(&pLane->start, &ts) );
+    
+    // display the new value on the LCD (unless a lap is shown)
+    if( !lapShown )
+    {
+        func_disp_sw();
+    }
+}
+
+//..............................................................................
+
+static void __func_start_stopwatch (uint8_t ln, ts_t *pTs)
+{
+    lane_t *pL = &lanes[ln];
+    
+    pL->start = *pTs;
+    
+    // continue with the current value
+    pL->base = pL->sw;
+    
+    laneRun |= (1 << ln);
+    
+    // only the selected lane takes laps
+    if( ln != laneSel )
+    {
+        return;
+    }
+    
+    // start with an empty lap buffer, USR takes the laps
+    lapCnt = 0;
+    lapTs.tick = pTs->tick - LAP_LOCKOUT;
+    INTCON3bits.INT2IF = 0;
+    INTCON3bits.INT2IE = 1;
+    
+    // show the running time (even if the lane number is shown right now)
+    timer_stop(lapTimer);
+    lapShown = false;
+    __func_arm_disp_timer();
+}
+
+//..............................................................................
+
+static void __func_stop_stopwatch (uint8_t ln, ts_t *pTs)
+{
+    lane_t *pL = &lanes[ln];
+    
+    laneRun &= ~(1 << ln);
+    
+    pL->sw = pL->base + __func_correct( timer1_elapsed_ms(&pL->start, pTs) );
+    
+    if( ln != laneSel )
+    {
+        return;
+    }
+    
+    // no more laps
+    INTCON3bits.INT2IE = 0;
+    status.iLap = false;
+    __func_arm_disp_timer();
+    
+    // show the final time (even if a lap is shown right now)
+    timer_stop(lapTimer);
+    lapShown = false;
+    func_disp_sw();
+    
+    // save the laps of this measurement
+    __func_flush_laps();
+    eeprom_25LC256_flush();
+}
+
+//..............................................................................
+
+static void __func_select_lane (uint8_t ln)
+{
+    laneSel = ln;
+    pLane = &lanes[ln];
+    
+    // the new lane may already run (started by its gate)
+    if( pLane->state == SW_STATE_RUN )
+    {
+        lapCnt = 0;
+        lapTs.tick = timer1_get_ticks() - LAP_LOCKOUT;
+        INTCON3bits.INT2IF = 0;
+        INTCON3bits.INT2IE = 1;
+    }
+    
+    // show the lane number for a while
+    lcd_write("Lane    ", 0);
+    lcd_write(__func_uint16_to_dec(ln + 1) + 4, 5);
+    lapShown = true;
+    timer_start(lapTimer, LAP_DISP_TIME, 0);
+    
+    __func_arm_disp_timer();
+    __func_arm_state_timer();
+}
+
+//..............................................................................
+
+static void __func_handle_lap (void)
+{
+    ts_t ts;
+    sw_t *pLap = &laps[lapWr];
+    
+    status.iLap = false;
+    
+    INTCON3bits.INT2IE = 0;
+    ts.tick = lapTs.tick;
+    ts.sub  = lapTs.sub;
+    INTCON3bits.INT2IE = 1;
+    
+    *pLap = pLane->base + 
+        __func_correct( timer1_elapsed_ms(&pLane->start, &ts) );
+    
+    // next slot (the oldest lap will be overwritten if the buffer is full)
+    lapWr = (lapWr + 1) % MAX_LAPS;
+    
+    if( lapCnt < MAX_LAPS )
+    {
+        lapCnt++;
+    }
+    
+    // show the lap for a while (the measurement continues in background)
+    lcd_write(__func_time_to_disp_str(pLap), 0);
+    lapShown = true;
+    timer_start(lapTimer, LAP_DISP_TIME, 0);
+}
+
+//..............................................................................
+
+static void __func_lap_timeout (void)
+{
+    lapShown = false;
+    
+    // the other states show their own messages
+    if( pLane->state == SW_STATE_RUN || pLane->state == SW_STATE_IDLE || 
+        pLane->state == SW_STATE_STOP )
+    {
+        func_disp_sw();
+    }
+}
+
+//..............................................................................
+
+static void __func_arm_disp_timer (void)
+{
+    if( laneRun & (1 << laneSel) )
+    {
+        timer_start(dispTimer, dispPeriod, dispPeriod);
+    }
+    else
+    {
+        timer_stop(dispTimer);
+    }
+}
+
+//..............................................................................
+
+static void __func_disp_timeout (void)
+{
+    // the other lanes are calculated from their timestamps once stopped
+    if( laneRun & (1 << laneSel) )
+    {
+        __func_update_stopwatch(timer1_get_ticks());
+    }
+}
+
+//..............................................................................
+
+static void __func_set_disp_rate (uint8_t hz)
+{
+    if( !hz || hz > DISP_RATE_MAX )
+    {
+        return;
+    }
+    
+    dispPeriod = 100 / hz;
+    
+    __func_arm_disp_timer();
+}
+
+//..............................................................................
+
+static void __func_yield (void)
+{
+    if( status.iSpi )
+    {
+        spi_dispatch();
+    }
+}
+
+//..............................................................................
+
+static void __func_baud_timeout (void)
+{
+    (void)uart_set_baud(baudOld);
+    baudOld = 0;
+}
+
+//..............................................................................
+
+static void __func_export_start (uint8_t ln, uint16_t first, uint16_t n,
+                                 uint8_t type, uint8_t seq)
+{
+    expCnt = __func_log_cnt(ln);
+    
+    // limit the range to the saved measurements
+    if( first > expCnt )
+    {
+        first = expCnt;
+    }
+    
+    if( n > expCnt - first )
+    {
+        n = expCnt - first;
+    }
+    
+    expLn = ln;
+    expTail = (logs[ln].head + LOG_PAGES + 1 - logs[ln].pages) % LOG_PAGES;
+    expLow = first;
+    expHigh = first + n;
+    expBin = (remMode == REM_MODE_BIN);
+    expSeq = seq;
+    
+    expLen = 0;
+    expPos = 0;
+    expFrame = false;
+    expState = EXP_STATE_SEND;
+    
+    // send the commando start and the number of saved measurements (the
+    // laps in between aren't counted)
+    if( expBin )
+    {
+        // (the records follow by __func_export_step_bin)
+        frame_begin(type, seq, 4);
+        frame_put((uint8_t)pLane->measCnt);
+        frame_put((uint8_t)(pLane->measCnt >> 8));
+        frame_put((uint8_t)expCnt);
+        frame_put((uint8_t)(expCnt >> 8));
+        frame_end();
+        return;
+    }
+    
+    __func_reply("4|");
+    uart_print(__func_uint16_to_dec(pLane->measCnt));
+    
+    if( expHigh > expLow )
+    {
+        __func_export_read();
+    }
+}
+
+//..............................................................................
+
+static void __func_export_read (void)
+{
+    uint16_t start, pg;
+    
+    if( expBin )
+    {
+        // from the oldest record not read yet to the end of its log page (or
+        // of the frame)
+        start = expLow;
+        pg = start / LOG_SLOTS;
+        expLen = (uint8_t)((pg + 1) * LOG_SLOTS - start) * SIZE_OF_SW;
+        
+        if( expLen > expLeft )
+        {
+            expLen = expLeft;
+        }
+        
+        expLow += expLen / SIZE_OF_SW;
+        expLeft -= expLen;
+    }
+    else
+    {
+        // first record of the log page with the newest record not read yet
+        pg = (expHigh - 1) / LOG_SLOTS;
+        start = pg * LOG_SLOTS;
+        
+        if( start < expLow )
+        {
+            start = expLow;
+        }
+        
+        expLen = (uint8_t)(expHigh - start) * SIZE_OF_SW;
+        expHigh = start;
+    }
+    
+    expPos = expLen;
+    expState = EXP_STATE_READ;
+    
+    pg = (expTail + pg) % LOG_PAGES;
+    start = LOG_PAGE_ADDR(expLn, pg) + LOG_HDR_SIZE + 
+            (start % LOG_SLOTS) * SIZE_OF_SW;
+    
+    eeprom_25LC256_read_async(start, expBuf, expLen, __func_export_read_done);
+}
+
+//..............................................................................
+
+static void __func_export_read_done (void)
+{
+    expState = EXP_STATE_SEND;
+}
+
+//..............................................................................
+
+static void __func_export_step (void)
+{
+    sw_t sw;
+    
+    if( expBin )
+    {
+        __func_export_step_bin();
+        return;
+    }
+    
+    // send the measurements of the page while the uart has room for them
+    while( expPos )
+    {
+        if( uart_tx_free() < EXP_ROOM )
+        {
+            return;
+        }
+        
+        expPos -= SIZE_OF_SW;
+        sw = *(sw_t*)&expBuf[expPos];
+        
+        // laps get an L
+        uart_print("|");
+        
+        if( sw & SW_LAP_FLAG )
+        {
+            uart_print("L");
+        }
+        
+        uart_print(__func_time_to_str(&sw));
+    }
+    
+    // more measurements left? -> read the next page
+    if( expHigh > expLow )
+    {
+        __func_export_read();
+        return;
+    }
+    
+    // send end of command indicator
+    if( !uart_tx_free() )
+    {
+        return;
+    }
+    
+    uart_print(">");
+    expState = EXP_STATE_IDLE;
+    
+    // the remote commands were paused, the pic may go to sleep again
+    __func_arm_state_timer();
+}
+
+//..............................................................................
+
+static void __func_export_step_bin (void)
+{
+    uint16_t n;
+    
+    while( uart_tx_free() >= EXP_ROOM )
+    {
+        if( !expFrame )
+        {
+            // the next records (oldest first), the last frame is empty
+            n = expHigh - expLow;
+            
+            if( n > EXP_FRAME_RECS )
+            {
+                n = EXP_FRAME_RECS;
+            }
+            
+            expLeft = (uint8_t)(n * SIZE_OF_SW);
+            
+            // index of the frame's first record
+            frame_begin(FRAME_TYPE_DATA, ++expSeq, expLeft + 2);
+            frame_put((uint8_t)expLow);
+            frame_put((uint8_t)(expLow >> 8));
+            expFrame = true;
+            expLen = expLeft;
+        }
+        else if( expPos )
+        {
+            // the records read in memory order
+            frame_put(expBuf[expLen - expPos]);
+            expPos--;
+        }
+        else if( expLeft )
+        {
+            // the frame goes on with the next records
+            __func_export_read();
+            return;
+        }
+        else
+        {
+            frame_end();
+            expFrame = false;
+            
+            // the empty frame was sent? -> done
+            if( !expLen )
+            {
+                expState = EXP_STATE_IDLE;
+                __func_arm_state_timer();
+                return;
+            }
+        }
+    }
+}
+
+//..............................................................................
+
+static void __func_flush_laps (void)
+{
+    uint8_t i, n, first;
+    
+    if( !lapCnt )
+    {
+        return;
+    }
+    
+    // mark the entries as laps
+    for(i=0; i<lapCnt; i++)
+    {
+        laps[(lapWr + MAX_LAPS - 1 - i) % MAX_LAPS] |= SW_LAP_FLAG;
+    }
+    
+    // the oldest lap up to the end of the ring buffer ..
+    first = (lapWr + MAX_LAPS - lapCnt) % MAX_LAPS;
+    n = MAX_LAPS - first;
+    
+    if( n > lapCnt )
+    {
+        n = lapCnt;
+    }
+    
+    __func_log_append(laneSel, &laps[first], n);
+    
+    // .. and the wrapped around part
+    if( lapCnt > n )
+    {
+        __func_log_append(laneSel, &laps[0], lapCnt - n);
+    }
+    
+    lapCnt = 0;
+}
+
+//..............................................................................
+
+static char* __func_time_to_str (sw_t *pSw)
+{
+    uint32_t t = *pSw & ~SW_LAP_FLAG;
+    uint16_t ms;
+    uint8_t c;
+    
+    __func_split_time(t);
+    
+    // MM:SS:cc
+    if( t < SW_100_MIN )
+    {
+        // hundredths of a second (the upper two digits of the milliseconds)
+        c = 0;
+        
+        for(ms=split.ms; ms >= 10; ms -= 10)
+        {
+            c++;
+        }
+        
+        return __func_3x2_to_str(split.h * 60 + split.m, split.s, c);
+    }
+    
+    // HH:MM:SS (hours wrap around after 99)
+    return __func_3x2_to_str(split.h, split.m, split.s);
+}
+
+//..............................................................................
+
+static char* __func_time_to_disp_str (sw_t *pSw)
+{
+    uint32_t t = *pSw & ~SW_LAP_FLAG;
+    uint16_t ms;
+    uint8_t d;
+    
+    // no space left for the milliseconds?
+    if( t >= SW_10_MIN )
+    {
+        return __func_time_to_str(pSw);
+    }
+    
+    __func_split_time(t);
+    
+    // hundreds of the milliseconds by subtraction, the rest by the table
+    ms = split.ms;
+    d = 0;
+    
+    while( ms >= 100 )
+    {
+        ms -= 100;
+        d++;
+    }
+    
+    gBuf[0] = split.m + '0';
+    gBuf[1] = ':';
+    __func_2_digits(&gBuf[2], split.s);
+    gBuf[4] = '.';
+    gBuf[5] = d + '0';
+    __func_2_digits(&gBuf[6], (uint8_t)ms);
+    gBuf[8] = '\0';
+    
+    return gBuf;
+}
+
+//..............................................................................
+
+static void __func_split_time (sw_t t)
+{
+    uint16_t d;
+    
+    // a bit more than last time? -> just add the difference
+    if( t >= splitVal && (t - splitVal) < 60000 )
+    {
+        d = (uint16_t)(t - splitVal);
+    }
+    else
+    {
+        splitVal = t;
+        
+        // count the components from scratch
+        split.h = 0;
+        split.m = 0;
+        split.s = 0;
+        split.ms = 0;
+        
+        while( t >= 3600000UL )
+        {
+            t -= 3600000UL;
+            
+            if( ++split.h == 100 )
+            {
+                split.h = 0;
+            }
+        }
+        
+        while( t >= 60000 )
+        {
+            t -= 60000;
+            split.m++;
+        }
+        
+        // the rest (< 1 minute) is added below
+        d = (uint16_t)t;
+        splitVal -= d;
+    }
+    
+    splitVal += d;
+    split.ms += d;
+    
+    // carry over to the seconds, minutes and hours
+    while( split.ms >= 1000 )
+    {
+        split.ms -= 1000;
+        
+        if( ++split.s == 60 )
+        {
+            split.s = 0;
+            
+            if( ++split.m == 60 )
+            {
+                split.m = 0;
+                
+                if( ++split.h == 100 )
+                {
+                    split.h = 0;
+                }
+            }
+        }
+    }
+}
+
+//..............................................................................
+
+static void __func_2_digits (char *p, uint8_t val)
+{
+    uint8_t bcd = bcdTab[val];
+    
+    p[0] = (bcd >> 4) + '0';
+    p[1] = (bcd & 0x0F) + '0';
+}
+
+//..............................................................................
+
+static char* __func_dabble (uint32_t val, uint8_t bits, uint8_t digits)
+{
+    uint8_t bcd [5] = {0, 0, 0, 0, 0};
+    uint8_t i, j, b, carry;
+    
+    // only the valid bits are shifted in (MSB first)
+    val <<= (32 - bits);
+    
+    for(i=0; i<bits; i++)
+    {
+        // add 3 to every digit >= 5 (it will be >= 10 after the shift)
+        for(j=0; j<5; j++)
+        {
+            b = bcd[j];
+            
+            if( (b & 0x0F) >= 0x05 ) b += 0x03;
+            if( (b & 0xF0) >= 0x50 ) b += 0x30;
+            
+            bcd[j] = b;
+        }
+        
+        // shift the next bit of val into the digits
+        carry = (val & 0x80000000UL) ? 1 : 0;
+        val <<= 1;
+        
+        for(j=0; j<5; j++)
+        {
+            b = bcd[j];
+            bcd[j] = (uint8_t)(b << 1) | carry;
+            carry = b >> 7;
+        }
+    }
+    
+    // unpack the digits (bcd[0] holds the two lowest ones)
+    for(i=0; i<digits; i++)
+    {
+        b = bcd[i >> 1];
+        
+        if(i & 1)
+        {
+            b >>= 4;
+        }
+        
+        gBuf[digits - 1 - i] = (b & 0x0F) + '0';
+    }
+    
+    gBuf[digits] = '\0';
+    
+    return gBuf;
+}
+
+//..............................................................................
+
+static char* __func_3x2_to_str (uint8_t a, uint8_t b, uint8_t c)
+{
+    __func_2_digits(&gBuf[0], a);
+    gBuf[2] = ':';
+    __func_2_digits(&gBuf[3], b);
+    gBuf[5] = ':';
+    __func_2_digits(&gBuf[6], c);
+    gBuf[8] = '\0';
+    
+    return gBuf;
+}
+
+//..............................................................................
+
+static void __func_get_pb_edge (ts_t *pTs, uint8_t edge)
+{
+    // take the current time as fallback
+    timer1_get_timestamp(pTs);
+    
+    INTCONbits.RABIE = 0;
+    
+    // use the captured edge if there is a recent one
+    if( (pbEdgeValid & (1 << edge)) && 
+        (pTs->tick - pbEdgeTs[edge].tick) <= PB_EDGE_MAX_AGE )
+    {
+        pTs->tick = pbEdgeTs[edge].tick;
+        pTs->sub  = pbEdgeTs[edge].sub;
+    }
+    
+    // discard all captured edges (the next ones belong to the next event)
+    pbEdgeValid = 0;
+    
+    INTCONbits.RABIE = 1;
+}
+
+//..............................................................................
+
+static uint8_t __func_debounce (void)
+{
+    uint8_t actKeyDown = 0;
+    uint8_t ret = 0;
+
+    // check if PB is pressed right now
+    if(PB)
+    {
+        // set the bit for PB
+        actKeyDown |= KEY_PB;
+        
+        // increment the press&hold count var for PB
+        debCntPB++;
+    }
+    
+    // check if USR is pressed right now
+    if(USR)
+    {
+        // set the bit for USR
+        actKeyDown |= KEY_USR;
+        
+        // increment the press&hold count var for USR
+        debCntUSR++;
+    } 
+    
+    // is there a new key event (key pressed or released)?
+    if(actKeyDown != lastPressedKey)
+    {
+        // check which keys changed
+        ret = actKeyDown ^ lastPressedKey;
+        
+        // get the exact time of the PB change
+        if(ret & KEY_PB)
+        {
+            __func_get_pb_edge(&pbTs, 
+                (actKeyDown & KEY_PB) ? PB_EDGE_PRESS : PB_EDGE_RELEASE);
+        }
+        
+        // take the new actKeyDown as lastPressedKey
+        lastPressedKey = actKeyDown;
+    }
+    
+    return ret;
+}
+
+//..............................................................................
+
+static void __func_set_trigger_mode (uint8_t mode)
+{
+    uint32_t now = timer1_get_ticks();
+    
+    INTCONbits.INT0IE = 0;
+    INTCON3bits.INT1IE = 0;
+    
+    trigMode = mode;
+    trigValid = 0;
+    status.iTrig = false;
+    
+    if(mode != TRIG_MODE_OFF)
+    {
+        // both gates are armed right away
+        trigLast[TRIG_GATE_START] = now - trigLockout;
+        trigLast[TRIG_GATE_STOP]  = now - trigLockout;
+        
+        INTCONbits.INT0IF = 0;
+        INTCON3bits.INT1IF = 0;
+        INTCONbits.INT0IE = 1;
+        INTCON3bits.INT1IE = 1;
+    }
+}
+
+//..............................................................................
+
+static void __func_handle_trigger (void)
+{
+    ts_t startTs, stopTs;
+    uint8_t valid;
+    
+    status.iTrig = false;
+    
+    // take over the captured edges
+    INTCONbits.INT0IE = 0;
+    INTCON3bits.INT1IE = 0;
+    
+    valid = trigValid;
+    trigValid = 0;
+    
+    startTs.tick = trigTs[TRIG_GATE_START].tick;
+    startTs.sub  = trigTs[TRIG_GATE_START].sub;
+    stopTs.tick  = trigTs[TRIG_GATE_STOP].tick;
+    stopTs.sub   = trigTs[TRIG_GATE_STOP].sub;
+    
+    INTCONbits.INT0IE = (trigMode != TRIG_MODE_OFF);
+    INTCON3bits.INT1IE = (trigMode != TRIG_MODE_OFF);
+    
+    // one gate per lane: each gate starts and stops its own lane
+    if( trigMode == TRIG_MODE_LANES )
+    {
+        if( valid & (1 << TRIG_GATE_START) )
+        {
+            if( lanes[0].state == SW_STATE_RUN )
+            {
+                __func_gate_stop(0, &startTs);
+            }
+            else
+            {
+                __func_gate_start(0, &startTs);
+            }
+        }
+        
+        if( valid & (1 << TRIG_GATE_STOP) )
+        {
+            if( lanes[1].state == SW_STATE_RUN )
+            {
+                __func_gate_stop(1, &stopTs);
+            }
+            else
+            {
+                __func_gate_start(1, &stopTs);
+            }
+        }
+        
+        return;
+    }
+    
+    // start gate passed?
+    if( valid & (1 << TRIG_GATE_START) )
+    {
+        __func_gate_start(laneSel, &startTs);
+    }
+    
+    // stop gate passed?
+    if( valid & (1 << TRIG_GATE_STOP) )
+    {
+        __func_gate_stop(laneSel, &stopTs);
+    }
+}
+
+//..............................................................................
+
+static void __func_gate_start (uint8_t ln, ts_t *pTs)
+{
+    lane_t *pL = &lanes[ln];
+    
+    if( pL->state != SW_STATE_IDLE && pL->state != SW_STATE_STOP )
+    {
+        return;
+    }
+    
+    __func_clear_sw(&pL->sw);
+    __func_start_stopwatch(ln, pTs);
+    
+    pL->state = SW_STATE_RUN;
+    
+    if( ln == laneSel )
+    {
+        __func_arm_state_timer();
+    }
+    
+    #ifdef DEBUG
+        uart_print("state (trigger): -> RUN\n");
+    #endif
+}
+
+//..............................................................................
+
+static void __func_gate_stop (uint8_t ln, ts_t *pTs)
+{
+    lane_t *pL = &lanes[ln];
+    
+    if( pL->state != SW_STATE_RUN )
+    {
+        return;
+    }
+    
+    __func_stop_stopwatch(ln, pTs);
+    
+    pL->state = SW_STATE_STOP;
+    
+    // check if the measurement is a new record (only the selected lane shows
+    // it, the record of the other lanes is updated silently)
+    if( __func_is_new_record(ln) && ln == laneSel )
+    {
+        pL->state = SW_STATE_RECORD;
+    }
+    
+    if( ln == laneSel )
+    {
+        __func_arm_state_timer();
+    }
+    else
+    {
+        // return to idle in the background
+        pL->due = (uint16_t)pTs->tick + STOP_TO_IDLE_TIME;
+        __func_next_state_timeout();
+    }
+    
+    #ifdef DEBUG
+        uart_print("state (trigger): RUN -> STOP\n");
+    #endif
+}
+
+//..............................................................................
+
+static void __func_clear_sw (sw_t *pSw)
+{
+    *pSw = 0;
+}
+
+//..............................................................................
+
+static bool __func_sw_state_machine (void)
+{
+    bool keyAccepted = true;
+            
+    switch(pLane->state)
+    {
+        case SW_STATE_PRE_IDLE:
+        {
+            pLane->state = SW_STATE_IDLE;
+            
+            // send the "back in idle cmd"
+            uart_print("<7>");
+
+            #ifdef DEBUG
+                uart_print("state: PRE IDLE -> IDLE\n");
+            #endif
+
+            break;
+        }
+
+        case SW_STATE_IDLE:
+        {
+            // check how long the key was pressed
+            if(debCntPB > KEY_HOLD_CLR && PB)
+            {
+                // display some status info
+                lcd_write("Erase?  ",0);
+
+                pLane->state = SW_STATE_CLR;      
+                
+                #ifdef DEBUG
+                    uart_print("state: IDLE -> CLEAR\n");
+                #endif
+            }
+            // is the key already released?
+            else if(!PB)
+            {
+                // start a new measurement (at the time PB was released)
+                __func_start_stopwatch(laneSel, &pbTs);
+                pLane->state = SW_STATE_RUN;
+                
+                #ifdef DEBUG
+                    uart_print("state: IDLE -> RUN\n");
+                #endif
+            }
+            else
+            {
+                // key was NOT accepted
+                keyAccepted = false;
+            }
+
+            break;
+        }
+
+        case SW_STATE_RUN:
+        {
+            if(PB)
+            {
+                // stop at the time PB was pressed
+                __func_stop_stopwatch(laneSel, &pbTs);
+                
+                pLane->state = SW_STATE_PRE_STOP;
+                
+                // check if the measurement is a new record
+                if( __func_is_new_record(laneSel) )
+                {
+                    pLane->state = SW_STATE_RECORD;
+
+                    #ifdef DEBUG
+                        uart_print("state: RUN -> RECORD\n");
+                    #endif
+                }
+                else
+                {
+                    #ifdef DEBUG
+                        uart_print("state: RUN -> STOP\n");
+                    #endif
+                }
+            }
+
+            break;
+        }
+
+        case SW_STATE_PRE_STOP:
+        {   
+            pLane->state = SW_STATE_STOP;
+            
+            #ifdef DEBUG
+                uart_print("state: PRE STOP -> STOP\n");
+            #endif
+
+            break;
+        }
+
+        case SW_STATE_STOP:
+        {
+            // check how long the key was pressed
+            if(debCntPB > KEY_HOLD_SAVE && PB)
+            {
+                // save the last sw-value into the EEPROM
+                __func_save(laneSel);
+
+                // display an info message (-> #xxxx)
+                lcd_write(__func_uint16_to_dec(pLane->measCnt), 3);
+                lcd_write("-> #",0);
+                
+                pLane->state = SW_STATE_SAVED;
+               
+                #ifdef DEBUG
+                    uart_print("state: STOP -> SAVED\n");
+                #endif
+            }
+            else if(!PB)
+            {
+                __func_clear_sw(&pLane->sw);
+                func_disp_sw();
+
+                pLane->state = SW_STATE_IDLE;
+                eeprom_25LC256_flush();
+                
+                #ifdef DEBUG
+                    uart_print("state: STOP -> IDLE\n");
+                #endif
+            }
+            else
+            {
+                // key was NOT accepted
+                keyAccepted = false;
+            }
+
+            break;
+        }
+
+        case SW_STATE_CLR:
+        {
+            if(PB)
+            {
+                __func_clear_eeprom(laneSel);   
+                lcd_write("Erased  ",0);
+
+                pLane->state = SW_STATE_CLRD;
+
+                #ifdef DEBUG
+                    uart_print("state: CLEAR -> CLEARED\n");
+                #endif
+            }
+            
+            break;
+        }
+
+        case SW_STATE_CLRD:
+        {
+            if(PB)
+            {
+                // display again the 00:00:00
+                __func_clear_sw(&pLane->sw);
+                func_disp_sw();
+
+                pLane->state = SW_STATE_PRE_IDLE;
+
+                #ifdef DEBUG
+                    uart_print("state: CLEARED -> IDLE\n");
+                #endif
+            }
+
+            break;
+        }
+        
+        case SW_STATE_SAVED:
+        {      
+            if(PB)
+            {
+                // display again the 00:00:00
+                __func_clear_sw(&pLane->sw);
+                func_disp_sw();
+
+                pLane->state = SW_STATE_PRE_IDLE;
+
+                #ifdef DEBUG
+                    uart_print("state: SAVED -> IDLE\n");
+                #endif
+            }
+
+            break;
+        }
+        
+        case SW_STATE_RECORD:
+        {      
+            lcd_write("Record! ",0);
+            
+            if(PB)
+            {
+                // display again the 00:00:00
+                __func_clear_sw(&pLane->sw);
+                func_disp_sw();
+
+                pLane->state = SW_STATE_PRE_IDLE;
+
+                #ifdef DEBUG
+                    uart_print("state: RECORD0 -> PRE_IDLE\n");
+                #endif
+            }
+
+            break;
+        }
+    }
+    
+    return keyAccepted;
+}
+
+//..............................................................................
+
+static void __func_sleep (void)
+{
+    // shut the timer and lcd off
+    timer1_stop();
+    lcd_off();  
+    
+    // PB shall not wake up the pic
+    INTCONbits.RABIE = 0;
+   
+    // enable INT2 to wake up the pic  
+    INTCON3bits.INT2IE = 1;
+    
+    // clear a may existing INT2 flag
+    INTCON3bits.INT2IF = 0;
+
+    // write the buffered eeprom data
+    eeprom_25LC256_flush();
+    
+    // send the rest of the tx-ringbuffer and enable the auto wake up
+    uart_sleep();
+    
+    SLEEP();
+    NOP();
+    
+    // disable INT2 and the auto wake up after wakeup   
+    INTCON3bits.INT2IE = 0;
+    uart_wake();
+    
+    // turn the lcd on and display 00:00:00
+    lcd_init();
+    func_disp_sw();   
+    
+    // wait for PB is released
+    __delay_ms(100);
+    while(PB);
+    
+    // turn the timer on (normal functionallity available from now)
+    timer1_start();
+    
+    // capture the PB edges again (reading PORTA ends a mismatch condition)
+    (void)PORTA;
+    INTCONbits.RABIF = 0;
+    INTCONbits.RABIE = 1;
+}
+
+//..............................................................................
+
+//static char* __func_uint8_to_hex (uint8_t val)
+//{
+//    tmp_buf[0] = val / 16 + '0';
+//    tmp_buf[1] = val % 16 + '0';
+//    
+//    if( tmp_buf[0] > '9' ) tmp_buf[0] += 7;
+//    if( tmp_buf[1] > '9' ) tmp_buf[1] += 7;
+//    
+//    tmp_buf[2] = '\0';
+//
+//    return tmp_buf;
+//}
+
+//..............................................................................
+
+static char* __func_uint16_to_dec (uint16_t val)
+{
+    return __func_dabble(val, 16, 5);
+}
+
+//..............................................................................
+
+static void __func_state_timeout (void)
+{
+    bool go_idle = false;
+    bool pending = false;
+    uint16_t now = (uint16_t)timer1_get_ticks();
+    uint8_t ln;
+    
+    // the lanes in the background time out silently (the selected one below)
+    for(ln = 0; ln < MAX_LANES; ln++)
+    {
+        if( ln == laneSel || lanes[ln].state == SW_STATE_IDLE || 
+            !__func_state_time(lanes[ln].state) )
+        {
+            continue;
+        }
+        
+        if( (int16_t)(now - lanes[ln].due) >= 0 )
+        {
+            __func_lane_idle(ln);
+        }
+        else
+        {
+            pending = true;
+        }
+    }
+    
+    // the timer expired for a lane in the background only?
+    if( !__func_state_time(pLane->state) || 
+        (int16_t)(now - pLane->due) < 0 )
+    {
+        __func_next_state_timeout();
+        return;
+    }
+
+    switch(pLane->state)
+    {
+        case SW_STATE_IDLE:
+        {
+            // time to sleep? (not in trigger mode, the gates must be served, 
+            // and not while calibrating, exporting or another lane is running
+            // or waits for its timeout, the timer must keep running)
+            if(!trigMode && !calActive && !laneRun && !pending && !expState)
+            {
+                __func_sleep();
+            }
+            
+            // ask again later (or restart after the wake up)
+            __func_arm_state_timer();
+            
+            break;
+        }
+
+        case SW_STATE_STOP:
+        {
+            // time to go from stop to idle
+            go_idle = true;
+
+            #ifdef DEBUG
+                uart_print("new state (auto): STOP -> IDLE\n");
+            #endif
+            
+            break;
+        }
+
+        case SW_STATE_CLR:
+        {
+            // time to leave "Clear?" state (because of no user confirmation)
+            go_idle = true;
+
+            #ifdef DEBUG
+                uart_print("state (auto): CLEAR -> IDLE\n");
+            #endif
+
+            break;
+        }
+
+        case SW_STATE_CLRD:
+        {
+            // time to leave "Cleard!" state
+            go_idle = true;
+
+            #ifdef DEBUG
+                uart_print("state (auto): CLEARED -> IDLE\n");
+            #endif
+            
+            break;
+        }
+        
+        case SW_STATE_SAVED:
+        {
+            go_idle = true;
+
+            #ifdef DEBUG
+                uart_print("state (auto): SAVED -> IDLE\n");
+            #endif
+            
+            break;
+        }
+        
+        case SW_STATE_RECORD:
+        {
+            if(recToggleCnt)
+            {
+                recToggleCnt--;
+
+                if(recToggleCnt % 2)
+                {
+                    func_disp_sw();
+                }
+                else
+                {
+                    lcd_write("Record! ",0);
+                }
+                
+                pLane->due += RECORD_TOGGLE_TIME;
+                __func_next_state_timeout();
+            }
+            else
+            {
+                go_idle = true;
+            }
+
+            break;
+        }
+        
+        default: break;
+    }
+    
+    if(go_idle)
+    {
+        __func_lane_idle(laneSel);
+    }
 }
 
-//*** static functions *********************************************************
+//..............................................................................
 
-static void __func_update_stopwatch (void)
+static void __func_lane_idle (uint8_t ln)
 {
-    // increment millisecond (+1 => +10ms)
-    sWatch.ms += 1;
+    lane_t *pL = &lanes[ln];
+    
+    __func_clear_sw(&pL->sw);
+    pL->state = SW_STATE_IDLE;
+    
+    // the run is over -> write the buffered laps and times (the idle block 
+    // of func_workload doesn't flush as long as another lane runs)
+    eeprom_25LC256_flush();
+    
+    if( ln != laneSel )
+    {
+        return;
+    }
+    
+    // display the resetted time
+    func_disp_sw();
+    __func_arm_state_timer();
     
-    // 1000ms passed?
-    if( sWatch.ms > 99)
+    // send the "back in idle cmd" (not inbetween the binary frames)
+    if( remMode == REM_MODE_ASCII )
+    {
+        uart_print("<8>");
+    }
+}
+
+//..............................................................................
+
+static uint16_t __func_state_time (uint8_t state)
+{
+    switch(state)
+    {
+        case SW_STATE_IDLE:     return IDLE_TO_SLEEP_TIME;
+        case SW_STATE_STOP:     return STOP_TO_IDLE_TIME;
+        case SW_STATE_CLR:      return CLEAR_TO_IDLE_TIME;
+        case SW_STATE_CLRD:     return CLEARED_TO_IDLE_TIME;
+        case SW_STATE_SAVED:    return SAVED_TO_IDLE_TIME;
+        case SW_STATE_RECORD:   return RECORD_TOGGLE_TIME;
+        default:                return 0;
+    }
+}
+
+//..............................................................................
+
+static void __func_arm_state_timer (void)
+{
+    if( pLane->state == SW_STATE_RECORD )
     {
-        sWatch.ms = 0;
-        sWatch.s++;
+        // toggle between the time and "Record!"
+        recToggleCnt = REC_TOGGLE_CNT;
+    }
+    
+    pLane->due = (uint16_t)timer1_get_ticks() + 
+                 __func_state_time(pLane->state);
+    
+    __func_next_state_timeout();
+}
 
-        // one minute passed?
-        if( sWatch.s > 59 )
+//..............................................................................
+
+static void __func_next_state_timeout (void)
+{
+    uint16_t now = (uint16_t)timer1_get_ticks();
+    uint16_t next = 0;
+    int16_t rem;
+    uint8_t ln;
+    
+    // the earliest timeout of all lanes (the lanes in the background only 
+    // time out of the states after a measurement, not the idle state)
+    for(ln = 0; ln < MAX_LANES; ln++)
+    {
+        if( !__func_state_time(lanes[ln].state) || 
+            (ln != laneSel && lanes[ln].state == SW_STATE_IDLE) )
         {
-            sWatch.s = 0;
-            sWatch.m++;
-            
-            // more than 99 minutes passed?
-            if( sWatch.m > 99 )
-            {
-                sWatch.m = 0;
-            }
+            continue;
+        }
+        
+        rem = (int16_t)(lanes[ln].due - now);
+        
+        if( rem < 1 )
+        {
+            rem = 1;
+        }
+        
+        if( !next || (uint16_t)rem < next )
+        {
+            next = (uint16_t)rem;
         }
     }
     
-    // display the new value on the LCD
-    func_disp_sw();
+    if( next )
+    {
+        timer_start(stateTimer, next, 0);
+    }
+    else
+    {
+        // no automatic time behaviour
+        timer_stop(stateTimer);
+    }
 }
 
 //..............................................................................
 
-static char* __func_time_to_str (sw_t *pSw)
+static uint16_t __func_save (uint8_t ln)
 {
-    gBuf[0] = (pSw->m  / 10) + '0';
-    gBuf[1] = (pSw->m  % 10) + '0';
-    gBuf[2] = ':';
-    gBuf[3] = (pSw->s  / 10) + '0';
-    gBuf[4] = (pSw->s  % 10) + '0';
-    gBuf[5] = ':';
-    gBuf[6] = (pSw->ms / 10) + '0';
-    gBuf[7] = (pSw->ms % 10) + '0';
-    gBuf[8] = '\0';
+    sw_t *pSw = &lanes[ln].sw;
     
-    return gBuf;
+    // take this as record if there is none (first one after clearing)
+    if( logs[ln].rec == SW_EMPTY )
+    {
+        logs[ln].rec = *pSw;
+    }
+    
+    // store the latest measurement
+    __func_log_append(ln, pSw, 1);
+    lanes[ln].measCnt++;
+    
+    return lanes[ln].measCnt;
 }
 
 //..............................................................................
 
-static uint8_t __func_debounce (void)
+static bool __func_is_new_record (uint8_t ln)
 {
-    uint8_t actKeyDown = 0;
-    uint8_t ret = 0;
+    bool new_rec = false;
+    sw_t *pSw = &lanes[ln].sw;
+    sw_t rec;
+    
+    // get the latest record (abort if no latest record was found)
+    if( __func_get_record(ln, &rec) )
+    {
+        #ifdef DEBUG
+            uart_print("no data in eeprom\n");
+        #endif
 
-    // check if PB is pressed right now
-    if(PB)
+        return new_rec;
+    }
+    
+    // check if the new measurement is a new record
+    new_rec = (*pSw < rec);
+    
+    // update the record and store the new measurement if new record
+    if( new_rec )
     {
-        // set the bit for PB
-        actKeyDown |= KEY_PB;
+        #ifdef DEBUG
+            uart_print("record\n");
+        #endif
+            
+        logs[ln].rec = *pSw;
+        __func_log_append(ln, pSw, 1);
+        lanes[ln].measCnt++;
+    }    
+    
+    return new_rec;
+}
+
+//..............................................................................
+
+static uint8_t __func_get_record (uint8_t ln, sw_t *pRec)
+{
+    // abort if there is no stored record/data
+    if( logs[ln].rec == SW_EMPTY )
+    {
+        return 1;
+    }
+
+    // the current record (shortest measured time)
+    *pRec = logs[ln].rec;
+    
+    return 0;
+}
+
+//..............................................................................
+
+static void __func_clear_eeprom (uint8_t ln)
+{
+    // the new log starts without a record and measurements
+    logs[ln].rec = SW_EMPTY;
+    lanes[ln].measCnt = 0;
+    __func_log_open(ln, true);
+}
+
+//..............................................................................
+
+static uint8_t __func_count_meas (uint8_t ln, uint16_t pg)
+{
+    uint16_t addr = LOG_PAGE_ADDR(ln, pg) + LOG_HDR_SIZE;
+    uint8_t i, cnt = 0;
+    sw_t tmpSw;
+    
+    for(i=0; i<LOG_SLOTS; i++, addr += SIZE_OF_SW)
+    {
+        eeprom_25LC256_read(addr, (uint8_t*)(&tmpSw), SIZE_OF_SW);
         
-        // increment the press&hold count var for PB
-        debCntPB++;
+        if( tmpSw == SW_EMPTY )
+        {
+            break;
+        }
+        
+        if( !(tmpSw & SW_LAP_FLAG) )
+        {
+            cnt++;
+        }
     }
     
-    // check if USR is pressed right now
-    if(USR)
+    return cnt;
+}
+
+//..............................................................................
+
+static void __func_log_scan (uint8_t ln)
+{
+    log_t *pLog = &logs[ln];
+    log_hdr_t hdr;
+    uint16_t pg, seq, d;
+    bool first = false;
+    sw_t sw;
+    uint8_t i;
+    
+    // empty log: the first page written will be page 0
+    pLog->seq = 0;
+    pLog->pages = 0;
+    pLog->head = LOG_PAGES - 1;
+    pLog->used = LOG_SLOTS;
+    pLog->rec = SW_EMPTY;
+    lanes[ln].measCnt = 0;
+    
+    // find the valid page with the newest sequence number
+    for(pg=0; pg<LOG_PAGES; pg++)
     {
-        // set the bit for USR
-        actKeyDown |= KEY_USR;
+        if( !__func_log_hdr(ln, pg, &hdr) )
+        {
+            continue;
+        }
         
-        // increment the press&hold count var for USR
-        debCntUSR++;
-    } 
+        seq = hdr.seq & LOG_SEQ_MASK;
+        d = (seq - pLog->seq) & LOG_SEQ_MASK;
+        
+        if( !pLog->pages || (d && d <= LOG_SEQ_MASK / 2) )
+        {
+            pLog->seq = seq;
+            pLog->pages = 1;
+            pLog->head = pg;
+            pLog->rec = hdr.rec;
+            first = (hdr.seq & LOG_SEQ_FIRST);
+        }
+    }
     
-    // is there a new key event (key pressed or released)?
-    if(actKeyDown != lastPressedKey)
+    if( !pLog->pages )
     {
-        // check which keys changed
-        ret = actKeyDown ^ lastPressedKey;
+        return;
+    }
+    
+    // go back over the pages of the log up to the first one
+    pg = pLog->head;
+    seq = pLog->seq;
+    lanes[ln].measCnt = __func_count_meas(ln, pg);
+    
+    while( !first && pLog->pages < LOG_PAGES )
+    {
+        pg = (pg + LOG_PAGES - 1) % LOG_PAGES;
+        seq = (seq - 1) & LOG_SEQ_MASK;
         
-        // take the new actKeyDown as lastPressedKey
-        lastPressedKey = actKeyDown;
+        if( !__func_log_hdr(ln, pg, &hdr) || 
+            (hdr.seq & LOG_SEQ_MASK) != seq )
+        {
+            break;
+        }
+        
+        pLog->pages++;
+        lanes[ln].measCnt += __func_count_meas(ln, pg);
+        first = (hdr.seq & LOG_SEQ_FIRST);
     }
     
-    return ret;
+    // count the used slots of the head page (a record may be among them)
+    for(i=0; i<LOG_SLOTS; i++)
+    {
+        eeprom_25LC256_read(LOG_PAGE_ADDR(ln, pLog->head) + LOG_HDR_SIZE + 
+                            i * SIZE_OF_SW, (uint8_t*)&sw, SIZE_OF_SW);
+        
+        if( sw == SW_EMPTY )
+        {
+            break;
+        }
+        
+        if( !(sw & SW_LAP_FLAG) && sw < pLog->rec )
+        {
+            pLog->rec = sw;
+        }
+    }
+    
+    pLog->used = i;
 }
 
 //..............................................................................
 
-static void __func_clear_sw (sw_t *pSw)
+static bool __func_log_hdr (uint8_t ln, uint16_t pg, log_hdr_t *pHdr)
 {
-    pSw->m  = 0;
-    pSw->ms = 0;
-    pSw->s  = 0;
+    eeprom_25LC256_read(LOG_PAGE_ADDR(ln, pg), (uint8_t*)pHdr, LOG_HDR_SIZE);
+    
+    return (pHdr->chk == LOG_CHK(pHdr->seq, pHdr->rec));
 }
 
 //..............................................................................
 
-static bool __func_sw_state_machine (void)
+static void __func_log_open (uint8_t ln, bool first)
 {
-    bool keyAccepted = true;
+    log_t *pLog = &logs[ln];
+    log_hdr_t hdr;
     uint16_t addr;
-            
-    switch(state)
+    
+    pLog->head = (pLog->head + 1) % LOG_PAGES;
+    pLog->seq = (pLog->seq + 1) & LOG_SEQ_MASK;
+    pLog->used = 0;
+    
+    if( first )
     {
-        case SW_STATE_PRE_IDLE:
-        {
-            state = SW_STATE_IDLE;
-            
-            // send the "back in idle cmd"
-            uart_print("<7>");
+        pLog->pages = 0;
+    }
+    
+    // the ring is full -> the oldest page is reused (its measurements are 
+    // dropped)
+    if( pLog->pages < LOG_PAGES )
+    {
+        pLog->pages++;
+    }
+    else
+    {
+        lanes[ln].measCnt -= __func_count_meas(ln, pLog->head);
+    }
+    
+    hdr.rec = pLog->rec;
+    hdr.seq = pLog->seq | (first ? LOG_SEQ_FIRST : 0);
+    hdr.chk = LOG_CHK(hdr.seq, hdr.rec);
+    
+    // erase the slots first, the page is valid as soon as the header is set
+    addr = LOG_PAGE_ADDR(ln, pLog->head);
+    eeprom_25LC256_erase_page(addr);
+    eeprom_25LC256_write(addr, (uint8_t*)&hdr, LOG_HDR_SIZE);
+}
 
-            #ifdef DEBUG
-                uart_print("state: PRE IDLE -> IDLE\n");
-            #endif
+//..............................................................................
 
-            break;
+static void __func_log_append (uint8_t ln, sw_t *pSw, uint8_t n)
+{
+    log_t *pLog = &logs[ln];
+    
+    while(n--)
+    {
+        // head page full (or no log at all)? -> start the next page
+        if( pLog->used >= LOG_SLOTS )
+        {
+            __func_log_open(ln, !pLog->pages);
         }
+        
+        eeprom_25LC256_write(LOG_PAGE_ADDR(ln, pLog->head) + LOG_HDR_SIZE + 
+                             pLog->used * SIZE_OF_SW, (uint8_t*)pSw, 
+                             SIZE_OF_SW);
+        pLog->used++;
+        pSw++;
+    }
+}
 
-        case SW_STATE_IDLE:
-        {
-            // check how long the key was pressed
-            if(debCntPB > KEY_HOLD_CLR && PB)
-            {
-                // display some status info
-                lcd_write("Erase?  ",0);
+//..............................................................................
 
-                state = SW_STATE_CLR;      
-                
-                #ifdef DEBUG
-                    uart_print("state: IDLE -> CLEAR\n");
-                #endif
-            }
-            // is the key already released?
-            else if(!PB)
-            {
-                // start a new measurement
-                state = SW_STATE_RUN;
-                
-                #ifdef DEBUG
-                    uart_print("state: IDLE -> RUN\n");
-                #endif
-            }
-            else
-            {
-                // key was NOT accepted
-                keyAccepted = false;
-            }
+static uint16_t __func_log_cnt (uint8_t ln)
+{
+    if( !logs[ln].pages )
+    {
+        return 0;
+    }
+    
+    return (logs[ln].pages - 1) * LOG_SLOTS + logs[ln].used;
+}
 
+//..............................................................................
+
+static bool __func_remote_sm (void)
+{
+    static uint8_t remState = REM_STATE_IDLE;
+    char c = inBuf[inRd];
+    
+    // a new message starts (even inside of a broken one)
+    if(c == '<')
+    {
+        remOp = 0;
+        remArgCnt = 0;
+        remHasId = false;
+        remState = REM_STATE_START;
+    }
+    else switch(remState)
+    {
+        // ignore everything else than '<' as first char
+        case REM_STATE_IDLE:
+        {
             break;
         }
-
-        case SW_STATE_RUN:
+        // the message started, now read the request id or the opcode
+        case REM_STATE_START:
         {
-            if(PB)
+            if(c == '#' && !remHasId)
             {
-                state = SW_STATE_PRE_STOP;
-                
-                // check if the measurement is a new record
-                if( __func_is_new_record(&sWatch) )
-                {
-                    state = SW_STATE_RECORD;
-
-                    #ifdef DEBUG
-                        uart_print("state: RUN -> RECORD\n");
-                    #endif
-                }
-                else
-                {
-                    #ifdef DEBUG
-                        uart_print("state: RUN -> STOP\n");
-                    #endif
-                }
+                remId = 0;
+                remHasId = true;
+                remState = REM_STATE_ID;
+                break;
             }
-
+            
+            remOp = (uint8_t)c;
+            remState = REM_STATE_OP;
             break;
         }
-
-        case SW_STATE_PRE_STOP:
-        {   
-            state = SW_STATE_STOP;
+        // read the decimal request id until ':'
+        case REM_STATE_ID:
+        {
+            if(c >= '0' && c <= '9')
+            {
+                remId = remId * 10 + (uint8_t)(c - '0');
+                break;
+            }
             
-            #ifdef DEBUG
-                uart_print("state: PRE STOP -> STOP\n");
-            #endif
-
+            remState = (c == ':') ? REM_STATE_START : REM_STATE_IDLE;
             break;
         }
-
-        case SW_STATE_STOP:
+        // read the rest of the opcode until the end char '>' (or the start
+        // of an argument)
+        case REM_STATE_OP:
         {
-            // check how long the key was pressed
-            if(debCntPB > KEY_HOLD_SAVE && PB)
+            if(c == '|')
             {
-                // save the last sw-value into the EEPROM
-                addr = __func_save(&sWatch);
-
-                // display an info message (-> #xxxx)
-                lcd_write(__func_uint16_to_dec((addr-2)>>2), 3);
-                lcd_write("-> #",0);
-                
-                state = SW_STATE_SAVED;
-               
-                #ifdef DEBUG
-                    uart_print("state: STOP -> SAVED\n");
-                #endif
+                remArg[remArgCnt++] = 0;
+                remState = REM_STATE_ARG;
+                break;
             }
-            else if(!PB)
+            
+            if(c == '>')
             {
-                __func_clear_sw(&sWatch);
-                func_disp_sw();
-
-                state = SW_STATE_IDLE;
-                
-                #ifdef DEBUG
-                    uart_print("state: STOP -> IDLE\n");
-                #endif
+                __func_remote_cmd(remOp);
+                remState = REM_STATE_IDLE;
+                break;
             }
-            else
+            
+            // opcode too long?
+            if(remOp >> 8)
             {
-                // key was NOT accepted
-                keyAccepted = false;
+                remState = REM_STATE_IDLE;
+                break;
             }
-
+            
+            remOp = REM_OP2(remOp, c);
             break;
         }
-
-        case SW_STATE_CLR:
+        // read the decimal arguments until the end char '>'
+        case REM_STATE_ARG:
         {
-            if(PB)
+            if(c >= '0' && c <= '9')
             {
-                __func_clear_eeprom();   
-                lcd_write("Erased  ",0);
-
-                state = SW_STATE_CLRD;
-
-                #ifdef DEBUG
-                    uart_print("state: CLEAR -> CLEARED\n");
-                #endif
+                remArg[remArgCnt-1] = remArg[remArgCnt-1] * 10 + 
+                                      (uint8_t)(c - '0');
+                break;
             }
             
-            break;
-        }
-
-        case SW_STATE_CLRD:
-        {
-            if(PB)
+            // next argument (if there is space left for it)
+            if(c == '|' && remArgCnt < REM_ARG_MAX)
             {
-                // display again the 00:00:00
-                __func_clear_sw(&sWatch);
-                func_disp_sw();
-
-                state = SW_STATE_PRE_IDLE;
-
-                #ifdef DEBUG
-                    uart_print("state: CLEARED -> IDLE\n");
-                #endif
+                remArg[remArgCnt++] = 0;
+                break;
             }
-
-            break;
-        }
-        
-        case SW_STATE_SAVED:
-        {      
-            if(PB)
+            
+            if(c == '>')
             {
-                // display again the 00:00:00
-                __func_clear_sw(&sWatch);
-                func_disp_sw();
-
-                state = SW_STATE_PRE_IDLE;
-
-                #ifdef DEBUG
-                    uart_print("state: SAVED -> IDLE\n");
-                #endif
+                __func_remote_cmd(remOp);
             }
-
+            
+            remState = REM_STATE_IDLE;
             break;
         }
-        
-        case SW_STATE_RECORD:
-        {      
-            lcd_write("Record! ",0);
-            
-            if(PB)
-            {
-                // display again the 00:00:00
-                __func_clear_sw(&sWatch);
-                func_disp_sw();
+    }
+    
+    // next time next char
+    inRd++;
+    
+    // check if inRd is at the limit
+    if(inRd == UART_RX_MAX)
+    {
+        inRd = 0;
+    }
+    
+    return (inRd != inWr);
+}
 
-                state = SW_STATE_PRE_IDLE;
+//..............................................................................
 
-                #ifdef DEBUG
-                    uart_print("state: RECORD0 -> PRE_IDLE\n");
-                #endif
+static void __func_tele (uint32_t now)
+{
+    uint8_t ln;
+    ts_t ts;
+    
+    // state changes of the lanes
+    for(ln=0; ln<MAX_LANES; ln++)
+    {
+        if( teleState[ln] != lanes[ln].state )
+        {
+            if( !__func_tele_send(TELE_STATE, ln, lanes[ln].state) )
+            {
+                return;
             }
-
-            break;
+            
+            teleState[ln] = lanes[ln].state;
         }
     }
     
-    return keyAccepted;
+    // key events
+    if( teleKeys != lastPressedKey )
+    {
+        if( !__func_tele_send(TELE_KEY, laneSel, lastPressedKey) )
+        {
+            return;
+        }
+        
+        teleKeys = lastPressedKey;
+    }
+    
+    // time of the running lanes
+    if( !laneRun || (now - teleLast) < telePeriod )
+    {
+        return;
+    }
+    
+    teleLast = now;
+    timer1_get_timestamp(&ts);
+    
+    for(ln=0; ln<MAX_LANES; ln++)
+    {
+        if( laneRun & (1 << ln) )
+        {
+            (void)__func_tele_send(TELE_TIME, ln, lanes[ln].base + 
+                __func_correct( timer1_elapsed_ms(&lanes[ln].start, &ts) ));
+        }
+    }
 }
 
 //..............................................................................
 
-static void __func_sleep (void)
+static bool __func_tele_send (uint8_t type, uint8_t a, uint32_t val)
 {
-    // shut the timer and lcd off
-    timer2_stop();
-    lcd_off();  
+    char hdr[] = "<x|0|";
     
-    // reset the state counter
-    state_cnt = 0;
-   
-    // enable INT2 to wake up the pic  
-    INTCON3bits.INT2IE = 1;
+    if( uart_tx_free() < TELE_ROOM )
+    {
+        return false;
+    }
     
-    // clear a may existing INT2 flag
-    INTCON3bits.INT2IF = 0;
-
-    // enable auto wake up (UART receive)
-    BAUDCONbits.WUE = 1;
+    if( remMode == REM_MODE_BIN )
+    {
+        frame_begin(type, ++teleSeq, 5);
+        frame_put(a);
+        frame_put((uint8_t)val);
+        frame_put((uint8_t)(val >> 8));
+        frame_put((uint8_t)(val >> 16));
+        frame_put((uint8_t)(val >> 24));
+        frame_end();
+        
+        return true;
+    }
     
-    SLEEP();
-    NOP();
+    // fixed width: <x|a|0000000000>
+    hdr[1] = type;
+    hdr[3] = a + '0';
     
-    // disable INT2 after wakeup   
-    INTCON3bits.INT2IE = 0;
+    uart_print(hdr);
+    uart_print(__func_dabble(val, 32, 10));
+    uart_print(">");
     
-    // turn the lcd on and display 00:00:00
-    lcd_init();
-    func_disp_sw();   
+    return true;
+}
+
+//..............................................................................
+
+static bool __func_remote_bin (void)
+{
+    switch( frame_rx((uint8_t)inBuf[inRd]) )
+    {
+        case FRAME_RX_OK:
+            __func_remote_frame();
+            break;
+        case FRAME_RX_ERR:
+            __func_remote_nak(0, 0);
+            break;
+        default:
+            break;
+    }
     
-    // wait for PB is released
-    __delay_ms(100);
-    while(PB);
+    // next time next char
+    inRd++;
     
-    // turn the timer on (normal functionallity available from now)
-    timer2_start();
+    // check if inRd is at the limit
+    if(inRd == UART_RX_MAX)
+    {
+        inRd = 0;
+    }
+    
+    return (inRd != inWr);
 }
 
 //..............................................................................
 
-//static char* __func_uint8_to_hex (uint8_t val)
-//{
-//    tmp_buf[0] = val / 16 + '0';
-//    tmp_buf[1] = val % 16 + '0';
-//    
-//    if( tmp_buf[0] > '9' ) tmp_buf[0] += 7;
-//    if( tmp_buf[1] > '9' ) tmp_buf[1] += 7;
-//    
-//    tmp_buf[2] = '\0';
-//
-//    return tmp_buf;
-//}
+static void __func_remote_frame (void)
+{
+    uint16_t idx;
+    
+    switch(frameRx.type)
+    {
+        // ping
+        case FRAME_TYPE_PING:
+        {
+            frame_begin(FRAME_TYPE_PING, frameRx.seq, 0);
+            frame_end();
+            break;
+        }
+        // export all measurements
+        case FRAME_TYPE_EXPORT:
+        {
+            __func_export_start(laneSel, 0, 0xFFFF, FRAME_TYPE_EXPORT, 
+                                frameRx.seq);
+            break;
+        }
+        // read measurements (index, count), e.g. to repeat a broken frame
+        case FRAME_TYPE_READ:
+        {
+            if( frameRx.len != 3 )
+            {
+                __func_remote_nak(frameRx.seq, frameRx.type);
+                break;
+            }
+            
+            idx = frameRx.data[0] | ((uint16_t)frameRx.data[1] << 8);
+            __func_export_start(laneSel, idx, frameRx.data[2], FRAME_TYPE_READ,
+                                frameRx.seq);
+            break;
+        }
+        // back to the ascii protocol
+        case FRAME_TYPE_ASCII:
+        {
+            frame_begin(FRAME_TYPE_ASCII, frameRx.seq, 0);
+            frame_end();
+            remMode = REM_MODE_ASCII;
+            break;
+        }
+        // unknown type
+        default:
+        {
+            __func_remote_nak(frameRx.seq, frameRx.type);
+            break;
+        }
+    }
+}
 
 //..............................................................................
 
-static char* __func_uint16_to_dec (uint16_t val)
+static void __func_remote_nak (uint8_t seq, uint8_t type)
 {
-    gBuf[0] = val/10000 + '0';
-    val %= 10000;
-    gBuf[1] = val/ 1000 + '0';
-    val %=  1000;
-    gBuf[2] = val/  100 + '0';
-    val %=   100;
-    gBuf[3] = val/   10 + '0';
-    val %=    10;
-    gBuf[4] = val       + '0';
-    
-    gBuf[5] = '\0';
+    frame_begin(FRAME_TYPE_NAK, seq, 1);
+    frame_put(type);
+    frame_end();
+}
 
-    return gBuf;
+//..............................................................................
+
+static void __func_reply (char *pBuf)
+{
+    uart_print("<");
+    
+    // tag the answer with the request id
+    if( remHasId )
+    {
+        uart_print("#");
+        uart_print(__func_uint32_to_dec(remId));
+        uart_print(":");
+    }
+    
+    uart_print(pBuf);
 }
 
 //..............................................................................
 
-static void __func_auto_time_behaviour (void)
+static void __func_remote_cmd (uint16_t op)
 {
-    bool go_idle = false;
-    static uint8_t rec_state_toggle_cnt = REC_TOGGLE_CNT; 
+    sw_t tmpSw;
+    ts_t tmpTs;
+    uart_stat_t uartStat;
+    uint16_t first, cnt;
+    int16_t err;
+    uint8_t i;
+    
+    // any command received with a new baudrate confirms it
+    if( baudOld )
+    {
+        timer_stop(baudTimer);
+        baudOld = 0;
+    }
+    
+    switch(op)
+    {
+        // ping
+        case '0':
+        {
+            __func_reply("0>");
+            break;
+        }
+        // read system info
+        case '1':
+        {
+            __func_reply("1|");
+            uart_print(__func_uint16_to_dec(BUILD_NR));
+            uart_print("|");
+            uart_print(BUILD_DATE);
+            uart_print("|");
+            uart_print(__func_int16_to_dec(calPpm));
+            uart_print(">");
+            
+            break;
+        }
+        // read eeprom info
+        case '2':
+        {
+            __func_reply("2|");
+            
+            // print the number of saved measurements (selected lane)
+            uart_print(__func_uint16_to_dec(pLane->measCnt));
+            
+            uart_print("|");
+            
+            // read out the record (00:00:00 if there is none)
+            if( __func_get_record(laneSel, &tmpSw) )
+            {
+                tmpSw = 0;
+            }
+            
+            uart_print(__func_time_to_str(&tmpSw));
+            
+            uart_print(">");
 
-    switch(state)
-    {
-        case SW_STATE_IDLE:
+            break;
+        }
+        // erase memory (not while the lane is running, see '7')
+        case '3':
         {
-            // time to sleep?
-            if(state_cnt > IDLE_TO_SLEEP_TIME)
+            if( pLane->state == SW_STATE_RUN )
             {
-                __func_sleep();
+                __func_reply("3|0>");
+                break;
             }
             
+            pLane->state = SW_STATE_CLRD;
+            __func_clear_eeprom(laneSel);
+            lcd_write("Erased  ",0);
+            __func_reply("3>");
             break;
         }
-
-        case SW_STATE_STOP:
+        // export data
+        case '4':
+        {
+            // the measurements are sent by __func_export_step
+            __func_export_start(laneSel, 0, 0xFFFF, 0, 0);
+            break;
+        }
+        // export a range of measurements (<RD|first|count>, 0: oldest one),
+        // answered like 4
+        case REM_OP2('R','D'):
         {
-            // time to go from stop to idle?
-            if(state_cnt > STOP_TO_IDLE_TIME)
+            first = 0;
+            cnt = 0xFFFF;
+            
+            // (bigger values are limited to the saved measurements anyway)
+            if( remArgCnt > 0 )
             {
-                go_idle = true;
-                
-                #ifdef DEBUG
-                    uart_print("new state (auto): STOP -> IDLE\n");
-                #endif
+                first = (remArg[0] < 0xFFFF) ? (uint16_t)remArg[0] : 0xFFFF;
+            }
+            
+            if( remArgCnt > 1 )
+            {
+                cnt = (remArg[1] < 0xFFFF) ? (uint16_t)remArg[1] : 0xFFFF;
             }
             
+            __func_export_start(laneSel, first, cnt, 0, 0);
             break;
         }
-
-        case SW_STATE_CLR:
+        // start measurement
+        case '5':
         {
-            // time to leave "Clear?" state (because of no user confirmation)
-            if(state_cnt > CLEAR_TO_IDLE_TIME)
-            {                
-                go_idle = true;
-                
-                #ifdef DEBUG
-                    uart_print("state (auto): CLEAR -> IDLE\n");
-                #endif
+            // already running? -> <5|0> (pLane->sw is only the time of the
+            // last refresh, a restart from it would set the time back)
+            if( pLane->state == SW_STATE_RUN )
+            {
+                __func_reply("5|0>");
+                break;
+            }
+            
+            timer1_get_timestamp(&tmpTs);
+            __func_start_stopwatch(laneSel, &tmpTs);
+            pLane->state = SW_STATE_RUN;
+            __func_reply("5>");
+            break;
+        }
+        // stop measurement
+        case '6':
+        {
+            if(pLane->state == SW_STATE_RUN)
+            {
+                timer1_get_timestamp(&tmpTs);
+                __func_stop_stopwatch(laneSel, &tmpTs);
+            }
+            
+            pLane->state = SW_STATE_STOP;
+            __func_reply("6|");
+            uart_print(__func_time_to_str(&pLane->sw));
+            
+            if( __func_is_new_record(laneSel) )
+            {
+                uart_print("|1>");
+            }
+            else
+            {
+                uart_print("|0>");
             }
 
             break;
         }
+        // save measurement (a running lane has to be stopped first, it would
+        // leave RUN without being stopped)
+        case '7':
+        {
+            if( pLane->state == SW_STATE_RUN )
+            {
+                __func_reply("7|0>");
+                break;
+            }
+            
+            pLane->state = SW_STATE_SAVED;
+            
+            // save the last sw-value into the EEPROM
+            __func_save(laneSel);
 
-        case SW_STATE_CLRD:
+            // display an info message (-> #xxxx)
+            lcd_write(__func_uint16_to_dec(pLane->measCnt), 3);
+            lcd_write("-> #",0);  
+            
+            __func_reply("7>");
+            break;
+        }
+        // set (<9|mode>) or toggle trigger mode
+        case '9':
         {
-            // time to leave "Cleard!" state
-            if(state_cnt > CLEARED_TO_IDLE_TIME)
+            if( remArgCnt && remArg[0] <= TRIG_MODE_LANES )
             {
-                go_idle = true;
-                
-                #ifdef DEBUG
-                    uart_print("state (auto): CLEARED -> IDLE\n");
-                #endif
+                __func_set_trigger_mode((uint8_t)remArg[0]);
+            }
+            else
+            {
+                __func_set_trigger_mode(trigMode ? TRIG_MODE_OFF : 
+                                                   TRIG_MODE_GATES);
             }
             
+            __func_reply("9|");
+            uart_print(__func_uint16_to_dec(trigMode) + 4);
+            uart_print(">");
             break;
         }
-        
-        case SW_STATE_SAVED:
+        // read the bus time of the lcd and the EEPROM since the last request
+        case 'B':
+        {
+            __func_reply("B|");
+            uart_print(__func_uint32_to_dec(spi_get_busy_time(SPI_DEV_LCD)));
+            uart_print("|");
+            uart_print(__func_uint32_to_dec(spi_get_busy_time(SPI_DEV_EEPROM)));
+            uart_print(">");
+            break;
+        }
+        // set (<R|hz>) or read the lcd refresh rate of a running measurement
+        case 'R':
         {
-            if(state_cnt > SAVED_TO_IDLE_TIME)
+            if( remArgCnt && remArg[0] <= DISP_RATE_MAX )
             {
-                go_idle = true;
-                
-                #ifdef DEBUG
-                    uart_print("state (auto): SAVED -> IDLE\n");
-                #endif
+                __func_set_disp_rate((uint8_t)remArg[0]);
             }
             
+            __func_reply("R|");
+            uart_print(__func_uint32_to_dec(100 / dispPeriod));
+            uart_print(">");
             break;
         }
-        
-        case SW_STATE_RECORD:
+        // change (<S|baud>) or read the baudrate
+        case 'S':
         {
-            if(state_cnt > RECORD_TOGGLE_TIME)
+            if( !remArgCnt )
             {
-                state_cnt = 0;
-
-                if(rec_state_toggle_cnt)
-                {
-                    rec_state_toggle_cnt--;
-                    
-                    if(rec_state_toggle_cnt % 2)
-                    {
-                        func_disp_sw();
-                    }
-                    else
-                    {
-                        lcd_write("Record! ",0);
-                    }
-                }
-                else
+                __func_reply("S|");
+                uart_print(__func_uint32_to_dec(uart_get_baud()));
+                uart_print(">");
+                break;
+            }
+            
+            // not supported? -> <S|0>
+            if( remArg[0] < UART_BAUD_MIN || remArg[0] > UART_BAUD_MAX )
+            {
+                __func_reply("S|0>");
+                break;
+            }
+            
+            err = uart_calc_baud(remArg[0], NULL);
+            
+            if( err > UART_BAUD_MAX_ERR || err < -UART_BAUD_MAX_ERR )
+            {
+                __func_reply("S|0|");
+                uart_print(__func_int16_to_dec(err));
+                uart_print(">");
+                break;
+            }
+            
+            // acknowledge with the old baudrate (deviation in [0,01%]), it
+            // is on the line completely before uart_set_baud switches
+            __func_reply("S|");
+            uart_print(__func_uint32_to_dec(remArg[0]));
+            uart_print("|");
+            uart_print(__func_int16_to_dec(err));
+            uart_print(">");
+            
+            // the host has to send a command with the new baudrate in time
+            baudOld = uart_get_baud();
+            (void)uart_set_baud(remArg[0]);
+            timer_start(baudTimer, BAUD_CONFIRM_TIME, 0);
+            break;
+        }
+        // switch to the binary protocol (<P|1>) or read the protocol mode
+        case 'P':
+        {
+            __func_reply("P|");
+            
+            if( remArgCnt && remArg[0] == REM_MODE_BIN )
+            {
+                uart_print("1>");
+                remMode = REM_MODE_BIN;
+            }
+            else
+            {
+                uart_print("0>");
+            }
+            
+            break;
+        }
+        // set (<TL|x>) or read the re-arm lockout of the photogates [10ms]
+        case REM_OP2('T','L'):
+        {
+            if( remArgCnt && remArg[0] && remArg[0] <= TRIG_LOCKOUT_MAX )
+            {
+                // the lockout is read by the high priority interrupt
+                INTCONbits.GIEH = 0;
+                trigLockout = (uint16_t)remArg[0];
+                INTCONbits.GIEH = 1;
+            }
+            
+            __func_reply("TL|");
+            uart_print(__func_uint32_to_dec(trigLockout));
+            uart_print(">");
+            break;
+        }
+        // subscribe to the telemetry (<TS|period>, 0: unsubscribe) or read
+        // the period of the time messages [10ms]
+        case REM_OP2('T','S'):
+        {
+            if( remArgCnt && (!remArg[0] || (remArg[0] >= TELE_PERIOD_MIN && 
+                                             remArg[0] <= TELE_PERIOD_MAX)) )
+            {
+                telePeriod = (uint16_t)remArg[0];
+                teleLast = timer1_get_ticks() - telePeriod;
+                
+                // start with the current states and keys
+                for(i=0; i<MAX_LANES; i++)
                 {
-                    rec_state_toggle_cnt = REC_TOGGLE_CNT;
-                    go_idle = true;
+                    teleState[i] = 0xFF;
                 }
+                
+                teleKeys = 0xFF;
             }
-
+            
+            __func_reply("TS|");
+            uart_print(__func_uint32_to_dec(telePeriod));
+            uart_print(">");
             break;
         }
-        
+        // read the error counters of the uart
+        case 'U':
+        {
+            uart_get_stat(&uartStat);
+            
+            __func_reply("U|");
+            uart_print(__func_uint32_to_dec(uartStat.txDropped));
+            uart_print("|");
+            uart_print(__func_uint32_to_dec(uartStat.rxDropped));
+            uart_print("|");
+            uart_print(__func_uint32_to_dec(uartStat.overrun));
+            uart_print("|");
+            uart_print(__func_uint32_to_dec(uartStat.framing));
+            uart_print(">");
+            break;
+        }
+        // read the wake up counter
+        case 'A':
+        {
+            __func_reply("A|");
+            uart_print(__func_uint16_to_dec(timer_get_wakeups()));
+            uart_print(">");
+            break;
+        }
+        // calibration (reference time of the host in [ms])
+        case 'C':
+        {
+            if( remArgCnt && __func_calibrate(remArg[0]) )
+            {
+                __func_reply("C|");
+                uart_print(__func_int16_to_dec(calPpm));
+                uart_print(">");
+            }
+            else
+            {
+                __func_reply("C>");
+            }
+            break;
+        }
+        // select a lane (<L|lane>) or read the selected lane
+        case 'L':
+        {
+            if( remArgCnt && remArg[0] < MAX_LANES && 
+                (pLane->state == SW_STATE_IDLE || 
+                 pLane->state == SW_STATE_STOP) )
+            {
+                __func_select_lane((uint8_t)remArg[0]);
+            }
+            
+            __func_reply("L|");
+            uart_print(__func_uint16_to_dec(laneSel) + 4);
+            uart_print(">");
+            break;
+        }
+        // end the calibration session and clear the correction
+        case 'D':
+        {
+            calActive = false;
+            __func_set_ppm(0);
+            
+            eeprom_int_write(EEPROM_INT_ADDR_PPM, 0);
+            eeprom_int_write(EEPROM_INT_ADDR_PPM+1, 0);
+            eeprom_int_write(EEPROM_INT_ADDR_MAGIC, EEPROM_INT_MAGIC);
+            
+            __func_reply("D>");
+            break;
+        }
+        // unknown command
         default: break;
     }
-    
-    if(go_idle)
-    {
-        state_cnt = 0;
-
-        // display the resetted time
-        __func_clear_sw(&sWatch);
-        func_disp_sw();
-
-        state = SW_STATE_IDLE;
-        
-        // send the "back in idle cmd"
-        uart_print("<8>");
-    }
 }
 
 //..............................................................................
 
-static uint16_t __func_save (sw_t *pSw)
+static uint32_t __func_correct (uint32_t ms)
 {
-    uint16_t addr = __func_get_addr_ptr();
+    uint16_t mh = (uint16_t)(ms >> 16);
+    uint16_t ml = (uint16_t)ms;
+    uint16_t fh = (uint16_t)(calFactor >> 16);
+    uint16_t fl = (uint16_t)calFactor;
+    uint32_t mid, mid2, corr;
     
-    // take this as record if this is the first one inside the EEPROM
-    if(addr == 0x0004)
+    if( !calFactor )
     {
-        eeprom_25LC256_write(0x0002, (uint8_t*)(&addr), 2);
+        return ms;
     }
     
-    // store the latest measurement
-    eeprom_25LC256_write(addr, (uint8_t*)pSw, SIZE_OF_SW);
+    // corr = ms * calFactor / 2^32 out of 16 bit partial products (exact, 
+    // the carries of the middle products are added separately)
+    mid  = (uint32_t)mh * fl;
+    mid2 = (uint32_t)ml * fh + (((uint32_t)ml * fl) >> 16);
     
-    // update the address of the next free slot
-    addr += SIZE_OF_SW;
+    corr  = (uint32_t)mh * fh + (mid >> 16) + (mid2 >> 16);
+    corr += ((mid & 0xFFFF) + (mid2 & 0xFFFF)) >> 16;
+    
+    return (calPpm > 0) ? ms - corr : ms + corr;
+}
+
+//..............................................................................
+
+static void __func_set_ppm (int16_t ppm)
+{
+    uint32_t p = (ppm < 0) ? (uint32_t)(-(int32_t)ppm) : (uint32_t)ppm;
     
-    // update the address pointer (next free slot)
-    __func_set_addr_ptr(addr);
+    calPpm = ppm;
     
-    return addr;
+    // p * 2^32 / 10^6 = p * 4295 - p * 0.032704 (rounded, no overflow for
+    // p <= CAL_MAX_PPM)
+    calFactor = p * 4295 - (p * 32704 + 500000) / 1000000;
 }
 
 //..............................................................................
 
-static bool __func_is_new_record (sw_t *pSw)
+static bool __func_calibrate (uint32_t host)
 {
-    bool new_rec = false;
-    uint16_t addr;
-    sw_t rec;
+    ts_t now;
+    uint32_t own;
+    int32_t diff, ppm;
     
-    // get the latest record (abort if no latest record was found)
-    if( __func_get_record(&rec) )
+    timer1_get_timestamp(&now);
+    
+    // first reference time -> start a new session
+    if( !calActive || host <= calHost )
     {
-        #ifdef DEBUG
-            uart_print("no data in eeprom\n");
-        #endif
-
-        return new_rec;
+        calActive = true;
+        calHost = host;
+        calTs = now;
+        
+        return false;
     }
     
-    // check if the new measurement is a new record
-    if(pSw->m < rec.m)
+    host -= calHost;
+    
+    // not yet long enough for a precise result
+    if( host < CAL_MIN_TIME )
     {
-        new_rec = true;
+        return false;
     }
-    else if(pSw->m == rec.m)
+    
+    // own (uncorrected) time and its deviation [ms]
+    own = timer1_elapsed_ms(&calTs, &now);
+    diff = (int32_t)(own - host);
+    
+    // beyond the max. correction? (CAL_MAX_PPM is 2% = own / 50)
+    if( diff >= (int32_t)(own / 50) )
     {
-        if(pSw->s < rec.s)
-        {
-            new_rec = true;
-        }
-        else if(pSw->s == rec.s)
-        {
-            if(pSw->ms < rec.ms)
-            {
-                new_rec = true;
-            }
-        }
+        ppm = CAL_MAX_PPM;
     }
-    
-    // update the record + address pointer if new record
-    if( new_rec )
+    else if( diff <= -(int32_t)(own / 50) )
     {
-        #ifdef DEBUG
-            uart_print("record\n");
-        #endif
-            
-        // get the next free slot
-        addr = __func_get_addr_ptr();
-        
-        // store the new measurement
-        eeprom_25LC256_write(addr, (uint8_t*)pSw, SIZE_OF_SW);
+        ppm = -CAL_MAX_PPM;
+    }
+    else
+    {
+        // scale both until diff * 10000 fits into 31 bits (a session longer
+        // than ~3h at 2%), own stays > 50 * diff
+        while( diff > 214748L || diff < -214748L )
+        {
+            diff /= 2;
+            own /= 2;
+        }
         
-        // update the record address to this slot
-        eeprom_25LC256_write(0x0002, (uint8_t*)(&addr), 2);
+        // the correction is applied to the own time (see __func_correct), so
+        // ppm = diff * 1000000 / own (scaled to avoid an overflow)
+        ppm = diff * 10000 / (int32_t)(own / 100);
         
-        // and increment the next free slot address
-        addr += SIZE_OF_SW;
-        __func_set_addr_ptr(addr);
-    }    
-    
-    return new_rec;
-}
-
-//..............................................................................
-
-
-static uint8_t __func_get_record (sw_t *pRec)
-{
-    uint16_t addr;
-
-    // read the address pointer of the current record
-    eeprom_25LC256_read(0x0002, (uint8_t*)(&addr), 2);
-    
-    // abort if the record address pointer is 0x0000
-    // (this means there is no storred record/data inside the EEPROM)
-    if(addr == 0x0000)
-    {
-        return 1;
+        if( ppm > CAL_MAX_PPM ) ppm = CAL_MAX_PPM;
+        if( ppm < -CAL_MAX_PPM ) ppm = -CAL_MAX_PPM;
     }
-
-    // read the current record (shortest measured time)
-    eeprom_25LC256_read(addr, (uint8_t*)pRec, SIZE_OF_SW);
     
-    return 0;
-}
-
-//..............................................................................
-
-static uint16_t __func_get_addr_ptr (void)
-{
-    uint16_t addr_ptr;
+    __func_set_ppm((int16_t)ppm);
     
-    eeprom_25LC256_read(0x0000, (uint8_t*)(&addr_ptr), 2);
+    // store the correction
+    eeprom_int_write(EEPROM_INT_ADDR_PPM, (uint8_t)((uint16_t)calPpm & 0xFF));
+    eeprom_int_write(EEPROM_INT_ADDR_PPM+1, (uint8_t)((uint16_t)calPpm >> 8));
+    eeprom_int_write(EEPROM_INT_ADDR_MAGIC, EEPROM_INT_MAGIC);
     
-    return addr_ptr;
-}
-
-//..............................................................................
-
-static void __func_set_addr_ptr (uint16_t addr_ptr)
-{
-    eeprom_25LC256_write(0x0000, (uint8_t*)(&addr_ptr), 2);
+    return true;
 }
 
 //..............................................................................
 
-static void __func_clear_eeprom (void)
+static char* __func_int16_to_dec (int16_t val)
 {
-    uint8_t buf [2] = {0x00, 0x00};
+    char *p;
+    uint8_t i;
     
-    // reset the next free slot to address 0x0004
-    __func_set_addr_ptr(0x0004);
+    if( val < 0 )
+    {
+        p = __func_uint16_to_dec((uint16_t)(-val));
+        
+        // shift the digits to make space for the sign
+        for(i=6; i; i--)
+        {
+            p[i] = p[i-1];
+        }
+        
+        p[0] = '-';
+        return p;
+    }
     
-    // clear the record (this is only a address)
-    eeprom_25LC256_write(0x0002, buf, 2);
+    return __func_uint16_to_dec((uint16_t)val);
 }
 
 //..............................................................................
 
-static bool __func_remote_sm (void)
+static char* __func_uint32_to_dec (uint32_t val)
 {
-    static uint8_t remState = REM_STATE_IDLE;
-    static int8_t cmd = 0;
-    uint16_t addr, i;
-    sw_t tmpSw;
-    
-    switch(remState)
-    {
-        // ignore everything else than '<' as first char
-        case REM_STATE_IDLE:
-        {
-            if(inBuf[inRd] == '<')
-            {
-                remState = REM_STATE_START;
-            }
-            break;
-        }
-        // the message started, now read the command number
-        case REM_STATE_START:
-        {
-            cmd = inBuf[inRd];
-            remState = REM_STATE_END;
-            break;
-        }
-        // now wait/read for the end char '>'
-        case REM_STATE_END:
-        {
-            if(inBuf[inRd] == '>')
-            {
-                // handle the command
-                switch(cmd)
-                {
-                    // ping
-                    case '0':
-                    {
-                        uart_print("<0>");
-                        break;
-                    }
-                    // read system info
-                    case '1':
-                    {
-                        uart_print("<1|");
-                        uart_print(__func_uint16_to_dec(BUILD_NR));
-                        uart_print("|");
-                        uart_print(BUILD_DATE);
-                        uart_print(">");
-                        
-                        break;
-                    }
-                    // read eeprom info
-                    case '2':
-                    {
-                        uart_print("<2|");
-                        
-                        // read the address of the next free EEPROM slot
-                        eeprom_25LC256_read(0x0000, (uint8_t*)(&addr), 2);
-                        
-                        // print the number of saved measurements 
-                        uart_print(__func_uint16_to_dec((addr-4) / SIZE_OF_SW));
-                        
-                        uart_print("|");
-                        
-                        // read out the record
-                        __func_get_record(&tmpSw);
-                        uart_print(__func_time_to_str(&tmpSw));
-                        
-                        uart_print(">");
-
-                        break;
-                    }
-                    // erase memory
-                    case '3':
-                    {
-                        state = SW_STATE_CLRD;
-                        __func_clear_eeprom();
-                        lcd_write("Erased  ",0);
-                        uart_print("<3>");
-                        break;
-                    }
-                    // export data
-                    case '4':
-                    {
-                        // read the address of the next free EEPROM slot
-                        eeprom_25LC256_read(0x0000, (uint8_t*)(&addr), 2);
-                        
-                        // get the number of saved measurements 
-                        i = (addr-4) / SIZE_OF_SW;
-                        
-                        // send the commando start
-                        uart_print("<4|");
-
-                        // print the number of saved measurements 
-                        uart_print(__func_uint16_to_dec((addr-4) / SIZE_OF_SW));
-                        
-                        // force the PIC to send all bytes NOW
-                        uart_tx(0);  
-                        
-                        // until all measurements were exported
-                        while(i)
-                        {
-                            // get the next measurement
-                            addr -= SIZE_OF_SW;
-                            eeprom_25LC256_read(addr, (uint8_t*)(&tmpSw), SIZE_OF_SW);
-                          
-                            // print the seperator + measurement
-                            uart_print("|");
-                            uart_print(__func_time_to_str(&tmpSw));
-                            uart_tx(0);
-                            
-                            i--;
-                        }
-                        
-                        // send end of command indicator
-                        uart_print(">");
-                        uart_tx(0);
-                        
-                        break;
-                    }
-                    // start measurement
-                    case '5':
-                    {
-                        state = SW_STATE_RUN;
-                        uart_print("<5>");
-                        break;
-                    }
-                    // stop measurement
-                    case '6':
-                    {
-                        state = SW_STATE_STOP;
-                        uart_print("<6|");
-                        uart_print(__func_time_to_str(&sWatch));
-                        
-                        if( __func_is_new_record(&sWatch) )
-                        {
-                            uart_print("|1>");
-                        }
-                        else
-                        {
-                            uart_print("|0>");
-                        }
-
-                        break;
-                    }
-                    // save measurement
-                    case '7':
-                    {
-                        state = SW_STATE_SAVED;
-                        
-                        // save the last sw-value into the EEPROM
-                        addr = __func_save(&sWatch);
-
-                        // display an info message (-> #xxxx)
-                        lcd_write(__func_uint16_to_dec((addr-2)>>2), 3);
-                        lcd_write("-> #",0);  
-                        
-                        uart_print("<7>");
-                        break;
-                    }
-                    // unknown command
-                    default: break;
-                }
-            }
-            
-            remState = REM_STATE_IDLE;
-            break;
-        }
-    }
-    
-    // next time next char
-    inRd++;
+    char *p = __func_dabble(val, 32, 10);
     
-    // check if inRd is at the limit
-    if(inRd == UART_BUF_MAX)
+    // skip the leading zeros (but keep the last digit)
+    while( *p == '0' && p[1] )
     {
-        inRd = 0;
+        p++;
     }
     
-    return (inRd != inWr);
+    return p;
 }
 
 //..............................................................................
@@ -29,34 +29,43 @@
 #include "main.h"
 #include "func.h"
 #include "uart.h"
+#include "spi.h"
 
 //*** functions ****************************************************************
 
 void __interrupt() highPrio (void)
 {
-    // waked up due to INT2?
-    if( INTCON3bits.INT2IF )
+    // start gate (or gate of lane 0) triggered (INT0)?
+    if( INTCONbits.INT0IF && INTCONbits.INT0IE )
     {
-        // nothing to do here
+        func_trigger(TRIG_GATE_START);
+        INTCONbits.INT0IF = 0;
+    }
+    // stop gate (or gate of lane 1) triggered (INT1)?
+    else if( INTCON3bits.INT1IF && INTCON3bits.INT1IE )
+    {
+        func_trigger(TRIG_GATE_STOP);
+        INTCON3bits.INT1IF = 0;
+    }
+    // USR pressed (INT2)? (also used to wake up the pic)
+    else if( INTCON3bits.INT2IF )
+    {
+        // take a lap if the stop watch is running
+        func_lap();
         INTCON3bits.INT2IF = 0;
     }
+    // PB changed (interrupt on change)?
+    else if( INTCONbits.RABIF && INTCONbits.RABIE )
+    {
+        // timestamp the edge (reading PORTA ends the mismatch condition)
+        func_pb_edge();
+        INTCONbits.RABIF = 0;
+    }
     // received data via UART?
     else if(PIR1bits.RCIF)
     {
-        status.iRx = true;
-
         // store the received byte into the fifo (this will also clear RCIF)
-        inBuf[inWr] = RCREG;
-        
-        // no, go to the next index
-        inWr++;
-        
-        // already on the last index?
-        if( inWr == UART_BUF_MAX )
-        {
-            // yes, start at the beginning
-            inWr = 0;
-        }
+        uart_rx_isr();
     }
 }
 
@@ -64,21 +73,32 @@ void __interrupt() highPrio (void)
 
 void __interrupt(low_priority) lowPrio (void)
 {
-    // 10ms passed --> TMR2?
-    if( PIR1bits.TMR2IF )
+    // 10ms passed --> CCP1 (TIMER1 compare match)?
+    if( PIR1bits.CCP1IF )
     {
         // clear the interrupt flag
-        PIR1bits.TMR2IF = 0;
+        PIR1bits.CCP1IF = 0;
         
-        // set the 10ms passed flag
-        status.iXms = true;
+        // another 10ms passed
+        timer1_increase_ticks();
+    }
+    // byte of a queued spi job shifted?
+    else if( PIR1bits.SSPIF && PIE1bits.SSPIE )
+    {
+        // next byte or next job (the flag is cleared inside)
+        spi_isr();
     }
-    else if(INTCONbits.T0IF)
+    // uart ready for the next byte?
+    else if( PIR1bits.TX1IF && PIE1bits.TX1IE )
     {
+        // next byte of the tx-ringbuffer
+        uart_tx_isr();
+    }
+    // wake up timer of the tickless idle expired?
+    else if( INTCONbits.T0IF && INTCONbits.T0IE )
+    {
+        // nothing to do here (see timer_idle)
         INTCONbits.T0IF = 0;
-        
-        // decrement all timeout counter (if in use)
-        timer0_decrease_timeout();
     }
 }
 
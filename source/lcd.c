@@ -28,21 +28,37 @@
 #include "spi.h"
 #include "main.h"
 
+//*** static variables *********************************************************
+
+// shadow copy of the visible DDRAM and the span not yet sent (see lcd_write)
+static char shadow[LCD_CHARS];
+static uint8_t dirtyFirst = 0xFF;
+static uint8_t dirtyLast = 0;
+
+// spi jobs to set the DDRAM address and to send the changed span
+static uint8_t gotoBuf[2];
+static spi_job_t gotoJob;
+static spi_job_t dataJob;
+
 //*** static functions *********************************************************
 
 /**
- * Use this function to direct the DDRAM of the LC-Display to a desired address.
- * 
- * @param addr New address for the DDRAM.
+ * This function queues the spi jobs to send the changed span of the shadow 
+ * copy to the lcd. If the previous span is still on the way, the function 
+ * will be called again once it is done.
  */
 
-static void __lcd_goto (uint8_t addr);
+static void __lcd_flush (void);
 
 //*** functions ****************************************************************
 
 void lcd_init (void)
 {
     uint8_t buf [9];
+    uint8_t i;
+    
+    // no queued job may be on the bus while the SSP is initialized
+    spi_wait();
     
     LCD_CS = 1;
     spi_init();
@@ -60,9 +76,18 @@ void lcd_init (void)
     buf[7] = 0b00000001;    // clear display
     buf[8] = 0b00000110;    // entry mode set
     
-    LCD_CS = 0;
-    spi_transfer(buf, NULL, 9);
-    LCD_CS = 1;
+    spi_select(SPI_DEV_LCD);
+    spi_tx(buf, 9);
+    spi_deselect(SPI_DEV_LCD);
+    
+    // the display was cleared (filled with spaces)
+    for(i=0; i<LCD_CHARS; i++)
+    {
+        shadow[i] = ' ';
+    }
+    
+    dirtyFirst = 0xFF;
+    dirtyLast = 0;
     
     __delay_ms(10);
 }
@@ -88,20 +113,30 @@ void lcd_init (void)
 
 void lcd_write (char *pStr, uint8_t addr)
 {
-    // set the start address first
-    __lcd_goto(addr);
-
-    // set register selection: data
-    LCD_RS = 1;
-    LCD_CS = 0;
-    
-    while(*pStr)
+    // compare the string with the shadow copy and take over the changes
+    while(*pStr && addr < LCD_CHARS)
     {
-        spi_transfer((uint8_t*)pStr, NULL, 1);
+        if( shadow[addr] != *pStr )
+        {
+            shadow[addr] = *pStr;
+            
+            // extend the span to send
+            if( dirtyFirst == 0xFF || addr < dirtyFirst )
+            {
+                dirtyFirst = addr;
+            }
+            
+            if( addr > dirtyLast )
+            {
+                dirtyLast = addr;
+            }
+        }
+        
         pStr++;
+        addr++;
     }
     
-    LCD_CS = 1;
+    __lcd_flush();
 }
 
 //..............................................................................
@@ -110,33 +145,54 @@ void lcd_off (void)
 {
     uint8_t buf;
 
-    // set register selection: command
-    LCD_RS = 0;
-    
     // display off (bit #2 = 0)
     buf = 0b00001000;
+
+    // set register selection: command (not before the queued jobs are done,
+    // a data job on the bus would be taken as command)
+    spi_select(SPI_DEV_LCD);
+    LCD_RS = 0;
     
-    LCD_CS = 0;
-    spi_transfer(&buf, NULL, 1);
-    LCD_CS = 1;
+    spi_tx(&buf, 1);
+    spi_deselect(SPI_DEV_LCD);
 }
 
 //*** static functions *********************************************************
 
-static void __lcd_goto (uint8_t addr)
+static void __lcd_flush (void)
 {
-    uint8_t buf[2];
-
-    buf[0] = 0b00110000;    // function set (instruction table 0)
-    buf[1] = 0x80 | addr;   // set DDRAM cmd + address
+    // nothing changed or the last span is still on the way?
+    if( dirtyFirst == 0xFF || dataJob.busy )
+    {
+        return;
+    }
     
-    // set register selection: command
-    LCD_RS = 0;
-    LCD_CS = 0;
-
-    spi_transfer(buf, NULL, 2);
+    gotoBuf[0] = 0b00110000;            // function set (instruction table 0)
+    gotoBuf[1] = 0x80 | dirtyFirst;     // set DDRAM cmd + address
+    
+    gotoJob.dev = SPI_DEV_LCD;
+    gotoJob.rs  = SPI_RS_CMD;
+    gotoJob.pWr = gotoBuf;
+    gotoJob.pRd = NULL;
+    gotoJob.len = 2;
+    gotoJob.cb  = NULL;
+    gotoJob.hold = false;
+    
+    // the characters are sent right out of the shadow copy (a character
+    // changed meanwhile is marked again and sent with the next span)
+    dataJob.dev = SPI_DEV_LCD;
+    dataJob.rs  = SPI_RS_DATA;
+    dataJob.pWr = (uint8_t*)&shadow[dirtyFirst];
+    dataJob.pRd = NULL;
+    dataJob.len = dirtyLast - dirtyFirst + 1;
+    dataJob.cb  = __lcd_flush;
+    dataJob.hold = false;
+    
+    dirtyFirst = 0xFF;
+    dirtyLast = 0;
     
-    LCD_CS = 1;    
+    spi_queue(&gotoJob);
+    spi_queue(&dataJob);
 }
 
 //..............................................................................
@@ -62,10 +62,13 @@ void main (void)
     lcd_init();
     func_disp_sw();
 
-    // init and start the timer 0 and 2
+    // init the timer 0 (tickless idle) and start the timer 1 (10ms tick)
     timer0_init();
-    timer2_init();
-    timer2_start();
+    timer1_init();
+    timer1_start();
+    
+    // create the stop watch' software timers
+    func_init();
     
     // go and do your job
     while(1)
@@ -83,7 +86,7 @@ static void __main_init_pic (void)
     OSCCONbits.IRCF = 0b111;
     
     // set input/output direction
-    TRISA = 0b00011100;
+    TRISA = 0b00011111;
     TRISB = 0b00110000;
     TRISC = 0b00000000;
     
@@ -91,8 +94,9 @@ static void __main_init_pic (void)
     INTCON2bits.RABPU = 0;
     WPUBbits.WPUB4 = 1;
     
-    // disable pull ups on PORTA
-    WPUA = 0;
+    // pull ups on RA0/RA1 (gate inputs): an unplugged gate keeps its input 
+    // high instead of floating into false triggers
+    WPUA = 0b00000011;
     
     // analog and digital selection
     ANSEL  = 0x00;
@@ -101,6 +105,17 @@ static void __main_init_pic (void)
     // set priority to high for INT2 (USR input)
     INTCON3bits.INT2IP = 1;
     
+    // start gate (INT0, always high prio) and stop gate (INT1) on rising edge
+    // (the interrupts will be enabled with the trigger mode)
+    INTCON2bits.INTEDG0 = 1;
+    INTCON2bits.INTEDG1 = 1;
+    INTCON3bits.INT1IP = 1;
+    
+    // interrupt on change for RA4 (PB) with high priority
+    IOCAbits.IOCA4 = 1;
+    INTCON2bits.RABIP = 1;
+    INTCONbits.RABIE = 1;
+    
     // enable interrupt priotiries
     RCONbits.IPEN = 1;
     
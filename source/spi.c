@@ -25,68 +25,435 @@
 #include <xc.h>
 #include <stdint.h>
 #include "main.h"
+#include "spi.h"
+#include "lcd.h"
+#include "eeprom.h"
+
+//*** typedef ******************************************************************
+
+// clock profile and chip select of a device
+
+typedef struct spi_dev_s
+{
+    uint8_t cs;         // chip select: bit mask of LATC (active low)
+    uint8_t sspcon1;    // clock divider + clock polarity
+    uint8_t sspstat;    // clock edge (CKE) + sample phase (SMP)
+    uint8_t prio;       // priority of the jobs (SPI_PRIO_x)
+    uint8_t usPerByte;  // bus time of one byte [us]
+    
+} spi_dev_t;
+
+//*** constants ****************************************************************
+
+static const spi_dev_t spiDev[SPI_DEV_CNT] =
+{
+    // lcd: FOSC/64 (250kHz), clk idle state = high, the display must not
+    // wait behind EEPROM traffic
+    { LCD_CS_MASK,      0b00110010, 0b00000000, SPI_PRIO_HIGH, 32 },
+    
+    // 25LC256: FOSC/4 (4MHz), same clock mode as the lcd: clk idle state = 
+    // high, data changes on the falling and is sampled on the rising edge 
+    // (SPI mode 1,1)
+    { EEPROM_CS_MASK,   0b00110000, 0b00000000, SPI_PRIO_LOW,  2 },
+};
+
+//*** static variables *********************************************************
+
+// queued jobs (the first one is on the bus) and the position inside it
+static spi_job_t * volatile pHead = NULL;
+static volatile uint8_t pos;
+
+// bus time of each device since the last spi_get_busy_time [us]
+static volatile uint32_t busyTime[SPI_DEV_CNT];
+
+// device whose clock profile is set right now
+static volatile uint8_t spiCur;
+
+// finished jobs waiting for their callback (see spi_dispatch)
+static spi_job_t * volatile pDone = NULL;
+static spi_job_t *pDoneTail = NULL;
 
 //*** prototypes ***************************************************************
 
 /**
- * This function will send and receive bytes over the serial peripheral 
- * interface (SPI).
+ * This function adds the bus time of polled bytes to the counter of the 
+ * device whose profile is set (no job is queued, the interrupt doesn't touch
+ * the counters right now).
+ * 
+ * @param len Number of bytes.
+ */
+
+static void __spi_account (uint8_t len);
+
+/**
+ * This function asserts the chip select of the first queued job and sends its
+ * first byte. The SSP interrupt has to be disabled (or the function has to be
+ * called from the interrupt).
+ */
+
+static void __spi_start (void);
+
+/**
+ * This function switches the SSP to the clock profile of a device (if it
+ * isn't set already). The bus has to be idle.
  * 
- * @param val Byte to send
- * @return Received byte
+ * @param dev Device (SPI_DEV_x).
  */
 
-static uint8_t __spi_rxtx (uint8_t val);
+static void __spi_profile (uint8_t dev);
 
 //*** functions ****************************************************************
 
 void spi_init (void)
 {
-    // clk = FOSC/64 and clk idle state = low (Bit #4)
-    SSPCON1 = 0b00110010;
+    // start with the (slow) profile of the lcd
+    SSPSTAT = spiDev[SPI_DEV_LCD].sspstat;
+    SSPCON1 = spiDev[SPI_DEV_LCD].sspcon1;
+    spiCur = SPI_DEV_LCD;
+    
+    // queued jobs are shifted by the low priority interrupt
+    IPR1bits.SSPIP = 0;
+}
+
+//..............................................................................
+
+void spi_select (uint8_t dev)
+{
+    // the queued jobs go first
+    spi_wait();
+    
+    __spi_profile(dev);
+    LATC &= ~spiDev[dev].cs;
+}
+
+//..............................................................................
+
+void spi_deselect (uint8_t dev)
+{
+    LATC |= spiDev[dev].cs;
 }
 
 //..............................................................................
 
 void spi_transfer (uint8_t* pWr, uint8_t* pRd, uint8_t len)
 {
-    uint8_t i, dummy = 0;
+    // decide the mode once, not per byte
+    if(pWr && pRd)
+    {
+        spi_txrx(pWr, pRd, len);
+    }
+    else if(pWr)
+    {
+        spi_tx(pWr, len);
+    }
+    else if(pRd)
+    {
+        spi_rx(pRd, len);
+    }
+}
+
+//..............................................................................
+
+void spi_tx (uint8_t *pWr, uint8_t len)
+{
+    uint8_t next;
     
-    // abort if read and write pointer are NULL
-    if(pWr == NULL && pRd == NULL)
+    if(!len)
     {
         return;
     }
     
-    // start reading and/or writing
-    for(i=0; i<len; i++)
+    __spi_account(len);
+    next = *pWr++;
+    
+    do
     {
-        if(pWr && pRd)
+        SSPBUF = next;
+        
+        // fetch the next byte while the current one is shifted
+        if(--len)
         {
-            // write and read
-            pRd[i] = __spi_rxtx( pWr[i] );
+            next = *pWr++;
         }
-        else if(pWr == NULL)
+        
+        while( !SSPSTATbits.BF );
+        (void)SSPBUF;
+    }
+    while(len);
+    
+    // the next job must not see the flag of the polled bytes
+    PIR1bits.SSPIF = 0;
+}
+
+//..............................................................................
+
+void spi_rx (uint8_t *pRd, uint8_t len)
+{
+    if(!len)
+    {
+        return;
+    }
+    
+    __spi_account(len);
+    
+    // the dummy byte for the first clocks
+    SSPBUF = 0x00;
+    
+    while(--len)
+    {
+        while( !SSPSTATbits.BF );
+        
+        // the next dummy byte follows the read immediately
+        *pRd++ = SSPBUF;
+        SSPBUF = 0x00;
+    }
+    
+    while( !SSPSTATbits.BF );
+    *pRd = SSPBUF;
+    
+    PIR1bits.SSPIF = 0;
+}
+
+//..............................................................................
+
+void spi_txrx (uint8_t *pWr, uint8_t *pRd, uint8_t len)
+{
+    uint8_t next;
+    
+    if(!len)
+    {
+        return;
+    }
+    
+    __spi_account(len);
+    next = *pWr++;
+    
+    do
+    {
+        SSPBUF = next;
+        
+        // fetch the next byte while the current one is shifted
+        if(--len)
         {
-            // read only (will send dummy byte 0x00)
-            pRd[i] = __spi_rxtx(dummy);
+            next = *pWr++;
+        }
+        
+        while( !SSPSTATbits.BF );
+        *pRd++ = SSPBUF;
+    }
+    while(len);
+    
+    PIR1bits.SSPIF = 0;
+}
+
+//..............................................................................
+
+void spi_queue (spi_job_t *pJob)
+{
+    spi_job_t *p;
+    uint8_t prio = spiDev[pJob->dev].prio;
+    
+    pJob->pNext = NULL;
+    pJob->busy = true;
+    
+    PIE1bits.SSPIE = 0;
+    
+    if(pHead == NULL)
+    {
+        // the bus is free, start right away
+        pHead = pJob;
+        __spi_start();
+    }
+    else
+    {
+        // behind the job on the bus, all jobs of the same or a higher 
+        // priority and the rest of a started transaction
+        p = pHead;
+        
+        while( p->pNext && (p->hold || spiDev[p->pNext->dev].prio >= prio) )
+        {
+            p = p->pNext;
+        }
+        
+        pJob->pNext = p->pNext;
+        p->pNext = pJob;
+    }
+    
+    PIE1bits.SSPIE = 1;
+}
+
+//..............................................................................
+
+void spi_wait (void)
+{
+    while(pHead);
+}
+
+//..............................................................................
+
+uint32_t spi_get_busy_time (uint8_t dev)
+{
+    uint32_t t;
+    
+    PIE1bits.SSPIE = 0;
+    
+    t = busyTime[dev];
+    busyTime[dev] = 0;
+    
+    PIE1bits.SSPIE = (pHead != NULL);
+    
+    return t;
+}
+
+//..............................................................................
+
+void spi_dispatch (void)
+{
+    spi_job_t *pJob;
+    
+    status.iSpi = false;
+    
+    while(1)
+    {
+        // take the oldest finished job
+        PIE1bits.SSPIE = 0;
+        
+        pJob = pDone;
+        
+        if(pJob)
+        {
+            pDone = pJob->pNext;
+        }
+        
+        PIE1bits.SSPIE = (pHead != NULL);
+        
+        if(pJob == NULL)
+        {
+            break;
+        }
+        
+        // the job may be queued again from within its callback
+        pJob->busy = false;
+        pJob->cb();
+    }
+}
+
+//..............................................................................
+
+void spi_isr (void)
+{
+    spi_job_t *pJob = pHead;
+    uint8_t val;
+    
+    // reading SSPBUF clears BF
+    val = SSPBUF;
+    PIR1bits.SSPIF = 0;
+    
+    if(pJob->pRd)
+    {
+        pJob->pRd[pos] = val;
+    }
+    
+    pos++;
+    
+    // next byte of the current job
+    if(pos < pJob->len)
+    {
+        SSPBUF = pJob->pWr ? pJob->pWr[pos] : 0x00;
+        return;
+    }
+    
+    // job done, release the chip select (unless the transaction continues)
+    if( !pJob->hold )
+    {
+        LATC |= spiDev[pJob->dev].cs;
+    }
+    
+    busyTime[pJob->dev] += (uint16_t)pJob->len * spiDev[pJob->dev].usPerByte;
+    
+    pHead = pJob->pNext;
+    
+    // the callback is called from the main loop (see spi_dispatch)
+    if(pJob->cb)
+    {
+        pJob->pNext = NULL;
+        
+        if(pDone == NULL)
+        {
+            pDone = pJob;
         }
         else
         {
-            // write only (return value discarded)
-            __spi_rxtx( pWr[i] );
+            pDoneTail->pNext = pJob;
         }
+        
+        pDoneTail = pJob;
+        status.iSpi = true;
+    }
+    else
+    {
+        pJob->busy = false;
+    }
+    
+    // start the next job (if there is one)
+    if(pHead)
+    {
+        __spi_start();
+    }
+    else
+    {
+        PIE1bits.SSPIE = 0;
     }
 }
 
 //*** static functions *********************************************************
 
-static uint8_t __spi_rxtx (uint8_t val)
+static void __spi_account (uint8_t len)
 {
-    SSPBUF = val;
-    while( !SSPSTATbits.BF );
+    busyTime[spiCur] += (uint16_t)len * spiDev[spiCur].usPerByte;
+}
 
-    return SSPBUF;
+//..............................................................................
+
+static void __spi_start (void)
+{
+    spi_job_t *pJob = pHead;
+    
+    pos = 0;
+    
+    __spi_profile(pJob->dev);
+    
+    if(pJob->rs == SPI_RS_CMD)
+    {
+        SPI_RS = 0;
+    }
+    else if(pJob->rs == SPI_RS_DATA)
+    {
+        SPI_RS = 1;
+    }
+    
+    LATC &= ~spiDev[pJob->dev].cs;
+    
+    // the interrupt flag is set once the first byte was shifted
+    PIR1bits.SSPIF = 0;
+    SSPBUF = pJob->pWr ? pJob->pWr[0] : 0x00;
+}
+
+//..............................................................................
+
+static void __spi_profile (uint8_t dev)
+{
+    if(dev == spiCur)
+    {
+        return;
+    }
+    
+    spiCur = dev;
+    
+    // the mode may only be changed while the SSP is disabled
+    SSPCON1 = 0x00;
+    SSPSTAT = spiDev[dev].sspstat;
+    SSPCON1 = spiDev[dev].sspcon1;
 }
 
 //..............................................................................
@@ -27,46 +27,208 @@
 
 //*** golabl variables *********************************************************
 
-static struct tOut_s tOut[MAX_TOUT];
+// free-running 10ms tick counter (incremented by the CCP1 interrupt)
+static volatile uint32_t ticks = 0;
+
+// software timers and the timing wheel (list heads per slot)
+static struct timer_s timer[MAX_TIMER];
+static uint8_t wheel[TIMER_WHEEL_SIZE] = 
+{
+    TIMER_NONE, TIMER_NONE, TIMER_NONE, TIMER_NONE,
+    TIMER_NONE, TIMER_NONE, TIMER_NONE, TIMER_NONE
+};
+
+// tick up to which the timing wheel was processed
+static uint32_t wheelTick = 0;
+
+// remainder of the last tickless idle periods [TIMER0 counts / 4]
+static uint16_t idleRem = 0;
+
+// wake ups from the idle mode (see timer_get_wakeups)
+static uint16_t wakeCnt = 0;
+
+//*** prototypes ***************************************************************
+
+/**
+ * This function links a timer into the timing wheel slot of its expiry.
+ * 
+ * @param i Timer index.
+ * @param ticks Time until expiry in [10ms] (min 1).
+ */
+
+static void __timer_link (uint8_t i, uint16_t ticks);
+
+/**
+ * This function removes a timer from its timing wheel slot.
+ * 
+ * @param i Timer index.
+ */
+
+static void __timer_unlink (uint8_t i);
+
+/**
+ * This function returns the time until the next software timer expires.
+ * 
+ * @return Ticks [10ms] until the next expiry or TIMER_IDLE_MAX if there is no
+ * active timer.
+ */
+
+static uint16_t __timer_next_expiry (void);
 
 //*** functions ****************************************************************
 
 void timer0_init (void)
 {
-    // 8 bit, 1/16 -> T0IF every ~1ms
-    T0CON = 0b01000011;
+    // 16 bit, 1/256 -> 64us per count, timer stopped
+    T0CON = 0b00000111;
     
     // set its interrupt prio to low
     INTCON2bits.TMR0IP = 0;
+}
+
+//..............................................................................
+
+void timer1_init (void)
+{
+    // 16 bit read/write, prescale = 1/1, clock = FOSC/4 (timer stopped)
+    T1CON = 0b10000000;
     
-    // enable T0IF, prio low
-    INTCONbits.T0IE = 1;
+    // compare mode: special event trigger (resets TIMER1 on match)
+    CCP1CON = 0b00001011;
     
-    // start the timer
-    T0CONbits.TMR0ON = 1;
+    // compare value (see calculation below)
+    CCPR1H = (uint8_t)((TIMER1_TICK_CNT - 1) >> 8);
+    CCPR1L = (uint8_t)((TIMER1_TICK_CNT - 1) & 0xFF);
+    
+    // low interrupt priority
+    IPR1bits.CCP1IP = 0;
+    
+    // enable interrupt
+    PIE1bits.CCP1IE = 1;
+    
+    /* Calculation of CCPR1:
+     * 
+     * Internal RC-Oscillator:  16 MHz
+     * Timer1 frequency:        16 Mhz / 4 = 4 MHz
+     * Necessary time base:     10 ms
+     * Prescaler of TIMER1:     1/1
+     * Tick count of TIMER1:    1 / 4 MHz = 0,25us
+     * Ticks for time base:     10ms / 0,25us = 40000
+     * Nominal CCPR1-Value:     40000 - 1 (period is CCPR1 + 1)
+     * Error:                   0% (apart from the rc oscillator itself)
+     * 
+     * In contrast to a period timer with postscaler the current position 
+     * within the 10ms tick can be read from TMR1 at any time.
+     */
+}
+
+//..............................................................................
+
+void timer1_start (void)
+{
+    T1CONbits.TMR1ON = 1;
+}
+
+//..............................................................................
+
+void timer1_stop (void)
+{
+    T1CONbits.TMR1ON = 0;
+    
+    // reset the timer value (high byte is written with the low byte)
+    TMR1H = 0;
+    TMR1L = 0;
 }
 
 //..............................................................................
 
-int8_t timer0_new_timeout (uint16_t ms)
+void timer1_increase_ticks (void)
+{
+    ticks++;
+}
+
+//..............................................................................
+
+uint32_t timer1_get_ticks (void)
+{
+    uint32_t t;
+    
+    // the 32 bit counter can't be read atomically, so block the CCP1 interrupt
+    PIE1bits.CCP1IE = 0;
+    t = ticks;
+    PIE1bits.CCP1IE = 1;
+    
+    return t;
+}
+
+//..............................................................................
+
+void timer1_get_timestamp (ts_t *pTs)
+{
+    uint16_t sub;
+    bool ie = PIE1bits.CCP1IE;
+    
+    // block the tick interrupt (no effect if called from the high prio isr)
+    PIE1bits.CCP1IE = 0;
+    
+    // read the timer (reading TMR1L latches TMR1H)
+    sub  = TMR1L;
+    sub |= (uint16_t)TMR1H << 8;
+    
+    pTs->tick = ticks;
+    pTs->sub  = sub;
+    
+    // the timer was reset but the tick wasn't counted yet?
+    if( PIR1bits.CCP1IF && sub < (TIMER1_TICK_CNT / 2) )
+    {
+        pTs->tick++;
+    }
+    
+    PIE1bits.CCP1IE = ie;
+}
+
+//..............................................................................
+
+uint32_t timer1_elapsed_ms (ts_t *pStart, ts_t *pStop)
+{
+    uint32_t t = pStop->tick - pStart->tick;
+    uint32_t sub = pStop->sub;
+    
+    // borrow one tick if the sub tick position of the stop is before the start
+    if( pStop->sub < pStart->sub )
+    {
+        t--;
+        sub += TIMER1_TICK_CNT;
+    }
+    
+    // (sub - start) / TIMER1_CNT_PER_MS by the reciprocal (no division)
+    sub = (sub - pStart->sub) >> TIMER1_MS_PRESHIFT;
+    
+    return t * 10 + (((uint16_t)sub * TIMER1_MS_RECIP) >> TIMER1_MS_SHIFT);
+}
+
+//..............................................................................
+
+int8_t timer_new (void (*cb)(void))
 {
     int8_t i = 0;
 
-    // find a free timeout counter
-    while( tOut[i].inUse && (i < MAX_TOUT) )
+    // find a free timer
+    while( (i < MAX_TIMER) && timer[i].inUse )
     {
         i++;
     }
     
-    // mark the tOut as "in use"
-    if(i < MAX_TOUT)
+    // mark the timer as "in use"
+    if(i < MAX_TIMER)
     {
-        tOut[i].inUse = true;
-        tOut[i].cnt = ms;
+        timer[i].inUse = true;
+        timer[i].active = false;
+        timer[i].cb = cb;
     }
     else
     {
-        // no free timeout slot found
+        // no free timer slot found
         i = -1;
     }
 
@@ -75,83 +237,233 @@ int8_t timer0_new_timeout (uint16_t ms)
 
 //..............................................................................
 
-void timer0_decrease_timeout (void)
+void timer_start (uint8_t i, uint16_t ticks, uint16_t period)
 {
-    uint8_t i = 0;
-
-    while(i < MAX_TOUT)
+    if(timer[i].active)
     {
-        if(tOut[i].inUse && tOut[i].cnt)
-        {
-            tOut[i].cnt--;
-        }
-
-        // next timeout
-        i++;
+        __timer_unlink(i);
     }
+    
+    timer[i].period = period;
+    timer[i].active = true;
+    
+    __timer_link(i, ticks);
 }
 
 //..............................................................................
 
-bool timer0_get_timeout (uint8_t i)
+void timer_stop (uint8_t i)
 {
-    return (tOut[i].cnt == 0 && tOut[i].inUse);
+    if(timer[i].active)
+    {
+        __timer_unlink(i);
+        timer[i].active = false;
+    }
 }
 
 //..............................................................................
 
-void timer0_clear_timeout (uint8_t i)
+void timer_dispatch (void)
 {
-    tOut[i].inUse = false;
-    tOut[i].cnt = 0;
+    uint32_t now = timer1_get_ticks();
+    uint8_t slot, i, next, expired, n;
+    
+    while( wheelTick != now )
+    {
+        wheelTick++;
+        slot = (uint8_t)wheelTick & (TIMER_WHEEL_SIZE - 1);
+        
+        // detach the list of this slot (survivors will be linked again)
+        i = wheel[slot];
+        wheel[slot] = TIMER_NONE;
+        expired = 0;
+        
+        while( i != TIMER_NONE )
+        {
+            next = timer[i].next;
+            
+            if( timer[i].rounds )
+            {
+                // not yet, one more wheel round
+                timer[i].rounds--;
+                timer[i].next = wheel[slot];
+                wheel[slot] = i;
+            }
+            else
+            {
+                expired |= (1 << i);
+                
+                // reload periodic timers
+                if( timer[i].period )
+                {
+                    __timer_link(i, timer[i].period);
+                }
+                else
+                {
+                    timer[i].active = false;
+                }
+            }
+            
+            i = next;
+        }
+        
+        // call the callbacks after the wheel slot is consistent again
+        for(n=0; expired; n++, expired >>= 1)
+        {
+            if( (expired & 1) && timer[n].cb )
+            {
+                timer[n].cb();
+            }
+        }
+    }
 }
 
 //..............................................................................
 
-void timer2_init (void)
+void timer_idle (void)
 {
-    // post- and pre-scale = 1/16
-    T2CON = 0b01111010;
+    uint16_t n = __timer_next_expiry();
+    uint16_t cnt, start;
+    uint32_t rem, lag;
     
-    // low interrupt priority
-    IPR1bits.TMR2IP = 0;
+    // ticks which passed since the last timer_dispatch count against the
+    // next expiry
+    PIE1bits.CCP1IE = 0;
+    lag = ticks - wheelTick;
     
-    // enable interrupt
-    PIE1bits.TMR2IE = 1;
+    // not worth to stop the tick
+    if( lag + 2 > n )
+    {
+        PIE1bits.CCP1IE = 1;
+        return;
+    }
     
-    // compare value (see calculation below)
-    PR2 = 156;
+    n -= (uint16_t)lag;
     
-    /* Calculation of PR2:
-     * 
-     * Internal RC-Oscillator:  16 MHz
-     * Timer2 frequency:        16 Mhz / 4 = 4 MHz
-     * Necessary time base:     10 ms
-     * Prescaler of TIMER2:     1/16
-     * Postscaler of TIMER2:    1/16
-     * Tick count of TIMER2:    1/(4 MHz / (16*16)) = 64us
-     * Ticks for time base:     10ms / 64us = 156,25 
-     * Nominal PR2-Value:       156
-     * Error:                   0,16% (9,984ms instead of 10ms)
-     * Error-Direction:         faster
-     */
+    // stop the tick (TIMER1 keeps its position within the tick)
+    T1CONbits.TMR1ON = 0;
+    
+    // TIMER0 counts for n ticks: n * 10ms / 64us = n * 625 / 4
+    cnt = (uint16_t)(((uint32_t)n * 625) / 4);
+    start = (uint16_t)(0 - cnt);
+    
+    // load the timer (high byte is written with the low byte)
+    TMR0H = (uint8_t)(start >> 8);
+    TMR0L = (uint8_t)(start & 0xFF);
+    
+    INTCONbits.T0IF = 0;
+    INTCONbits.T0IE = 1;
+    T0CONbits.TMR0ON = 1;
+    
+    // sleep in idle mode (peripherals keep running)
+    OSCCONbits.IDLEN = 1;
+    SLEEP();
+    NOP();
+    OSCCONbits.IDLEN = 0;
+    
+    // woken up (by TIMER0 or any other interrupt, GIEH is still disabled)
+    wakeCnt++;
+    
+    T0CONbits.TMR0ON = 0;
+    INTCONbits.T0IE = 0;
+    INTCONbits.T0IF = 0;
+    
+    // elapsed counts (reading TMR0L latches TMR0H, wraps after an overflow)
+    cnt  = TMR0L;
+    cnt |= (uint16_t)TMR0H << 8;
+    cnt -= start;
+    
+    // convert to ticks and keep the remainder for the next idle period
+    rem = (uint32_t)cnt * 4 + idleRem;
+    n = (uint16_t)(rem / 625);
+    idleRem = (uint16_t)(rem % 625);
+    
+    // account the ticks and start the tick again (interrupts still disabled)
+    ticks += n;
+    
+    T1CONbits.TMR1ON = 1;
+    PIE1bits.CCP1IE = 1;
+}
+
+//*** static functions *********************************************************
+
+static void __timer_link (uint8_t i, uint16_t ticks)
+{
+    uint8_t slot;
+    
+    if( ticks == 0 )
+    {
+        ticks = 1;
+    }
+    
+    slot = (uint8_t)(wheelTick + ticks) & (TIMER_WHEEL_SIZE - 1);
+    
+    timer[i].slot = slot;
+    timer[i].rounds = (ticks - 1) >> TIMER_WHEEL_BITS;
+    timer[i].next = wheel[slot];
+    wheel[slot] = i;
 }
 
 //..............................................................................
 
-void timer2_start (void)
+uint16_t timer_get_wakeups (void)
 {
-    T2CONbits.TMR2ON = 1;
+    return wakeCnt;
 }
 
 //..............................................................................
 
-void timer2_stop (void)
+static void __timer_unlink (uint8_t i)
 {
-    T2CONbits.TMR2ON = 0;
+    uint8_t *p = &wheel[timer[i].slot];
+    
+    while( *p != TIMER_NONE )
+    {
+        if( *p == i )
+        {
+            *p = timer[i].next;
+            break;
+        }
+        
+        p = &timer[*p].next;
+    }
+}
+
+//..............................................................................
+
+static uint16_t __timer_next_expiry (void)
+{
+    uint16_t n, next = TIMER_IDLE_MAX;
+    uint8_t i;
+    
+    for(i=0; i<MAX_TIMER; i++)
+    {
+        if( timer[i].active )
+        {
+            // slots until the timer's slot (a full round if it's the current)
+            n = (timer[i].slot - (uint8_t)wheelTick) & (TIMER_WHEEL_SIZE - 1);
+            
+            if( n == 0 )
+            {
+                n = TIMER_WHEEL_SIZE;
+            }
+            
+            // (the limit also avoids an overflow for far away expiries)
+            if( timer[i].rounds >= (TIMER_IDLE_MAX >> TIMER_WHEEL_BITS) )
+            {
+                continue;
+            }
+            
+            n += timer[i].rounds << TIMER_WHEEL_BITS;
+            
+            if( n < next )
+            {
+                next = n;
+            }
+        }
+    }
     
-    // reset the timer value
-    TMR2 = 0;
+    return next;
 }
 
 //..............................................................................
@@ -27,34 +27,64 @@
 #include <stdbool.h>
 #include "uart.h"
 #include "timer.h"
+#include "main.h"
 
 //*** global variables *********************************************************
 
 // fifo / ring buffer for rx
-char inBuf [UART_BUF_MAX];
-uint8_t inWr = 0;
+char inBuf [UART_RX_MAX];
+volatile uint8_t inWr = 0;
 uint8_t inRd = 0;
 
 //*** static variables *********************************************************
 
 // fifo / ring buffer for tx
-static char outBuf [UART_BUF_MAX];
-uint8_t outWr = 0;
-uint8_t outRd = 0;
+static char outBuf [UART_TX_MAX];
+static volatile uint8_t outWr = 0;
+static volatile uint8_t outRd = 0;
+
+// error counters (rx errors are counted in the high priority interrupt)
+static volatile uart_stat_t stat;
+
+// called while uart_print waits for free space
+static void (*pYield)(void) = NULL;
+
+// current baudrate
+static uint32_t baudrate = UART_BAUD_DEF;
+
+//*** prototypes ***************************************************************
+
+/**
+ * This function appends a byte to the tx-ringbuffer and enables the tx
+ * interrupt. The caller has to make sure that there is room for it.
+ * 
+ * @param c Byte to send.
+ */
+
+static void __uart_put (char c);
+
+/**
+ * This function increments an error counter (saturating).
+ * 
+ * @param pCnt Pointer to the counter.
+ */
+
+static void __uart_count (volatile uint16_t *pCnt);
 
 //*** functions ****************************************************************
 
 void uart_init (void)
 {
-    TXSTA = 0b00100000;
+    TXSTA = 0b00100100;
     RCSTA = 0b10010000;
 
-    // set baudrate to 9.6kbs
-    BAUDCONbits.BRG16 = 0;
-    SPBRG = 25;
+    // 16 bit baudrate generator (high speed), set baudrate to 9.6kbs
+    BAUDCONbits.BRG16 = 1;
+    (void)uart_set_baud(UART_BAUD_DEF);
 
-    // set interrupt prio to high
+    // set interrupt prio to high (rx) and low (tx)
     IPR1bits.RC1IP = 1;
+    IPR1bits.TX1IP = 0;
 
     // enable the receive interrupt
     PIE1bits.RC1IE = 1;
@@ -64,68 +94,319 @@ void uart_init (void)
 
 void uart_print (char *pBuf)
 {
-    if( *pBuf )
+    while( *pBuf )
     {
-        // set "data in uart tx buffer available" flag
-        status.iTx = true;
+        uart_putc(*pBuf);
+        pBuf++;
     }
+}
 
-    while( *pBuf )
+//..............................................................................
+
+void uart_putc (char c)
+{
+    // wait until the tx interrupt made room for the byte
+    while( !uart_tx_free() )
     {
-        outBuf[outWr] = *pBuf;       
-        outWr++;
-        
-        // already on the last index?
-        if( outWr == UART_BUF_MAX )
+        if( pYield )
         {
-            // yes, start at the beginning
-            outWr = 0;
+            pYield();
         }
-
-        pBuf++;
     }
+    
+    __uart_put(c);
 }
 
 //..............................................................................
 
-void uart_tx (uint16_t tmo)
+bool uart_try_print (char *pBuf)
 {
-    // create a new 5ms timeout
-    uint8_t timeout = timer0_new_timeout(tmo);
+    uint8_t len = 0;
     
-    // until there is data in the fifo
-    while( outRd != outWr )
+    while( pBuf[len] )
     {
-        // break if a timeout occurred
-        if(timer0_get_timeout(timeout) && tmo)
+        len++;
+    }
+    
+    // all or nothing (a partial message would break the protocol)
+    if( len > uart_tx_free() )
+    {
+        while( len-- )
         {
-            break;
+            __uart_count(&stat.txDropped);
         }
         
-        // ready to send new data?
-        if(PIR1bits.TX1IF)
+        return false;
+    }
+    
+    while( *pBuf )
+    {
+        __uart_put(*pBuf);
+        pBuf++;
+    }
+    
+    return true;
+}
+
+//..............................................................................
+
+uint8_t uart_tx_free (void)
+{
+    uint8_t used = outWr - outRd;
+    
+    // outWr wrapped around?
+    if( used >= UART_TX_MAX )
+    {
+        used += UART_TX_MAX;
+    }
+    
+    return (UART_TX_MAX - 1) - used;
+}
+
+//..............................................................................
+
+void uart_set_yield (void (*cb)(void))
+{
+    pYield = cb;
+}
+
+//..............................................................................
+
+void uart_get_stat (uart_stat_t *pStat)
+{
+    // the rx counters are changed by the high priority interrupt
+    INTCONbits.GIEH = 0;
+    pStat->txDropped = stat.txDropped;
+    pStat->rxDropped = stat.rxDropped;
+    pStat->overrun   = stat.overrun;
+    pStat->framing   = stat.framing;
+    INTCONbits.GIEH = 1;
+}
+
+//..............................................................................
+
+int16_t uart_calc_baud (uint32_t baud, uint16_t *pBrg)
+{
+    uint32_t n, real, below;
+    
+    // baud = Fosc / (4 * (n+1)) with BRG16 = 1 and BRGH = 1: the generator
+    // values on both sides of the rate, the nearer one wins
+    n = ((uint32_t)_XTAL_FREQ / 4) / baud;
+    real = ((uint32_t)_XTAL_FREQ / 4) / n;
+    below = ((uint32_t)_XTAL_FREQ / 4) / (n + 1);
+    
+    if( baud - below < real - baud )
+    {
+        n++;
+        real = below;
+    }
+    
+    if( pBrg )
+    {
+        *pBrg = (uint16_t)(n - 1);
+    }
+    
+    return (int16_t)(((int32_t)real - (int32_t)baud) * 10000 / (int32_t)baud);
+}
+
+//..............................................................................
+
+bool uart_set_baud (uint32_t baud)
+{
+    uint16_t brg;
+    int16_t err;
+    
+    if( baud < UART_BAUD_MIN || baud > UART_BAUD_MAX )
+    {
+        return false;
+    }
+    
+    err = uart_calc_baud(baud, &brg);
+    
+    if( err > UART_BAUD_MAX_ERR || err < -UART_BAUD_MAX_ERR )
+    {
+        return false;
+    }
+    
+    // the pending data (e.g. the acknowledge of the new baudrate) is meant 
+    // for the old baudrate, its last stop bit has to be on the line first
+    // (bounded: a stuck transmitter must not block the switch for ever)
+    uart_flush(UART_FLUSH_TMO);
+    
+    SPBRGH = (uint8_t)(brg >> 8);
+    SPBRG  = (uint8_t)brg;
+    baudrate = baud;
+    
+    return true;
+}
+
+//..............................................................................
+
+uint32_t uart_get_baud (void)
+{
+    return baudrate;
+}
+
+//..............................................................................
+
+void uart_sleep (void)
+{
+    // the uart stops during sleep
+    uart_flush(UART_FLUSH_TMO);
+    
+    // enable auto wake up (UART receive)
+    BAUDCONbits.WUE = 1;
+}
+
+//..............................................................................
+
+void uart_wake (void)
+{
+    // woken up by a received byte? -> WUE was already cleared by hardware
+    BAUDCONbits.WUE = 0;
+}
+
+//..............................................................................
+
+void uart_flush (uint16_t tmo)
+{
+    ts_t start, now;
+    
+    // remember the start time for the timeout
+    timer1_get_timestamp(&start);
+    
+    // until the fifo is empty and the last byte was shifted out: TXREG1 
+    // empty (TX1IF) and the shift register empty (TRMT), the byte loaded by
+    // the interrupt reaches the shift register one cycle later
+    while( outRd != outWr || !PIR1bits.TX1IF || !TXSTAbits.TRMT )
+    {
+        // break if a timeout occurred
+        if( tmo )
         {
-            /*load the byte into the buffer*/
-            TXREG1 = outBuf[outRd];
-            outRd++;
+            timer1_get_timestamp(&now);
             
-            // already on the last index?
-            if( outRd == UART_BUF_MAX )
+            if( timer1_elapsed_ms(&start, &now) >= tmo )
             {
-                // yes, start at the beginning
-                outRd = 0;
+                break;
             }
-        }     
+        }
+    }
+}
+
+//..............................................................................
+
+void uart_rx_isr (void)
+{
+    uint8_t next;
+    char c;
+    
+    // overrun? -> the receiver stops until CREN is cleared
+    if( RCSTAbits.OERR )
+    {
+        __uart_count(&stat.overrun);
+        
+        RCSTAbits.CREN = 0;
+        RCSTAbits.CREN = 1;
+        
+        return;
+    }
+    
+    // framing error? -> reading RCREG clears FERR, the byte is discarded
+    if( RCSTAbits.FERR )
+    {
+        c = RCREG;
+        __uart_count(&stat.framing);
+        
+        return;
     }
     
-    // if the buffer is empty clear "data in uart tx buffer available" flag
+    // take the byte from the fifo (this will also clear RCIF)
+    c = RCREG;
+    
+    next = inWr + 1;
+    
+    // already on the last index?
+    if( next == UART_RX_MAX )
+    {
+        // yes, start at the beginning
+        next = 0;
+    }
+    
+    // buffer full? -> don't overwrite unread data
+    if( next == inRd )
+    {
+        __uart_count(&stat.rxDropped);
+        
+        return;
+    }
+    
+    inBuf[inWr] = c;
+    inWr = next;
+    
+    status.iRx = true;
+}
+
+//..............................................................................
+
+void uart_tx_isr (void)
+{
+    // nothing left? (uart_print may enable the interrupt after the last byte
+    // was already sent)
+    if( outRd == outWr )
+    {
+        PIE1bits.TX1IE = 0;
+        return;
+    }
+    
+    // load the byte into the buffer (this will also clear TX1IF)
+    TXREG1 = outBuf[outRd];
+    outRd++;
+    
+    // already on the last index?
+    if( outRd == UART_TX_MAX )
+    {
+        // yes, start at the beginning
+        outRd = 0;
+    }
+    
+    // buffer empty? -> no more interrupts until the next uart_print
     if( outRd == outWr )
     {
-        status.iTx = false;
+        PIE1bits.TX1IE = 0;
+    }
+}
+
+//..............................................................................
+
+//*** static functions *********************************************************
+
+static void __uart_put (char c)
+{
+    outBuf[outWr] = c;
+    
+    // already on the last index?
+    if( outWr == UART_TX_MAX - 1 )
+    {
+        // yes, start at the beginning
+        outWr = 0;
+    }
+    else
+    {
+        outWr++;
     }
     
-    // clear the timeout
-    timer0_clear_timeout(timeout);
+    // let the tx interrupt shift out the data
+    PIE1bits.TX1IE = 1;
+}
+
+//..............................................................................
+
+static void __uart_count (volatile uint16_t *pCnt)
+{
+    if( *pCnt != 0xFFFF )
+    {
+        (*pCnt)++;
+    }
 }
 
 //..............................................................................
@@ -0,0 +1,612 @@
+/*******************************************************************************
+ *
+ * File:        sim.c
+ * Project:     PICLCD-Stopwatch
+ * Author:      Nicolas Pannwitz (https://pic-projekte.de/)
+ * Comment:     Host stand-ins of the special function registers (tests)
+ * Licence:     Copyrightn (C) 2018 Nicolas Pannwitz
+ *
+ *              This program is free software: You can redistribute it and/or
+ *              modify it under the terms of the GNU General Public License as
+ *              published by the Free Software Foundation, either version 3 of
+ *              the License, or (at your option) any later version.
+ *
+ *              This program is distributed in the hope that it will be useful,
+ *              but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *              MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *              GNU General Public License for more details.
+ *
+ *              You should have received a copy of the GNU General Public
+ *              License along with this program.
+ *              If not, see https://www.gnu.org/licenses/
+ *
+ ******************************************************************************/
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "sim.h"
+#include "main.h"
+#include "spi.h"
+#include "lcd.h"
+#include "eeprom.h"
+#include "uart.h"
+#include "timer.h"
+
+//*** define *******************************************************************
+
+// 25LC256 instruction parser (see __sim_ee_byte)
+#define EE_CMD      0       // next byte is the instruction
+#define EE_ADDR_H   1
+#define EE_ADDR_L   2
+#define EE_READ     3       // clock out the data
+#define EE_WRITE    4       // take the data (written at the end of the frame)
+#define EE_RDSR     5
+#define EE_IGNORE   6
+
+//*** registers ****************************************************************
+
+#define SIM_DEF_BITS(n)     volatile struct sfr_bits_s n
+#define SIM_DEF(n)          volatile uint8_t n
+
+SIM_DEF_BITS(PORTAbits);    SIM_DEF_BITS(LATBbits);
+SIM_DEF_BITS(OSCCONbits);   SIM_DEF_BITS(INTCONbits);   SIM_DEF_BITS(INTCON2bits);
+SIM_DEF_BITS(INTCON3bits);  SIM_DEF_BITS(RCONbits);     SIM_DEF_BITS(WPUBbits);
+SIM_DEF_BITS(PIR1bits);     SIM_DEF_BITS(PIE1bits);     SIM_DEF_BITS(IPR1bits);
+SIM_DEF_BITS(T0CONbits);    SIM_DEF_BITS(T1CONbits);    SIM_DEF_BITS(BAUDCONbits);
+SIM_DEF_BITS(TXSTAbits);    SIM_DEF_BITS(RCSTAbits);
+
+SIM_DEF(PORTA);     SIM_DEF(TRISA);     SIM_DEF(TRISB);     SIM_DEF(TRISC);
+SIM_DEF(WPUA);      SIM_DEF(ANSEL);     SIM_DEF(ANSELH);    SIM_DEF(T0CON);
+SIM_DEF(TMR0L);     SIM_DEF(TMR0H);     SIM_DEF(T1CON);     SIM_DEF(TMR1L);
+SIM_DEF(TMR1H);     SIM_DEF(CCP1CON);   SIM_DEF(CCPR1L);    SIM_DEF(CCPR1H);
+SIM_DEF(SSPCON1);   SIM_DEF(SSPSTAT);   SIM_DEF(SSPBUF);    SIM_DEF(TXSTA);
+SIM_DEF(RCSTA);     SIM_DEF(SPBRG);     SIM_DEF(RCREG);
+SIM_DEF(SPBRGH);    SIM_DEF(EEADR);     SIM_DEF(EECON2);
+
+static volatile sim_latc_t latc = { .reg = 0xFF };
+static volatile struct sfr_bits_s sspstat;
+static volatile struct sfr_bits_s eecon1;
+static volatile uint8_t eedata;
+static volatile uint8_t txreg;
+
+//*** globals ******************************************************************
+
+// (main.c isn't part of the tests)
+status_t status = {0};
+
+sim_t *pSim = NULL;
+
+//*** static variables *********************************************************
+
+// device frames in progress (chip select seen low)
+static bool inFrame[SIM_DEV_CNT];
+
+// 25LC256: parser, instruction, address, write enable latch and the data of
+// a WRITE (by its position inside the page)
+static uint8_t eeState;
+static uint8_t eeCmd;
+static uint16_t eeAddr;
+static bool eeWel;
+static uint8_t eeData[SIM_EE_PAGE];
+static uint8_t eeLen;
+
+// the interrupt is served right now
+static bool inIsr;
+
+// a byte was loaded into TXREG1 (see __sim_uart)
+static bool txLoaded;
+
+//*** extern *******************************************************************
+
+// (uart.c and timer.c are only part of some of the tests)
+extern void uart_tx_isr (void) __attribute__((weak));
+extern void timer1_increase_ticks (void) __attribute__((weak));
+
+//*** prototypes ***************************************************************
+
+/**
+ * This function serves the uart tx interrupt once: the character loaded into
+ * TXREG1 is sent at once (TRMT stays set).
+ */
+
+static void __sim_uart (void);
+
+/**
+ * This function looks at the chip selects and ends the frame of a device whose
+ * chip select is high again.
+ */
+
+static void __sim_sample (void);
+
+/**
+ * This function tells if the chip select of a device is low.
+ *
+ * @param dev SIM_DEV_x.
+ * @return True if the device is selected.
+ */
+
+static bool __sim_selected (uint8_t dev);
+
+/**
+ * This function shifts the byte in SSPBUF: the selected device gets it and
+ * its answer is put into SSPBUF.
+ */
+
+static void __sim_shift (void);
+
+/**
+ * This function takes a byte of the lcd.
+ *
+ * @param rs Register select.
+ * @param val Byte.
+ */
+
+static void __sim_lcd_byte (uint8_t rs, uint8_t val);
+
+/**
+ * This function takes a byte of the 25LC256 and returns its answer.
+ *
+ * @param val Byte.
+ * @return Answer of the 25LC256.
+ */
+
+static uint8_t __sim_ee_byte (uint8_t val);
+
+/**
+ * This function writes the data of a WRITE instruction (end of its frame).
+ */
+
+static void __sim_ee_commit (void);
+
+//*** functions ****************************************************************
+
+void sim_reset (void)
+{
+    if( pSim == NULL )
+    {
+        pSim = mmap(NULL, sizeof(sim_t), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    }
+    
+    sim.pollBytes = 1;
+    sim.noBus = false;
+    sim.wakeAfter = 0;
+    sim.txHold = false;
+    sim.tickPoll = false;
+    memset(sim.eeInt, 0xFF, sizeof(sim.eeInt));
+    memset(sim.ee, 0xFF, sizeof(sim.ee));
+    memset(sim.eeWrites, 0, sizeof(sim.eeWrites));
+    sim.eeFailAt = 0;
+    memset(sim.ddram, ' ', sizeof(sim.ddram));
+    sim.ddAddr = 0;
+    sim_clear_log();
+    
+    latc.reg = 0xFF;
+    PIE1bits.SSPIE = 0;
+    PIE1bits.TX1IE = 0;
+    PIR1bits.TX1IF = 1;
+    TXSTAbits.TRMT = 1;
+    
+    inFrame[SIM_DEV_LCD] = false;
+    inFrame[SIM_DEV_EEPROM] = false;
+    eeState = EE_CMD;
+    eeWel = false;
+    inIsr = false;
+}
+
+//..............................................................................
+
+void sim_clear_log (void)
+{
+    memset(sim.frames, 0, sizeof(sim.frames));
+    memset(sim.bytes, 0, sizeof(sim.bytes));
+    sim.logCnt = 0;
+    sim.txCnt = 0;
+    sim.eeCycles = 0;
+}
+
+//..............................................................................
+
+void sim_spi_drain (void)
+{
+    sim_spi_run(UINT32_MAX);
+}
+
+//..............................................................................
+
+void sim_uart_drain (void)
+{
+    while( PIE1bits.TX1IE && !sim.txHold )
+    {
+        __sim_uart();
+    }
+}
+
+//..............................................................................
+
+uint32_t sim_spi_run (uint32_t max)
+{
+    uint32_t n = 0;
+    
+    // (spi_isr may end up here through its loops)
+    if( inIsr )
+    {
+        return 0;
+    }
+
+    inIsr = true;
+
+    while( PIE1bits.SSPIE && n < max )
+    {
+        __sim_shift();
+        PIR1bits.SSPIF = 1;
+        spi_isr();
+        n++;
+    }
+
+    inIsr = false;
+    __sim_sample();
+    
+    return n;
+}
+
+//..............................................................................
+
+void sim_poll (void)
+{
+    sim_spi_run(sim.pollBytes);
+    
+    if( PIE1bits.TX1IE )
+    {
+        __sim_uart();
+    }
+    
+    if( sim.tickPoll && timer1_increase_ticks )
+    {
+        timer1_increase_ticks();
+    }
+}
+
+//..............................................................................
+
+volatile sim_latc_t* sim_latc (void)
+{
+    __sim_sample();
+    return &latc;
+}
+
+//..............................................................................
+
+volatile struct sfr_bits_s* sim_sspstat (void)
+{
+    // polled transfer: the byte written to SSPBUF is shifted right away
+    if( !sim.noBus )
+    {
+        __sim_shift();
+    }
+    
+    sspstat.BF = 1;
+
+    return &sspstat;
+}
+
+//..............................................................................
+
+volatile struct sfr_bits_s* sim_eecon1 (void)
+{
+    // a started write cycle is completed by the next access (WR polling)
+    if( eecon1.WR && eecon1.WREN )
+    {
+        sim.eeInt[EEADR] = eedata;
+    }
+    
+    eecon1.WR = 0;
+
+    return &eecon1;
+}
+
+//..............................................................................
+
+volatile uint8_t* sim_eedata (void)
+{
+    // a started read is completed before EEDATA is accessed
+    if( eecon1.RD )
+    {
+        eecon1.RD = 0;
+        eedata = sim.eeInt[EEADR];
+    }
+
+    return &eedata;
+}
+
+//..............................................................................
+
+volatile uint8_t* sim_txreg (void)
+{
+    txLoaded = true;
+
+    return &txreg;
+}
+
+//..............................................................................
+
+void sim_sleep (void)
+{
+    uint16_t cnt;
+    
+    // only the tickless idle is modelled (TIMER0 as wake up timer)
+    if( !T0CONbits.TMR0ON || !INTCONbits.T0IE )
+    {
+        return;
+    }
+    
+    // TIMER0 overflows or another interrupt comes first
+    cnt = (uint16_t)(TMR0L | (TMR0H << 8));
+    
+    if( sim.wakeAfter && sim.wakeAfter < (uint16_t)(0 - cnt) )
+    {
+        cnt += sim.wakeAfter;
+    }
+    else
+    {
+        cnt = 0;
+        INTCONbits.T0IF = 1;
+    }
+    
+    TMR0L = (uint8_t)cnt;
+    TMR0H = (uint8_t)(cnt >> 8);
+}
+
+//*** static functions *********************************************************
+
+static void __sim_uart (void)
+{
+    if( !uart_tx_isr || sim.txHold )
+    {
+        return;
+    }
+    
+    // (nothing is loaded if uart_tx_isr finds the buffer empty)
+    txLoaded = false;
+    uart_tx_isr();
+    
+    if( txLoaded && sim.txCnt < SIM_TX_MAX )
+    {
+        sim.tx[sim.txCnt++] = (char)txreg;
+        sim.txBrg = (uint16_t)(SPBRGH << 8 | SPBRG);
+    }
+}
+
+//..............................................................................
+
+static void __sim_sample (void)
+{
+    uint8_t i;
+    
+    for(i=0; i<SIM_DEV_CNT; i++)
+    {
+        if( inFrame[i] && !__sim_selected(i) )
+        {
+            inFrame[i] = false;
+            
+            if( i == SIM_DEV_EEPROM )
+            {
+                __sim_ee_commit();
+            }
+        }
+    }
+}
+
+//..............................................................................
+
+static bool __sim_selected (uint8_t dev)
+{
+    return (dev == SIM_DEV_LCD) ? !latc.LC0 : !latc.LATC2;
+}
+
+//..............................................................................
+
+static void __sim_shift (void)
+{
+    uint8_t tx = SSPBUF;
+    uint8_t rx = 0xFF;
+    uint8_t i;
+    int8_t dev = -1;
+    
+    // (only the 25LC256 answers)
+    __sim_sample();
+    
+    for(i=0; i<SIM_DEV_CNT; i++)
+    {
+        if( !__sim_selected(i) )
+        {
+            continue;
+        }
+        
+        // a new frame starts with the instruction
+        if( !inFrame[i] )
+        {
+            inFrame[i] = true;
+            sim.frames[i]++;
+            
+            if( i == SIM_DEV_EEPROM )
+            {
+                eeState = EE_CMD;
+            }
+        }
+        
+        dev = (int8_t)i;
+        sim.bytes[i]++;
+        
+        if( i == SIM_DEV_LCD )
+        {
+            __sim_lcd_byte(latc.LC1, tx);
+        }
+        else
+        {
+            rx = __sim_ee_byte(tx);
+        }
+    }
+    
+    if( sim.logCnt < SIM_LOG_MAX )
+    {
+        sim.log[sim.logCnt].dev = dev;
+        sim.log[sim.logCnt].rs = latc.LC1;
+        sim.log[sim.logCnt].val = tx;
+        sim.log[sim.logCnt].sspcon1 = SSPCON1;
+        sim.log[sim.logCnt].sspstat = SSPSTAT;
+        sim.logCnt++;
+    }
+    
+    SSPBUF = rx;
+}
+
+//..............................................................................
+
+static void __sim_lcd_byte (uint8_t rs, uint8_t val)
+{
+    if( rs )
+    {
+        sim.ddram[sim.ddAddr & 0x7F] = (char)val;
+        sim.ddAddr = (sim.ddAddr + 1) & 0x7F;
+    }
+    else if( val & 0x80 )
+    {
+        // set DDRAM address
+        sim.ddAddr = val & 0x7F;
+    }
+    else if( val == 0x01 )
+    {
+        // clear display
+        memset(sim.ddram, ' ', sizeof(sim.ddram));
+        sim.ddAddr = 0;
+    }
+}
+
+//..............................................................................
+
+static uint8_t __sim_ee_byte (uint8_t val)
+{
+    uint8_t rx = 0xFF;
+
+    switch(eeState)
+    {
+        case EE_CMD:
+
+            if( val == EEPROM_25LC256_WREN )
+            {
+                eeWel = true;
+                eeState = EE_IGNORE;
+            }
+            else if( val == EEPROM_25LC256_WRDI )
+            {
+                eeWel = false;
+                eeState = EE_IGNORE;
+            }
+            else if( val == EEPROM_25LC256_RDSR )
+            {
+                eeState = EE_RDSR;
+            }
+            else if( val == EEPROM_25LC256_READ ||
+                     val == EEPROM_25LC256_WRITE )
+            {
+                eeCmd = val;
+                eeLen = 0;
+                eeState = EE_ADDR_H;
+            }
+            else
+            {
+                eeState = EE_IGNORE;
+            }
+            break;
+
+        case EE_ADDR_H:
+
+            eeAddr = (uint16_t)val << 8;
+            eeState = EE_ADDR_L;
+            break;
+
+        case EE_ADDR_L:
+
+            eeAddr = (eeAddr | val) & (SIM_EE_SIZE - 1);
+            eeState = (eeCmd == EEPROM_25LC256_READ) ? EE_READ : EE_WRITE;
+            break;
+
+        case EE_READ:
+
+            // the whole array is read sequentially
+            rx = sim.ee[eeAddr];
+            eeAddr = (eeAddr + 1) & (SIM_EE_SIZE - 1);
+            break;
+
+        case EE_WRITE:
+
+            // the address wraps inside the page
+            eeData[(eeAddr + eeLen) % SIM_EE_PAGE] = val;
+
+            if( eeLen < SIM_EE_PAGE )
+            {
+                eeLen++;
+            }
+            break;
+
+        case EE_RDSR:
+
+            // the write cycle is over once the status is read
+            rx = eeWel ? EEPROM_25LC256_SR_WEL : 0x00;
+            break;
+
+        default:
+            break;
+    }
+
+    return rx;
+}
+
+//..............................................................................
+
+static void __sim_ee_commit (void)
+{
+    uint16_t page = eeAddr & ~(uint16_t)(SIM_EE_PAGE - 1);
+    uint16_t a;
+    uint8_t i, keep = SIM_EE_PAGE;
+
+    if( eeState != EE_WRITE )
+    {
+        return;
+    }
+
+    eeState = EE_CMD;
+
+    // WRITE without WREN is ignored, the latch is reset by the write cycle
+    if( !eeWel || !eeLen )
+    {
+        return;
+    }
+
+    eeWel = false;
+    sim.eeCycles++;
+
+    // power loss within this write cycle?
+    if( sim.eeCycles == sim.eeFailAt )
+    {
+        keep = sim.eeFailKeep;
+    }
+    
+    for(i=0; i<eeLen && i<keep; i++)
+    {
+        a = page | ((eeAddr + i) % SIM_EE_PAGE);
+        
+        sim.ee[a] = eeData[(eeAddr + i) % SIM_EE_PAGE];
+        sim.eeWrites[a]++;
+    }
+    
+    // the pic is off
+    if( keep < SIM_EE_PAGE )
+    {
+        _exit(SIM_EXIT_POWER_LOSS);
+    }
+}
+
+//..............................................................................
@@ -0,0 +1,169 @@
+/*******************************************************************************
+ *
+ * File:        sim.h
+ * Project:     PICLCD-Stopwatch
+ * Author:      Nicolas Pannwitz (https://pic-projekte.de/)
+ * Comment:     Host stand-ins of the special function registers (tests)
+ * Licence:     Copyrightn (C) 2018 Nicolas Pannwitz
+ *
+ *              This program is free software: You can redistribute it and/or
+ *              modify it under the terms of the GNU General Public License as
+ *              published by the Free Software Foundation, either version 3 of
+ *              the License, or (at your option) any later version.
+ *
+ *              This program is distributed in the hope that it will be useful,
+ *              but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *              MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *              GNU General Public License for more details.
+ *
+ *              You should have received a copy of the GNU General Public
+ *              License along with this program.
+ *              If not, see https://www.gnu.org/licenses/
+ *
+ ******************************************************************************/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <xc.h>
+#include <stdint.h>
+
+//*** define *******************************************************************
+
+// devices on the bus
+#define SIM_DEV_LCD         0
+#define SIM_DEV_EEPROM      1
+#define SIM_DEV_CNT         2
+
+// size of the 25LC256 and of its pages
+#define SIM_EE_SIZE         0x8000
+#define SIM_EE_PAGE         64
+
+// length of the bus log (see sim_t.log)
+#define SIM_LOG_MAX         4096
+
+// length of the uart log (see sim_t.tx)
+#define SIM_TX_MAX          4096
+
+// exit code of a process whose power was lost (see sim_t.eeFailAt)
+#define SIM_EXIT_POWER_LOSS 99
+
+//*** typedef ******************************************************************
+
+// a byte on the bus: device selected, register select, the data and the
+// clock profile
+typedef struct sim_byte_s
+{
+    int8_t dev;                 // SIM_DEV_x (-1: none selected)
+    uint8_t rs;                 // LATC1 while the byte was shifted
+    uint8_t val;                // byte sent by the pic
+    uint8_t sspcon1;            // clock profile while the byte was shifted
+    uint8_t sspstat;
+
+} sim_byte_t;
+
+// state of the model (shared by the processes of a test, see sim_reset)
+typedef struct sim_s
+{
+    // bytes shifted by the SSP interrupt per pass of a loop (see xc.h)
+    uint8_t pollBytes;
+    
+    // polled bytes aren't shifted, BF is set at once (the cost of the model
+    // is kept out of the cycle benchmarks of the polled loops)
+    bool noBus;
+    
+    // TIMER0 counts until another interrupt wakes up the cpu from SLEEP (0:
+    // the TIMER0 overflow wakes it up)
+    uint16_t wakeAfter;
+    
+    // internal data EEPROM and the 25LC256 (erased: 0xFF)
+    uint8_t eeInt[256];
+    uint8_t ee[SIM_EE_SIZE];
+    
+    // write cycles of the 25LC256 (since sim_clear_log) and the writes of
+    // each cell (since sim_reset)
+    uint32_t eeCycles;
+    uint32_t eeWrites[SIM_EE_SIZE];
+    
+    // power loss: only the first eeFailKeep bytes of the write cycle eeFailAt
+    // are written, then the process ends (SIM_EXIT_POWER_LOSS)
+    uint32_t eeFailAt;          // 0: off
+    uint8_t eeFailKeep;
+    
+    // frames (chip select low) and bytes shifted per device and the first
+    // SIM_LOG_MAX bytes
+    uint32_t frames[SIM_DEV_CNT];
+    uint32_t bytes[SIM_DEV_CNT];
+    sim_byte_t log[SIM_LOG_MAX];
+    uint16_t logCnt;
+    
+    // the uart doesn't take characters (the tx interrupt isn't served)
+    bool txHold;
+    
+    // every pass of a loop that serves an interrupt takes one tick (the time
+    // runs while the code waits, e.g. into a timeout)
+    bool tickPoll;
+    
+    // the first SIM_TX_MAX characters sent by the uart (since sim_clear_log)
+    char tx[SIM_TX_MAX];
+    uint16_t txCnt;
+    
+    // baudrate generator (SPBRGH:SPBRG) while the last character was sent
+    uint16_t txBrg;
+    
+    // lcd: DDRAM and its address counter
+    char ddram[0x80];
+    uint8_t ddAddr;
+
+} sim_t;
+
+//*** extern *******************************************************************
+
+extern sim_t *pSim;
+
+#define sim                 (*pSim)
+
+//*** prototypes ***************************************************************
+
+/**
+ * This function resets the model: the chip selects high, the SSP interrupt
+ * disabled (one byte per pass of a loop once enabled), the cpu is only
+ * woken up by TIMER0, the lcd is cleared, the internal EEPROM and the 25LC256
+ * are erased. The model is mapped shared, so a forked process (a reboot of 
+ * the pic, all other RAM is as it was at the fork) sees and leaves the same
+ * 25LC256.
+ */
+
+void sim_reset (void);
+
+/**
+ * This function clears the frame and byte counters and the bus log.
+ */
+
+void sim_clear_log (void);
+
+/**
+ * This function serves the SSP interrupt until the queue is empty (like the
+ * low priority interrupt would do while the main loop runs).
+ */
+
+void sim_spi_drain (void);
+
+/**
+ * This function serves the SSP interrupt for up to max bytes (a queued job
+ * is interrupted on the bus).
+ * 
+ * @param max Max. number of bytes to shift.
+ * @return Number of bytes shifted.
+ */
+
+uint32_t sim_spi_run (uint32_t max);
+
+/**
+ * This function serves the uart tx interrupt until the buffer is empty (the
+ * characters are logged in sim_t.tx).
+ */
+
+void sim_uart_drain (void);
+
+#endif
@@ -0,0 +1,121 @@
+/*******************************************************************************
+ *
+ * File:        xc.h
+ * Project:     PICLCD-Stopwatch
+ * Author:      Nicolas Pannwitz (https://pic-projekte.de/)
+ * Comment:     Host stand-in for the XC8 device header (host tests only)
+ * Licence:     Copyrightn (C) 2018 Nicolas Pannwitz
+ *
+ *              This program is free software: You can redistribute it and/or
+ *              modify it under the terms of the GNU General Public License as
+ *              published by the Free Software Foundation, either version 3 of
+ *              the License, or (at your option) any later version.
+ *
+ *              This program is distributed in the hope that it will be useful,
+ *              but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *              MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *              GNU General Public License for more details.
+ *
+ *              You should have received a copy of the GNU General Public
+ *              License along with this program.
+ *              If not, see https://www.gnu.org/licenses/
+ *
+ ******************************************************************************/
+
+#ifndef XC_H
+#define XC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+//*** define *******************************************************************
+
+#define __interrupt(...)
+#define __pack
+#define low_priority
+
+#define NOP()           do{}while(0)
+#define CLRWDT()        do{}while(0)
+#define __delay_ms(x)   do{}while(0)
+#define __delay_us(x)   do{}while(0)
+
+//*** typedef ******************************************************************
+
+// all bit names of the special function registers used by the sources (one
+// struct for all of them, the tests only look at the bits they care about)
+
+struct sfr_bits_s
+{
+    unsigned RA2:1, RA4:1, LB6:1;
+    unsigned SCS:2, IRCF:3, IDLEN:1;
+    unsigned IPEN:1, GIEH:1, GIEL:1, T0IE:1, T0IF:1, RABPU:1, TMR0IP:1;
+    unsigned INT0IE:1, INT0IF:1, INT1IE:1, INT1IF:1, INT2IE:1, INT2IF:1;
+    unsigned INT2IP:1, WPUB4:1;
+    unsigned RABIE:1, RABIF:1, CCP1IE:1, CCP1IF:1, CCP1IP:1;
+    unsigned RC1IE:1, RC1IP:1, RCIF:1, TX1IE:1, TX1IF:1, TX1IP:1;
+    unsigned SSPIE:1, SSPIF:1, SSPIP:1;
+    unsigned BF:1, TMR0ON:1, TMR1ON:1, BRG16:1, WUE:1, TRMT:1, CREN:1;
+    unsigned FERR:1, OERR:1;
+    unsigned CFGS:1, EEPGD:1, RD:1, WR:1, WREN:1;
+};
+
+// LATC as byte and as bits (the chip selects are driven both ways)
+
+typedef union sim_latc_u
+{
+    uint8_t reg;
+    struct { unsigned LC0:1, LC1:1, LATC2:1; };
+
+} sim_latc_t;
+
+//*** registers ****************************************************************
+
+#define SIM_SFR_BITS(n)     extern volatile struct sfr_bits_s n
+#define SIM_SFR(n)          extern volatile uint8_t n
+
+SIM_SFR_BITS(PORTAbits);    SIM_SFR_BITS(LATBbits);
+SIM_SFR_BITS(OSCCONbits);   SIM_SFR_BITS(INTCONbits);   SIM_SFR_BITS(INTCON2bits);
+SIM_SFR_BITS(INTCON3bits);  SIM_SFR_BITS(RCONbits);     SIM_SFR_BITS(WPUBbits);
+SIM_SFR_BITS(PIR1bits);     SIM_SFR_BITS(PIE1bits);     SIM_SFR_BITS(IPR1bits);
+SIM_SFR_BITS(T0CONbits);    SIM_SFR_BITS(T1CONbits);    SIM_SFR_BITS(BAUDCONbits);
+SIM_SFR_BITS(TXSTAbits);    SIM_SFR_BITS(RCSTAbits);
+
+SIM_SFR(PORTA);     SIM_SFR(TRISA);     SIM_SFR(TRISB);     SIM_SFR(TRISC);
+SIM_SFR(WPUA);      SIM_SFR(ANSEL);     SIM_SFR(ANSELH);    SIM_SFR(T0CON);
+SIM_SFR(TMR0L);     SIM_SFR(TMR0H);     SIM_SFR(T1CON);     SIM_SFR(TMR1L);
+SIM_SFR(TMR1H);     SIM_SFR(CCP1CON);   SIM_SFR(CCPR1L);    SIM_SFR(CCPR1H);
+SIM_SFR(SSPCON1);   SIM_SFR(SSPSTAT);   SIM_SFR(SSPBUF);    SIM_SFR(TXSTA);
+SIM_SFR(RCSTA);     SIM_SFR(SPBRG);     SIM_SFR(RCREG);
+SIM_SFR(SPBRGH);    SIM_SFR(EEADR);     SIM_SFR(EECON2);
+
+// every access of LATC samples the chip selects, polling BF shifts the byte in
+// SSPBUF, SLEEP lets TIMER0 count until the cpu is woken up, EECON1/EEDATA
+// access the internal EEPROM, TXREG1 notes that a byte was loaded (see sim.c)
+
+volatile sim_latc_t* sim_latc (void);
+volatile struct sfr_bits_s* sim_sspstat (void);
+volatile struct sfr_bits_s* sim_eecon1 (void);
+volatile uint8_t* sim_eedata (void);
+volatile uint8_t* sim_txreg (void);
+void sim_sleep (void);
+
+#define SLEEP()         sim_sleep()
+
+#define LATC            (sim_latc()->reg)
+#define LATCbits        (*sim_latc())
+#define SSPSTATbits     (*sim_sspstat())
+#define EECON1bits      (*sim_eecon1())
+#define EEDATA          (*sim_eedata())
+#define TXREG1          (*sim_txreg())
+
+// the SSP and the uart tx interrupt may fire while the code waits: every loop
+// serves them (if enabled), e.g. spi_wait spins on the queue without touching
+// a register
+
+void sim_poll (void);
+
+#define while(c)        while( (PIE1bits.SSPIE || PIE1bits.TX1IE) ? \
+                               sim_poll() : (void)0, (c) )
+
+#endif
@@ -0,0 +1,71 @@
+/*******************************************************************************
+ *
+ * File:        test.h
+ * Project:     PICLCD-Stopwatch
+ * Author:      Nicolas Pannwitz (https://pic-projekte.de/)
+ * Comment:     Minimal check macros of the host tests
+ * Licence:     Copyrightn (C) 2018 Nicolas Pannwitz
+ *
+ *              This program is free software: You can redistribute it and/or
+ *              modify it under the terms of the GNU General Public License as
+ *              published by the Free Software Foundation, either version 3 of
+ *              the License, or (at your option) any later version.
+ *
+ *              This program is distributed in the hope that it will be useful,
+ *              but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *              MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *              GNU General Public License for more details.
+ *
+ *              You should have received a copy of the GNU General Public
+ *              License along with this program.
+ *              If not, see https://www.gnu.org/licenses/
+ *
+ ******************************************************************************/
+
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+//*** define *******************************************************************
+
+// checks a condition, a failed check is printed and counted (the test goes on;
+// no loop inside, a loop would serve the spi queue, see xc.h)
+#define CHECK(c)        test_check((c) != 0, __FILE__, __LINE__, #c)
+
+//*** globals ******************************************************************
+
+static unsigned long testChecks = 0;
+static unsigned long testFails = 0;
+
+//*** functions ****************************************************************
+
+static inline void test_check (int ok, const char *pFile, int line, 
+                               const char *pCond)
+{
+    testChecks++;
+    
+    if( !ok && ++testFails <= 20 )
+    {
+        printf("%s:%d: check failed: %s\n", pFile, line, pCond);
+    }
+}
+
+//..............................................................................
+
+/**
+ * This function prints the result of a test program.
+ * 
+ * @param pName Name of the test.
+ * @return Exit code (0: all checks passed).
+ */
+
+static inline int test_done (const char *pName)
+{
+    printf("%s: %lu checks, %lu failed\n", pName, testChecks, testFails);
+    
+    return testFails ? 1 : 0;
+}
+
+#endif
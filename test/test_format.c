@@ -0,0 +1,500 @@
+/*******************************************************************************
+ *
+ * File:        test_format.c
+ * Project:     PICLCD-Stopwatch
+ * Author:      Nicolas Pannwitz (https://pic-projekte.de/)
+ * Comment:     Host test of the time and number formatting (func.c)
+ * Licence:     Copyrightn (C) 2018 Nicolas Pannwitz
+ *
+ *              This program is free software: You can redistribute it and/or
+ *              modify it under the terms of the GNU General Public License as
+ *              published by the Free Software Foundation, either version 3 of
+ *              the License, or (at your option) any later version.
+ *
+ *              This program is distributed in the hope that it will be useful,
+ *              but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *              MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *              GNU General Public License for more details.
+ *
+ *              You should have received a copy of the GNU General Public
+ *              License along with this program.
+ *              If not, see https://www.gnu.org/licenses/
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x86intrin.h>
+#include "test.h"
+#include "sim.h"
+
+// the module under test (its static functions are tested)
+#include "../source/func.c"
+
+//*** define *******************************************************************
+
+// values per run of the cycle benchmark (the fastest of BENCH_RUNS runs)
+#define BENCH_CNT       20000UL
+#define BENCH_RUNS      5
+
+//*** static variables *********************************************************
+
+// remainder of the last division (see __test_div)
+static uint32_t testRem;
+
+// values of the cycle benchmark
+static uint32_t bench[BENCH_CNT];
+
+//*** static functions *********************************************************
+
+/**
+ * This function returns a random 32 bit value.
+ */
+
+static uint32_t __test_rand32 (void)
+{
+    return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+//..............................................................................
+
+/**
+ * This function divides like the software division of XC8 does (shift and
+ * subtract, one pass per bit of the operand type). The remainder is kept in
+ * testRem.
+ *
+ * @param a Dividend.
+ * @param b Divisor.
+ * @param bits Bits of the operand type (8, 16 or 32).
+ * @return Quotient.
+ */
+
+static uint32_t __test_div (uint32_t a, uint32_t b, uint8_t bits)
+{
+    uint32_t q = 0, r = 0;
+    uint8_t i;
+
+    for(i=bits; i; i--)
+    {
+        r = (r << 1) | ((a >> (i - 1)) & 1);
+        q <<= 1;
+
+        if( r >= b )
+        {
+            r -= b;
+            q |= 1;
+        }
+    }
+
+    testRem = r;
+
+    return q;
+}
+
+//..............................................................................
+
+/**
+ * These functions are the formatting as it was before (with the divisions of
+ * the operand types, see __test_div), kept as reference of the benchmark.
+ */
+
+static uint32_t __test_mod (uint32_t a, uint32_t b, uint8_t bits)
+{
+    (void)__test_div(a, b, bits);
+
+    return testRem;
+}
+
+static char* __test_3x2_before (uint8_t a, uint8_t b, uint8_t c)
+{
+    gBuf[0] = (char)__test_div(a, 10, 8) + '0';
+    gBuf[1] = (char)__test_mod(a, 10, 8) + '0';
+    gBuf[2] = ':';
+    gBuf[3] = (char)__test_div(b, 10, 8) + '0';
+    gBuf[4] = (char)__test_mod(b, 10, 8) + '0';
+    gBuf[5] = ':';
+    gBuf[6] = (char)__test_div(c, 10, 8) + '0';
+    gBuf[7] = (char)__test_mod(c, 10, 8) + '0';
+    gBuf[8] = '\0';
+
+    return gBuf;
+}
+
+static char* __test_time_before (sw_t t)
+{
+    uint8_t c;
+
+    if( t < SW_100_MIN )
+    {
+        t = __test_div(t, 10, 32);
+        c = (uint8_t)__test_mod(t, 100, 32);
+        t = __test_div(t, 100, 32);
+
+        return __test_3x2_before((uint8_t)__test_div(t, 60, 32),
+                                 (uint8_t)__test_mod(t, 60, 32), c);
+    }
+
+    t = __test_div(t, 1000, 32);
+    c = (uint8_t)__test_mod(t, 60, 32);
+    t = __test_div(t, 60, 32);
+
+    return __test_3x2_before((uint8_t)__test_mod(__test_div(t, 60, 32), 100,
+                                                 32),
+                             (uint8_t)__test_mod(t, 60, 32), c);
+}
+
+static char* __test_disp_before (sw_t t)
+{
+    uint16_t ms;
+    uint8_t s;
+
+    if( t >= SW_10_MIN )
+    {
+        return __test_time_before(t);
+    }
+
+    ms = (uint16_t)__test_mod(t, 1000, 32);
+    t = __test_div(t, 1000, 32);
+    s = (uint8_t)__test_mod(t, 60, 32);
+
+    gBuf[0] = (char)__test_div(t, 60, 32) + '0';
+    gBuf[1] = ':';
+    gBuf[2] = (char)__test_div(s, 10, 8) + '0';
+    gBuf[3] = (char)__test_mod(s, 10, 8) + '0';
+    gBuf[4] = '.';
+    gBuf[5] = (char)__test_div(ms, 100, 16) + '0';
+    gBuf[6] = (char)__test_mod(__test_div(ms, 10, 16), 10, 16) + '0';
+    gBuf[7] = (char)__test_mod(ms, 10, 16) + '0';
+    gBuf[8] = '\0';
+
+    return gBuf;
+}
+
+static char* __test_uint16_before (uint16_t val)
+{
+    gBuf[0] = (char)__test_div(val, 10000, 16) + '0';
+    val = (uint16_t)testRem;
+    gBuf[1] = (char)__test_div(val, 1000, 16) + '0';
+    val = (uint16_t)testRem;
+    gBuf[2] = (char)__test_div(val, 100, 16) + '0';
+    val = (uint16_t)testRem;
+    gBuf[3] = (char)__test_div(val, 10, 16) + '0';
+    gBuf[4] = (char)testRem + '0';
+    gBuf[5] = '\0';
+
+    return gBuf;
+}
+
+static char* __test_uint32_before (uint32_t val)
+{
+    uint8_t i = 10;
+
+    gBuf[10] = '\0';
+
+    do
+    {
+        gBuf[--i] = (char)__test_mod(val, 10, 32) + '0';
+        val = __test_div(val, 10, 32);
+    }
+    while(val);
+
+    return &gBuf[i];
+}
+
+//..............................................................................
+
+/**
+ * This function measures the host cycles per formatted value of bench[].
+ *
+ * @param kind 0: running time on the lcd, 1: time, 2: 16 bit, 3: 32 bit.
+ * @param before Use the formatting as it was before.
+ * @return Cycles per value.
+ */
+
+static double __test_cycles (uint8_t kind, bool before)
+{
+    uint64_t t, best = UINT64_MAX;
+    uint32_t n;
+    sw_t sw;
+    uint8_t r;
+
+    for(r=0; r<BENCH_RUNS; r++)
+    {
+        t = __rdtsc();
+
+        for(n=0; n<BENCH_CNT; n++)
+        {
+            sw = bench[n];
+
+            switch(kind)
+            {
+                case 0:
+                    (void)(before ? __test_disp_before(sw) :
+                                    __func_time_to_disp_str(&sw));
+                    break;
+                case 1:
+                    (void)(before ? __test_time_before(sw) :
+                                    __func_time_to_str(&sw));
+                    break;
+                case 2:
+                    (void)(before ? __test_uint16_before((uint16_t)sw) :
+                                    __func_uint16_to_dec((uint16_t)sw));
+                    break;
+                default:
+                    (void)(before ? __test_uint32_before(sw) :
+                                    __func_uint32_to_dec(sw));
+                    break;
+            }
+        }
+
+        t = __rdtsc() - t;
+
+        if( t < best )
+        {
+            best = t;
+        }
+    }
+
+    return (double)best / BENCH_CNT;
+}
+
+//..............................................................................
+
+/**
+ * This function checks the split time and both strings of a time against the
+ * division.
+ */
+
+static void __test_time (sw_t t)
+{
+    char ref[16];
+    sw_t sw = t;
+
+    __func_split_time(t);
+
+    CHECK( split.h == (t / 3600000UL) % 100 && split.m == (t / 60000) % 60 &&
+           split.s == (t / 1000) % 60 && split.ms == t % 1000 );
+
+    if( t < SW_100_MIN )
+    {
+        snprintf(ref, sizeof(ref), "%02lu:%02lu:%02lu",
+                 (unsigned long)(t / 60000), (unsigned long)(t / 1000) % 60,
+                 (unsigned long)(t % 1000) / 10);
+    }
+    else
+    {
+        snprintf(ref, sizeof(ref), "%02lu:%02lu:%02lu",
+                 (unsigned long)(t / 3600000UL) % 100,
+                 (unsigned long)(t / 60000) % 60,
+                 (unsigned long)(t / 1000) % 60);
+    }
+
+    // (a lap is formatted like a measurement)
+    if( t & 1 )
+    {
+        sw |= SW_LAP_FLAG;
+    }
+
+    CHECK( strcmp(__func_time_to_str(&sw), ref) == 0 );
+    CHECK( strcmp(__test_time_before(t), ref) == 0 );
+
+    if( t < SW_10_MIN )
+    {
+        snprintf(ref, sizeof(ref), "%lu:%02lu.%03lu",
+                 (unsigned long)(t / 60000), (unsigned long)(t / 1000) % 60,
+                 (unsigned long)(t % 1000));
+    }
+
+    CHECK( strcmp(__func_time_to_disp_str(&sw), ref) == 0 );
+    CHECK( strcmp(__test_disp_before(t), ref) == 0 );
+}
+
+//..............................................................................
+
+static void test_split (void)
+{
+    uint32_t t, n;
+
+    srand(6);
+
+    // the running time: small steps (also several minutes at once), the
+    // first 30 hours completely
+    for(t=0; t<30UL * 3600000UL; t+=1 + rand() % 97)
+    {
+        __test_time(t);
+    }
+
+    // random times (also beyond the 99 hours of the display), steps back and
+    // jumps
+    for(n=0; n<1000000UL; n++)
+    {
+        t = __test_rand32() & ~SW_LAP_FLAG;
+
+        switch(rand() % 4)
+        {
+            case 0:  t %= SW_10_MIN;  break;
+            case 1:  t %= SW_100_MIN; break;
+            case 2:  t = splitVal - (uint32_t)(rand() % 2000); break;
+            default: break;
+        }
+
+        __test_time(t & ~SW_LAP_FLAG);
+    }
+
+    // the borders of the formats and of the carries
+    __test_time(SW_10_MIN - 1);
+    __test_time(SW_10_MIN);
+    __test_time(SW_100_MIN - 1);
+    __test_time(SW_100_MIN);
+    __test_time(100UL * 3600000UL - 1);
+    __test_time(100UL * 3600000UL);
+    __test_time(SW_LAP_FLAG - 1);
+}
+
+//..............................................................................
+
+static void test_dabble (void)
+{
+    char ref[16];
+    uint32_t v, n;
+    int16_t i;
+
+    // all 16 bit values
+    for(v=0; v<0x10000UL; v++)
+    {
+        snprintf(ref, sizeof(ref), "%05lu", (unsigned long)v);
+        CHECK( strcmp(__func_uint16_to_dec((uint16_t)v), ref) == 0 );
+        CHECK( strcmp(__test_uint16_before((uint16_t)v), ref) == 0 );
+    }
+
+    for(i=-32767; i<32767; i++)
+    {
+        snprintf(ref, sizeof(ref), (i < 0) ? "-%05d" : "%05d", abs(i));
+        CHECK( strcmp(__func_int16_to_dec(i), ref) == 0 );
+    }
+
+    // 32 bit values: random ones, the powers of ten and the limits
+    srand(7);
+
+    for(n=0; n<2000000UL; n++)
+    {
+        v = __test_rand32() >> (rand() % 32);
+
+        if( n < 10 )
+        {
+            v = (n == 9) ? 0xFFFFFFFFUL : 1;
+
+            for(i=0; i<(int16_t)n && n < 9; i++)
+            {
+                v *= 10;
+            }
+        }
+
+        snprintf(ref, sizeof(ref), "%010lu", (unsigned long)v);
+        CHECK( strcmp(__func_dabble(v, 32, 10), ref) == 0 );
+
+        snprintf(ref, sizeof(ref), "%lu", (unsigned long)v);
+        CHECK( strcmp(__func_uint32_to_dec(v), ref) == 0 );
+        CHECK( strcmp(__test_uint32_before(v), ref) == 0 );
+
+        snprintf(ref, sizeof(ref), "%lu", (unsigned long)(v - 1));
+        CHECK( strcmp(__func_uint32_to_dec(v - 1), ref) == 0 );
+    }
+}
+
+//..............................................................................
+
+static void test_correct (void)
+{
+    uint32_t ms, n, p;
+    int32_t ppm;
+    int64_t exact, diff;
+
+    srand(8);
+
+    for(ppm=-CAL_MAX_PPM; ppm<=CAL_MAX_PPM; ppm+=1 + rand() % 50)
+    {
+        __func_set_ppm((int16_t)ppm);
+        p = (uint32_t)((ppm < 0) ? -ppm : ppm);
+
+        // the factor: p * 2^32 / 10^6 (rounded)
+        CHECK( calFactor == (uint32_t)((((uint64_t)p << 32) + 500000) /
+                                       1000000) );
+
+        // the correction: ms * factor / 2^32 (truncated)
+        for(n=0; n<200; n++)
+        {
+            ms = __test_rand32() >> (rand() % 32);
+
+            if( n == 0 )
+            {
+                ms = 0xFFFFFFFFUL;
+            }
+
+            CHECK( __func_correct(ms) == (uint32_t)((ppm > 0) ?
+                   ms - (((uint64_t)ms * calFactor) >> 32) :
+                   ms + (((uint64_t)ms * calFactor) >> 32)) );
+
+            // and within 1 ms of the exact correction (as long as it fits)
+            exact = (int64_t)ms - ((int64_t)ms * ppm) / 1000000;
+            diff = (int64_t)__func_correct(ms) - exact;
+            CHECK( exact > 0xFFFFFFFFLL || (diff >= -1 && diff <= 1) );
+        }
+    }
+
+    __func_set_ppm(0);
+
+    CHECK( __func_correct(123456789UL) == 123456789UL );
+}
+
+//..............................................................................
+
+static void test_cycles (void)
+{
+    static const char *pName[4] =
+    {
+        "running time (100Hz)", "measurement", "16 bit number",
+        "32 bit number"
+    };
+    double before, after;
+    uint32_t n;
+    uint8_t k;
+
+    srand(9);
+
+    for(k=0; k<4; k++)
+    {
+        for(n=0; n<BENCH_CNT; n++)
+        {
+            switch(k)
+            {
+                case 0:  bench[n] = 123456UL + n * 10; break;
+                case 1:  bench[n] = __test_rand32() % (100UL * 3600000UL);
+                         break;
+                case 2:  bench[n] = (uint16_t)rand(); break;
+                default: bench[n] = __test_rand32(); break;
+            }
+        }
+
+        before = __test_cycles(k, true);
+        after = __test_cycles(k, false);
+
+        printf("host cycles per %s: %.0f before, %.0f after\n", pName[k],
+               before, after);
+    }
+}
+
+//*** main *********************************************************************
+
+int main (void)
+{
+    sim_reset();
+
+    test_split();
+    test_dabble();
+    test_correct();
+    test_cycles();
+
+    return test_done("test_format");
+}
@@ -0,0 +1,968 @@
+/*******************************************************************************
+ *
+ * File:        test_func.c
+ * Project:     PICLCD-Stopwatch
+ * Author:      Nicolas Pannwitz (https://pic-projekte.de/)
+ * Comment:     Host test of the stop watch core (func.c)
+ * Licence:     Copyrightn (C) 2018 Nicolas Pannwitz
+ *
+ *              This program is free software: You can redistribute it and/or
+ *              modify it under the terms of the GNU General Public License as
+ *              published by the Free Software Foundation, either version 3 of
+ *              the License, or (at your option) any later version.
+ *
+ *              This program is distributed in the hope that it will be useful,
+ *              but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *              MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *              GNU General Public License for more details.
+ *
+ *              You should have received a copy of the GNU General Public
+ *              License along with this program.
+ *              If not, see https://www.gnu.org/licenses/
+ *
+ ******************************************************************************/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+#include "sim.h"
+
+// the module under test (its static functions and variables are used)
+#include "../source/func.c"
+
+//*** define *******************************************************************
+
+// passes of the main loop of the stall test
+#define STALL_LOOPS     20000UL
+
+//*** static functions *********************************************************
+
+static void test_stall (void)
+{
+    uint32_t n, k, total = 0;
+    ts_t ts;
+    
+    // no key pressed
+    PORTAbits.RA4 = 0;
+    PORTAbits.RA2 = 0;
+    
+    // start a measurement like the remote command does (TIMER1 is at the 
+    // start of a tick)
+    TMR1L = 0;
+    TMR1H = 0;
+    timer1_get_timestamp(&ts);
+    __func_start_stopwatch(0, &ts);
+    lanes[0].state = SW_STATE_RUN;
+    
+    srand(1);
+    
+    for(n=0; n<STALL_LOOPS; n++)
+    {
+        // the tick interrupt counts the ticks while the main loop is blocked:
+        // mostly not at all, sometimes for seconds (export, write cycles)
+        k = (rand() % 4) ? 1 : (uint32_t)(rand() % 500);
+        total += k;
+        
+        while( k-- )
+        {
+            timer1_increase_ticks();
+        }
+        
+        func_workload();
+        
+        // the display timer updates the time at least every dispPeriod ticks,
+        // with all ticks of a stall
+        CHECK( lanes[0].state == SW_STATE_RUN );
+        CHECK( lanes[0].sw <= total * 10 &&
+               total * 10 - lanes[0].sw < dispPeriod * 10UL );
+    }
+    
+    // a stall right before the stop, which happens 7.25ms into a tick: the
+    // stop takes the time of its timestamp
+    for(k=0; k<123; k++)
+    {
+        timer1_increase_ticks();
+    }
+    
+    total += 123;
+    TMR1L = (uint8_t)29000;
+    TMR1H = (uint8_t)(29000 >> 8);
+    timer1_get_timestamp(&ts);
+    __func_stop_stopwatch(0, &ts);
+    lanes[0].state = SW_STATE_STOP;
+    
+    printf("%lu ticks in %lu loops: %s\n", (unsigned long)total, STALL_LOOPS,
+           __func_time_to_str(&lanes[0].sw));
+    
+    CHECK( lanes[0].sw == total * 10 + 7 );
+}
+
+//..............................................................................
+
+static void test_calibrate (void)
+{
+    // host reference time and the own ticks passed meanwhile [ms, 10ms]
+    static const uint32_t session[][2] =
+    {
+        { 100000UL,    10100UL },   // oscillator 1% too fast
+        { 100000UL,     9900UL },   // 1% too slow
+        { 36000000UL, 3654000UL },  // 10h, 1.5% too fast (scaled calculation)
+        { 60000UL,      6300UL },   // 5% too fast (beyond CAL_MAX_PPM)
+    };
+    uint32_t n, k, own, corr;
+    uint16_t stored;
+    
+    // a fresh session, TIMER1 stays at the start of a tick
+    TMR1L = 0;
+    TMR1H = 0;
+    
+    for(n=0; n<sizeof(session)/sizeof(session[0]); n++)
+    {
+        calActive = false;
+        CHECK( !__func_calibrate(1000) );
+        
+        // too short for a result
+        timer1_increase_ticks();
+        CHECK( !__func_calibrate(1010) );
+        
+        for(k=1; k<session[n][1]; k++)
+        {
+            timer1_increase_ticks();
+        }
+        
+        CHECK( __func_calibrate(1000 + session[n][0]) );
+        
+        stored  = eeprom_int_read(EEPROM_INT_ADDR_PPM);
+        stored |= (uint16_t)eeprom_int_read(EEPROM_INT_ADDR_PPM+1) << 8;
+        CHECK( (int16_t)stored == calPpm );
+        CHECK( eeprom_int_read(EEPROM_INT_ADDR_MAGIC) == EEPROM_INT_MAGIC );
+        
+        // the corrected own time matches the host (the ppm resolution aside)
+        own = session[n][1] * 10;
+        corr = __func_correct(own);
+        
+        printf("calibration %lu/%lu ms: %d ppm, %lu ms\n", 
+               (unsigned long)session[n][0], (unsigned long)own, calPpm,
+               (unsigned long)corr);
+        
+        if( labs((long)own - (long)session[n][0]) < (long)(own / 50) )
+        {
+            k = (corr > session[n][0]) ? corr - session[n][0] 
+                                       : session[n][0] - corr;
+            CHECK( k <= own / 1000000 + 1 );
+        }
+        else
+        {
+            CHECK( calPpm == CAL_MAX_PPM );
+        }
+    }
+    
+    calActive = false;
+    __func_set_ppm(0);
+}
+
+//..............................................................................
+
+static void test_lane_cmds (void)
+{
+    sw_t lap[2];
+    uint8_t k;
+    
+    // start with an erased lane
+    __func_remote_cmd('3');
+    CHECK( lanes[0].state == SW_STATE_CLRD );
+    CHECK( lanes[0].measCnt == 0 );
+    
+    __func_remote_cmd('5');
+    CHECK( lanes[0].state == SW_STATE_RUN );
+    CHECK( laneRun & 1 );
+    
+    // a lap (INT2) 0.5s later
+    for(k=0; k<50; k++)
+    {
+        timer1_increase_ticks();
+    }
+    
+    timer1_get_timestamp((ts_t*)&lapTs);
+    __func_handle_lap();
+    
+    // erase, save and a restart are rejected while the lane runs
+    __func_remote_cmd('5');
+    CHECK( lanes[0].state == SW_STATE_RUN );
+    
+    __func_remote_cmd('3');
+    CHECK( lanes[0].state == SW_STATE_RUN );
+    
+    __func_remote_cmd('7');
+    CHECK( lanes[0].state == SW_STATE_RUN );
+    CHECK( lanes[0].measCnt == 0 );
+    CHECK( laneRun & 1 );
+    
+    // .. and accepted after the stop (0.1s after the lap)
+    for(k=0; k<10; k++)
+    {
+        timer1_increase_ticks();
+    }
+    
+    __func_remote_cmd('6');
+    CHECK( !(laneRun & 1) );
+    
+    __func_remote_cmd('7');
+    CHECK( lanes[0].state == SW_STATE_SAVED );
+    
+    // the lap is saved behind the measurement but isn't counted
+    eeprom_25LC256_read(LOG_PAGE_ADDR(0, logs[0].head) + LOG_HDR_SIZE,
+                        (uint8_t*)lap, sizeof(lap));
+    CHECK( __func_log_cnt(0) == 2 && logs[0].used == 2 );
+    CHECK( lap[0] == ((lap[1] - 100) | SW_LAP_FLAG) );
+    CHECK( lap[1] == lanes[0].sw );
+    CHECK( lanes[0].measCnt == 1 );
+    CHECK( __func_count_meas(0, logs[0].head) == 1 );
+}
+
+//..............................................................................
+
+/**
+ * This function counts the updates of the running time of lane 0 within one
+ * second (100 ticks, the main loop runs every tick).
+ */
+
+static uint8_t __test_updates (void)
+{
+    uint8_t k, cnt = 0;
+    sw_t last = lanes[0].sw;
+    
+    for(k=0; k<100; k++)
+    {
+        timer1_increase_ticks();
+        func_workload();
+        
+        if( lanes[0].sw != last )
+        {
+            last = lanes[0].sw;
+            cnt++;
+        }
+    }
+    
+    return cnt;
+}
+
+//..............................................................................
+
+static void test_refresh (void)
+{
+    __func_remote_cmd('3');
+    __func_remote_cmd('5');
+    CHECK( lanes[0].state == SW_STATE_RUN );
+    
+    // the default rate
+    CHECK( __test_updates() == DISP_RATE_DEF );
+    
+    // <R|50>, the rate is taken over by the running timer
+    remArgCnt = 1;
+    remArg[0] = 50;
+    __func_remote_cmd('R');
+    CHECK( dispPeriod == 2 );
+    CHECK( __test_updates() == 50 );
+    
+    // rates out of range are ignored, <R> only reads
+    remArg[0] = 0;
+    __func_remote_cmd('R');
+    remArg[0] = DISP_RATE_MAX + 1;
+    __func_remote_cmd('R');
+    remArgCnt = 0;
+    __func_remote_cmd('R');
+    CHECK( dispPeriod == 2 );
+    
+    // no updates once stopped
+    __func_remote_cmd('6');
+    CHECK( __test_updates() == 0 );
+    
+    remArgCnt = 1;
+    remArg[0] = DISP_RATE_DEF;
+    __func_remote_cmd('R');
+    remArgCnt = 0;
+}
+
+//..............................................................................
+
+static void test_uart (void)
+{
+    sim_uart_drain();
+    sim_clear_log();
+    
+    // the reply isn't sent by uart_print, the tx interrupt shifts it out in
+    // background (the uart is held until the reply was queued)
+    sim.txHold = true;
+    remArgCnt = 0;
+    __func_remote_cmd('R');
+    CHECK( PIE1bits.TX1IE );
+    CHECK( sim.txCnt == 0 );
+    
+    sim.txHold = false;
+    uart_flush(0);
+    CHECK( !PIE1bits.TX1IE );
+    CHECK( sim.txCnt == 6 && memcmp(sim.tx, "<R|25>", 6) == 0 );
+    
+    // the main loop lets it be shifted out before SLEEP
+    __func_remote_cmd('R');
+    func_workload();
+    CHECK( sim.txCnt == 12 );
+}
+
+//..............................................................................
+
+static void test_uart_errors (void)
+{
+    static char msg[101];
+    uint8_t i;
+    
+    // a message longer than the buffer waits for room and isn't cut
+    for(i=0; i<100; i++)
+    {
+        msg[i] = (char)('a' + i % 26);
+    }
+    
+    sim_uart_drain();
+    sim_clear_log();
+    uart_print(msg);
+    uart_flush(0);
+    CHECK( sim.txCnt == 100 && memcmp(sim.tx, msg, 100) == 0 );
+    
+    // the uart stalls: uart_try_print takes a message as a whole or drops it
+    sim.txHold = true;
+    msg[UART_TX_MAX - 2] = '\0';
+    CHECK( uart_try_print(msg) );
+    CHECK( !uart_try_print("<X>") );
+    CHECK( uart_try_print("<") );
+    sim.txHold = false;
+    uart_flush(0);
+    
+    // rx: an overrun restarts the receiver, a framing error drops the byte
+    RCSTAbits.CREN = 1;
+    RCSTAbits.OERR = 1;
+    uart_rx_isr();
+    CHECK( RCSTAbits.CREN );
+    RCSTAbits.OERR = 0;
+    
+    RCSTAbits.FERR = 1;
+    RCREG = 'x';
+    uart_rx_isr();
+    CHECK( inWr == inRd );
+    RCSTAbits.FERR = 0;
+    
+    // a full rx buffer doesn't overwrite unread bytes
+    for(i=0; i<UART_RX_MAX; i++)
+    {
+        RCREG = (uint8_t)('0' + i % 10);
+        uart_rx_isr();
+    }
+    
+    CHECK( (uint8_t)(inWr - inRd) % UART_RX_MAX == UART_RX_MAX - 1 );
+    inRd = inWr;
+    status.iRx = false;
+    
+    // <U|tx dropped|rx dropped|overrun|framing>
+    sim_clear_log();
+    __func_remote_cmd('U');
+    uart_flush(0);
+    CHECK( sim.txCnt == 11 && memcmp(sim.tx, "<U|3|1|1|1>", 11) == 0 );
+}
+
+//..............................................................................
+
+static void test_baud (void)
+{
+    uint32_t baud, real, t;
+    uint16_t brg, brgDef;
+    int16_t err;
+    
+    // every rate: the nearest generator value and its deviation
+    for(baud=UART_BAUD_MIN; baud<=UART_BAUD_MAX; baud++)
+    {
+        err = uart_calc_baud(baud, &brg);
+        real = (_XTAL_FREQ / 4) / (brg + 1UL);
+        
+        CHECK( err == (int16_t)(((int32_t)real - (int32_t)baud) * 10000 /
+                                (int32_t)baud) );
+        CHECK( labs((long)real - (long)baud) <=
+               labs((long)((_XTAL_FREQ / 4) / (brg + 2UL)) - (long)baud) );
+        CHECK( brg == 0 || labs((long)real - (long)baud) <=
+               labs((long)((_XTAL_FREQ / 4) / brg) - (long)baud) );
+    }
+    
+    CHECK( uart_calc_baud(57600, NULL) == 64 );
+    CHECK( uart_calc_baud(115200, NULL) == -79 );
+    CHECK( uart_calc_baud(250000, NULL) == 0 );
+    
+    (void)uart_calc_baud(UART_BAUD_DEF, &brgDef);
+    (void)uart_calc_baud(57600, &brg);
+    
+    // <S|57600>: the answer leaves completely at the old rate
+    uart_init();
+    sim_uart_drain();
+    sim_clear_log();
+    remArgCnt = 1;
+    remArg[0] = 57600;
+    __func_remote_cmd('S');
+    remArgCnt = 0;
+    
+    CHECK( sim.txCnt == 15 && memcmp(sim.tx, "<S|57600|00064>", 15) == 0 );
+    CHECK( sim.txBrg == brgDef );
+    CHECK( (SPBRGH << 8 | SPBRG) == brg );
+    
+    // not confirmed within 2s: the old rate is restored
+    (void)__test_updates();
+    (void)__test_updates();
+    (void)__test_updates();
+    CHECK( (SPBRGH << 8 | SPBRG) == brgDef );
+    CHECK( uart_get_baud() == UART_BAUD_DEF );
+    
+    // confirmed by any command
+    remArgCnt = 1;
+    __func_remote_cmd('S');
+    remArgCnt = 0;
+    __func_remote_cmd('0');
+    (void)__test_updates();
+    (void)__test_updates();
+    (void)__test_updates();
+    CHECK( uart_get_baud() == 57600 );
+    
+    // a stuck transmitter delays the switch by UART_FLUSH_TMO at most
+    sim.txHold = true;
+    sim.tickPoll = true;
+    uart_print("<0>");
+    t = timer1_get_ticks();
+    CHECK( uart_set_baud(UART_BAUD_DEF) );
+    t = timer1_get_ticks() - t;
+    CHECK( t * 10 >= UART_FLUSH_TMO && t * 10 <= UART_FLUSH_TMO + 20 );
+    CHECK( (SPBRGH << 8 | SPBRG) == brgDef );
+    
+    sim.txHold = false;
+    sim.tickPoll = false;
+    uart_flush(0);
+}
+
+//..............................................................................
+
+static void test_export (void)
+{
+    static char ref[SIM_TX_MAX];
+    sw_t rec[40];
+    uint16_t len, k;
+    uint8_t i, meas = 0;
+    
+    // 40 records (over three log pages), every 5th one a lap
+    __func_remote_cmd('3');
+    srand(4);
+    
+    for(i=0; i<40; i++)
+    {
+        rec[i] = (sw_t)rand() % SW_100_MIN;
+        
+        if( i % 5 == 4 )
+        {
+            rec[i] |= SW_LAP_FLAG;
+        }
+        else
+        {
+            meas++;
+        }
+    }
+    
+    __func_log_append(0, rec, 40);
+    lanes[0].measCnt = meas;
+    
+    // newest first, the header counts the measurements only
+    len = (uint16_t)sprintf(ref, "<4|%s", __func_uint16_to_dec(meas));
+    
+    for(i=40; i--; )
+    {
+        len += (uint16_t)sprintf(&ref[len], "|%s%s",
+                                 (rec[i] & SW_LAP_FLAG) ? "L" : "",
+                                 __func_time_to_str(&rec[i]));
+    }
+    
+    len += (uint16_t)sprintf(&ref[len], ">");
+    
+    // the main loop doesn't wait for a stuck uart
+    sim_uart_drain();
+    sim_clear_log();
+    sim.txHold = true;
+    __func_remote_cmd('4');
+    
+    for(k=0; k<100; k++)
+    {
+        func_workload();
+    }
+    
+    CHECK( expState != EXP_STATE_IDLE );
+    CHECK( sim.txCnt == 0 );
+    
+    // the export goes on as the uart takes the characters
+    sim.txHold = false;
+    
+    for(k=0; k<1000 && expState != EXP_STATE_IDLE; k++)
+    {
+        func_workload();
+        sim_spi_drain();
+        sim_uart_drain();
+    }
+    
+    CHECK( expState == EXP_STATE_IDLE );
+    CHECK( sim.txCnt == len && memcmp(sim.tx, ref, len) == 0 );
+}
+
+//..............................................................................
+
+/**
+ * This function runs the main loop until the export job is done (the bus and
+ * the uart are served in between).
+ */
+
+static void __test_export_run (void)
+{
+    uint16_t k;
+    
+    for(k=0; k<10000 && expState != EXP_STATE_IDLE; k++)
+    {
+        func_workload();
+        sim_spi_drain();
+        sim_uart_drain();
+    }
+    
+    CHECK( expState == EXP_STATE_IDLE );
+}
+
+//..............................................................................
+
+/**
+ * This function decodes the next frame sent by the uart (SLIP, crc checked).
+ * 
+ * @param pPos Position inside sim.tx (moved behind the frame).
+ * @param pF Decoded frame (type, seq, len + up to 255 data bytes).
+ * @return False if there is no complete, valid frame.
+ */
+
+static bool __test_frame (uint16_t *pPos, uint8_t *pF)
+{
+    uint16_t n = 0, crc = FRAME_CRC_INIT;
+    uint8_t c, i;
+    
+    // (the leading FRAME_END)
+    while( *pPos < sim.txCnt && (uint8_t)sim.tx[*pPos] == FRAME_END )
+    {
+        (*pPos)++;
+    }
+    
+    while( *pPos < sim.txCnt && (c = (uint8_t)sim.tx[(*pPos)++]) != FRAME_END )
+    {
+        if( c == FRAME_ESC )
+        {
+            c = ((uint8_t)sim.tx[(*pPos)++] == FRAME_ESC_END) ? FRAME_END :
+                                                               FRAME_ESC;
+        }
+        
+        pF[n++] = c;
+    }
+    
+    if( n < 5 || pF[2] != n - 5 )
+    {
+        return false;
+    }
+    
+    // CRC-16/CCITT
+    for(n=0; n<pF[2] + 3u; n++)
+    {
+        crc ^= (uint16_t)pF[n] << 8;
+        
+        for(i=0; i<8; i++)
+        {
+            crc = (crc & 0x8000) ? (uint16_t)(crc << 1) ^ FRAME_CRC_POLY :
+                                   (uint16_t)(crc << 1);
+        }
+    }
+    
+    return pF[n] == (uint8_t)crc && pF[n + 1] == (uint8_t)(crc >> 8);
+}
+
+//..............................................................................
+
+static void test_frames (void)
+{
+    static sw_t rec[150];
+    static uint8_t f[300];
+    uint16_t pos, idx, n, ascii;
+    uint8_t seq, meas = 0;
+    
+    // 150 records (three frames), every 5th one a lap
+    __func_remote_cmd('3');
+    srand(5);
+    
+    for(n=0; n<150; n++)
+    {
+        rec[n] = (sw_t)rand() % SW_100_MIN;
+        
+        if( n % 5 == 4 )
+        {
+            rec[n] |= SW_LAP_FLAG;
+        }
+        else
+        {
+            meas++;
+        }
+    }
+    
+    __func_log_append(0, rec, 150);
+    lanes[0].measCnt = meas;
+    
+    // the ascii export of the same records
+    sim_uart_drain();
+    sim_clear_log();
+    __func_remote_cmd('4');
+    __test_export_run();
+    ascii = sim.txCnt;
+    
+    // <P|1>
+    remArgCnt = 1;
+    remArg[0] = REM_MODE_BIN;
+    __func_remote_cmd('P');
+    remArgCnt = 0;
+    CHECK( remMode == REM_MODE_BIN );
+    
+    // export: the counts (measurements, records), the data frames (oldest
+    // first, laps keep their flag) and the empty one
+    sim_uart_drain();
+    sim_clear_log();
+    frameRx.type = FRAME_TYPE_EXPORT;
+    frameRx.seq = 7;
+    frameRx.len = 0;
+    __func_remote_frame();
+    __test_export_run();
+    
+    pos = 0;
+    CHECK( __test_frame(&pos, f) && f[0] == FRAME_TYPE_EXPORT && f[1] == 7 );
+    CHECK( f[2] == 4 && f[3] == meas && f[4] == 0 && f[5] == 150 && !f[6] );
+    
+    for(idx=0, seq=8; idx<=150; seq++)
+    {
+        n = (150 - idx > EXP_FRAME_RECS) ? EXP_FRAME_RECS : 150 - idx;
+        
+        CHECK( __test_frame(&pos, f) && f[0] == FRAME_TYPE_DATA );
+        CHECK( f[1] == seq && f[2] == 2 + n * SIZE_OF_SW );
+        CHECK( (f[3] | f[4] << 8) == idx );
+        CHECK( memcmp(&f[5], &rec[idx], n * SIZE_OF_SW) == 0 );
+        
+        idx += n ? n : 1;
+    }
+    
+    CHECK( pos == sim.txCnt );
+    
+    printf("export of 150 records (30 laps): ascii %u bytes, binary %u bytes "
+           "(%.2f : 1)\n", ascii, sim.txCnt, (double)ascii / sim.txCnt);
+    
+    // a range again: records 60..69
+    sim_clear_log();
+    frameRx.type = FRAME_TYPE_READ;
+    frameRx.seq = 20;
+    frameRx.len = 3;
+    frameRx.data[0] = 60;
+    frameRx.data[1] = 0;
+    frameRx.data[2] = 10;
+    __func_remote_frame();
+    __test_export_run();
+    
+    pos = 0;
+    CHECK( __test_frame(&pos, f) && f[0] == FRAME_TYPE_READ && f[5] == 150 );
+    CHECK( __test_frame(&pos, f) && f[1] == 21 && f[2] == 2 + 40 );
+    CHECK( f[3] == 60 && memcmp(&f[5], &rec[60], 40) == 0 );
+    CHECK( __test_frame(&pos, f) && f[2] == 2 && f[3] == 70 );
+    
+    // back to ascii
+    sim_clear_log();
+    frameRx.type = FRAME_TYPE_ASCII;
+    __func_remote_frame();
+    CHECK( remMode == REM_MODE_ASCII );
+    sim_uart_drain();
+}
+
+//..............................................................................
+
+/**
+ * This function passes bytes to the rx interrupt like the uart receives them.
+ * 
+ * @param pBuf Received bytes.
+ * @param len Number of bytes.
+ */
+
+static void __test_rx (const uint8_t *pBuf, uint8_t len)
+{
+    while(len--)
+    {
+        RCREG = *pBuf++;
+        uart_rx_isr();
+    }
+}
+
+//..............................................................................
+
+/**
+ * This function encodes a frame (SLIP, crc) and passes it to the rx interrupt.
+ * 
+ * @param type Frame type.
+ * @param seq Sequence number.
+ * @param pData Data bytes.
+ * @param len Number of data bytes.
+ * @return Number of bytes on the line.
+ */
+
+static uint8_t __test_rx_frame (uint8_t type, uint8_t seq, 
+                                const uint8_t *pData, uint8_t len)
+{
+    uint8_t raw[FRAME_DATA_MAX + 5];
+    uint8_t line[2 * sizeof(raw) + 2];
+    uint16_t crc = FRAME_CRC_INIT;
+    uint8_t i, k, n = 0;
+    
+    raw[0] = type;
+    raw[1] = seq;
+    raw[2] = len;
+    memcpy(&raw[3], pData, len);
+    
+    for(k=0; k<len + 3u; k++)
+    {
+        crc ^= (uint16_t)raw[k] << 8;
+        
+        for(i=0; i<8; i++)
+        {
+            crc = (crc & 0x8000) ? (uint16_t)(crc << 1) ^ FRAME_CRC_POLY :
+                                   (uint16_t)(crc << 1);
+        }
+    }
+    
+    raw[k++] = (uint8_t)crc;
+    raw[k++] = (uint8_t)(crc >> 8);
+    
+    line[n++] = FRAME_END;
+    
+    for(i=0; i<k; i++)
+    {
+        if( raw[i] == FRAME_END || raw[i] == FRAME_ESC )
+        {
+            line[n++] = FRAME_ESC;
+            line[n++] = (raw[i] == FRAME_END) ? FRAME_ESC_END : FRAME_ESC_ESC;
+        }
+        else
+        {
+            line[n++] = raw[i];
+        }
+    }
+    
+    line[n++] = FRAME_END;
+    __test_rx(line, n);
+    
+    return n;
+}
+
+//..............................................................................
+
+static void test_pipeline (void)
+{
+    static const char msgs[] = "<#7:0><#8:TL|25><2><#65535:RD|0|1>";
+    static const uint8_t full[FRAME_DATA_MAX] = { 0 };
+    uart_stat_t st0, st;
+    uint16_t pos;
+    uint8_t f[300];
+    uint8_t n;
+    
+    // several messages in a row, answered within one pass of the main loop
+    sim_uart_drain();
+    sim_clear_log();
+    uart_get_stat(&st0);
+    __test_rx((const uint8_t*)msgs, 16);
+    CHECK( status.iRx );
+    
+    sim.txHold = true;
+    func_workload();
+    CHECK( !status.iRx && inRd == inWr );
+    sim.txHold = false;
+    uart_flush(0);
+    CHECK( sim.txCnt == 16 && memcmp(sim.tx, "<#7:0><#8:TL|25>", 16) == 0 );
+    
+    // an id and two arguments, the answer of a range export is tagged too
+    sim_clear_log();
+    __test_rx((const uint8_t*)msgs + 16, sizeof(msgs) - 17);
+    func_workload();
+    __test_export_run();
+    CHECK( memcmp(sim.tx, "<2|", 3) == 0 );
+    
+    for(pos=0; pos<sim.txCnt && sim.tx[pos] != '>'; pos++);
+    
+    CHECK( memcmp(&sim.tx[pos + 1], "<#65535:4|", 10) == 0 );
+    
+    // a broken message doesn't swallow the next one
+    sim_clear_log();
+    __test_rx((const uint8_t*)"<#1:0|3<#2:0>", 13);
+    func_workload();
+    sim_uart_drain();
+    CHECK( sim.txCnt == 6 && memcmp(sim.tx, "<#2:0>", 6) == 0 );
+    
+    // binary: two frames of FRAME_DATA_MAX bytes fit into the rx-ringbuffer
+    // (the second one waits behind the export started by the first one)
+    remArgCnt = 1;
+    remArg[0] = REM_MODE_BIN;
+    __func_remote_cmd('P');
+    remArgCnt = 0;
+    sim_uart_drain();
+    sim_clear_log();
+    
+    n = __test_rx_frame(FRAME_TYPE_EXPORT, 30, full, FRAME_DATA_MAX);
+    n += __test_rx_frame(FRAME_TYPE_PING, 31, full, FRAME_DATA_MAX);
+    CHECK( n < UART_RX_MAX );
+    func_workload();
+    CHECK( expState != EXP_STATE_IDLE && status.iRx );
+    __test_export_run();
+    func_workload();
+    sim_uart_drain();
+    
+    pos = 0;
+    CHECK( __test_frame(&pos, f) && f[0] == FRAME_TYPE_EXPORT && f[1] == 30 );
+    
+    while( __test_frame(&pos, f) && f[0] == FRAME_TYPE_DATA );
+    
+    CHECK( f[0] == FRAME_TYPE_PING && f[1] == 31 );
+    
+    uart_get_stat(&st);
+    CHECK( st.rxDropped == st0.rxDropped );
+    
+    frameRx.type = FRAME_TYPE_ASCII;
+    __func_remote_frame();
+    CHECK( remMode == REM_MODE_ASCII );
+    sim_uart_drain();
+}
+
+//..............................................................................
+
+/**
+ * This function counts the telemetry messages of a type in the uart log.
+ * 
+ * @param type Message type (TELE_x).
+ * @return Number of messages.
+ */
+
+static uint16_t __test_tele_cnt (char type)
+{
+    uint16_t k, n = 0;
+    
+    for(k=0; k + 16 <= sim.txCnt; k++)
+    {
+        if( sim.tx[k] == '<' && sim.tx[k + 1] == type && sim.tx[k + 15] == '>' )
+        {
+            n++;
+        }
+    }
+    
+    return n;
+}
+
+//..............................................................................
+
+static void test_tele (void)
+{
+    ts_t ts;
+    uint8_t k;
+    
+    __func_remote_cmd('3');
+    sim_uart_drain();
+    sim_clear_log();
+    remHasId = false;
+    
+    // <TS|2>: the states and keys at once, then the time every 20ms
+    remArgCnt = 1;
+    remArg[0] = 2;
+    __func_remote_cmd(REM_OP2('T','S'));
+    remArgCnt = 0;
+    func_workload();
+    sim_uart_drain();
+    CHECK( memcmp(sim.tx, "<TS|2>", 6) == 0 );
+    CHECK( __test_tele_cnt(TELE_STATE) == MAX_LANES );
+    CHECK( memcmp(&sim.tx[6], "<s|0|000000000", 14) == 0 );
+    CHECK( sim.tx[20] == '0' + lanes[0].state );
+    CHECK( __test_tele_cnt(TELE_KEY) == 1 );
+    
+    sim_clear_log();
+    __func_remote_cmd('5');
+    
+    for(k=0; k<20; k++)
+    {
+        timer1_increase_ticks();
+        func_workload();
+        sim_uart_drain();
+    }
+    
+    CHECK( __test_tele_cnt(TELE_STATE) == 1 );
+    CHECK( __test_tele_cnt(TELE_TIME) == 10 );
+    
+    // the uart stalls: the main loop goes on, the time is skipped and the
+    // state change waits for room
+    sim_clear_log();
+    sim.txHold = true;
+    
+    for(k=0; k<20; k++)
+    {
+        timer1_increase_ticks();
+        func_workload();
+    }
+    
+    CHECK( uart_tx_free() < TELE_ROOM );
+    
+    timer1_get_timestamp(&ts);
+    __func_gate_stop(0, &ts);
+    func_workload();
+    
+    sim.txHold = false;
+    uart_flush(0);
+    CHECK( __test_tele_cnt(TELE_TIME) == 1 );
+    CHECK( __test_tele_cnt(TELE_STATE) == 0 );
+    
+    func_workload();
+    sim_uart_drain();
+    CHECK( __test_tele_cnt(TELE_STATE) == 1 );
+    CHECK( __test_tele_cnt(TELE_TIME) == 1 );
+    
+    // <TS|0> ends it, out of range periods are ignored
+    remArgCnt = 1;
+    remArg[0] = 1;
+    __func_remote_cmd(REM_OP2('T','S'));
+    CHECK( telePeriod == 2 );
+    remArg[0] = 0;
+    __func_remote_cmd(REM_OP2('T','S'));
+    remArgCnt = 0;
+    CHECK( telePeriod == 0 );
+    sim_uart_drain();
+}
+
+//*** main *********************************************************************
+
+int main (void)
+{
+    sim_reset();
+    
+    // the software timers of the stop watch (like main() does)
+    func_init();
+    
+    test_stall();
+    test_calibrate();
+    test_lane_cmds();
+    test_refresh();
+    test_uart();
+    test_uart_errors();
+    test_baud();
+    test_export();
+    test_frames();
+    test_pipeline();
+    test_tele();
+    
+    return test_done("test_func");
+}
@@ -0,0 +1,227 @@
+/*******************************************************************************
+ *
+ * File:        test_lcd.c
+ * Project:     PICLCD-Stopwatch
+ * Author:      Nicolas Pannwitz (https://pic-projekte.de/)
+ * Comment:     Host test of the lcd driver (lcd.c)
+ * Licence:     Copyrightn (C) 2018 Nicolas Pannwitz
+ *
+ *              This program is free software: You can redistribute it and/or
+ *              modify it under the terms of the GNU General Public License as
+ *              published by the Free Software Foundation, either version 3 of
+ *              the License, or (at your option) any later version.
+ *
+ *              This program is distributed in the hope that it will be useful,
+ *              but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *              MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *              GNU General Public License for more details.
+ *
+ *              You should have received a copy of the GNU General Public
+ *              License along with this program.
+ *              If not, see https://www.gnu.org/licenses/
+ *
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+#include "sim.h"
+
+// the module under test (its static variables are checked, too)
+#include "../source/lcd.c"
+
+//*** define *******************************************************************
+
+// display refresh rate while running (every tick) [Hz] and bytes of a full
+// redraw (the DDRAM address and all characters) like lcd_write sent it before
+#define REFRESH_HZ      100
+#define REDRAW_BYTES    (2 + LCD_CHARS)
+
+// spi clock FOSC/64 [bytes/s]
+#define SPI_BYTES_S     (_XTAL_FREQ / 64 / 8)
+
+//*** static functions *********************************************************
+
+/**
+ * This function lets the queued spi jobs and their callbacks run until the
+ * bus is idle.
+ */
+
+static void __test_idle (void)
+{
+    do
+    {
+        sim_spi_drain();
+        spi_dispatch();
+    }
+    while( status.iSpi || PIE1bits.SSPIE );
+}
+
+//..............................................................................
+
+static void test_init (void)
+{
+    uint16_t i, n = 0;
+    
+    sim_clear_log();
+    lcd_init();
+    
+    // the init sequence is sent as instructions, the display is blank
+    for(i=0; i<sim.logCnt; i++)
+    {
+        n += (sim.log[i].dev == SIM_DEV_LCD && sim.log[i].rs == 0);
+    }
+    
+    CHECK( n == 9 && sim.logCnt == 9 );
+    CHECK( memcmp(sim.ddram, "        ", LCD_CHARS) == 0 );
+    CHECK( memcmp(shadow, "        ", LCD_CHARS) == 0 );
+    CHECK( LATCbits.LC0 );
+}
+
+//..............................................................................
+
+static void test_random (void)
+{
+    char ref[LCD_CHARS + 1], str[LCD_CHARS + 4];
+    uint32_t n;
+    uint8_t addr, len, i;
+    
+    memset(ref, ' ', LCD_CHARS);
+    srand(3);
+    
+    // the bus runs only where the test says so
+    sim.pollBytes = 0;
+    
+    for(n=0; n<200000UL; n++)
+    {
+        // a string of a few characters (also beyond the visible ones)
+        addr = (uint8_t)(rand() % (LCD_CHARS + 2));
+        len = (uint8_t)(1 + rand() % (LCD_CHARS + 2));
+        
+        for(i=0; i<len; i++)
+        {
+            str[i] = "0123 :."[rand() % 7];
+            
+            if( addr + i < LCD_CHARS )
+            {
+                ref[addr + i] = str[i];
+            }
+        }
+        
+        str[len] = '\0';
+        lcd_write(str, addr);
+        
+        // the bus gets a few bytes only (the next write may change the 
+        // characters of a span which is on the way)
+        sim_spi_run((uint32_t)(rand() % 6));
+        
+        if( rand() % 4 == 0 )
+        {
+            spi_dispatch();
+        }
+        
+        if( rand() % 64 == 0 )
+        {
+            __test_idle();
+            CHECK( memcmp(sim.ddram, ref, LCD_CHARS) == 0 );
+        }
+    }
+    
+    sim.pollBytes = 1;
+    __test_idle();
+    
+    CHECK( memcmp(sim.ddram, ref, LCD_CHARS) == 0 );
+    CHECK( memcmp(shadow, ref, LCD_CHARS) == 0 );
+    CHECK( dirtyFirst == 0xFF );
+}
+
+//..............................................................................
+
+static void test_run (void)
+{
+    char str[16];
+    uint32_t ms, frames = 0, before = 0;
+    
+    // ten minutes of the running time (M:SS.mmm), refreshed every tick
+    __test_idle();
+    sim_clear_log();
+    
+    for(ms=0; ms<600000UL; ms+=1000/REFRESH_HZ)
+    {
+        snprintf(str, sizeof(str), "%lu:%02lu.%03lu", 
+                 (unsigned long)(ms / 60000), 
+                 (unsigned long)(ms / 1000) % 60, 
+                 (unsigned long)ms % 1000);
+        lcd_write(str, 0);
+        __test_idle();
+        frames++;
+        before += 2 + strlen(str);
+        
+        CHECK( memcmp(sim.ddram, str, LCD_CHARS) == 0 );
+    }
+    
+    printf("lcd bytes per second of RUN: %lu before, %lu after "
+           "(bus busy %.1f%% / %.1f%%)\n",
+           (unsigned long)(before * REFRESH_HZ / frames),
+           (unsigned long)(sim.bytes[SIM_DEV_LCD] * REFRESH_HZ / frames),
+           100.0 * before * REFRESH_HZ / frames / SPI_BYTES_S,
+           100.0 * sim.bytes[SIM_DEV_LCD] * REFRESH_HZ / frames / SPI_BYTES_S);
+    
+    // mostly the hundredths and the tenths change: at most the DDRAM address
+    // and a span of 3 characters per refresh on average
+    CHECK( before == frames * REDRAW_BYTES );
+    CHECK( sim.bytes[SIM_DEV_LCD] <= frames * (2 + 3) );
+    CHECK( sim.bytes[SIM_DEV_LCD] * 2 < before );
+    
+    // nothing changed: nothing is sent
+    sim_clear_log();
+    lcd_write(str, 0);
+    __test_idle();
+    
+    CHECK( sim.bytes[SIM_DEV_LCD] == 0 );
+}
+
+//..............................................................................
+
+static void test_off (void)
+{
+    uint16_t i;
+    
+    // a span is on the bus (the DDRAM address and a character sent), lcd_off
+    // has to wait for it
+    sim_clear_log();
+    sim.pollBytes = 0;
+    lcd_write("--:--.--", 0);
+    sim_spi_run(3);
+    sim.pollBytes = 1;
+    lcd_off();
+    
+    // the characters went out as data, the display off as instruction
+    CHECK( sim.logCnt == 2 + LCD_CHARS + 1 );
+    CHECK( sim.log[sim.logCnt - 1].rs == 0 );
+    CHECK( sim.log[sim.logCnt - 1].val == 0b00001000 );
+    
+    for(i=2; i<2+LCD_CHARS; i++)
+    {
+        CHECK( sim.log[i].rs == 1 );
+    }
+    
+    CHECK( memcmp(sim.ddram, "--:--.--", LCD_CHARS) == 0 );
+}
+
+//*** main *********************************************************************
+
+int main (void)
+{
+    sim_reset();
+    spi_init();
+    
+    test_init();
+    test_random();
+    test_run();
+    test_off();
+    
+    return test_done("test_lcd");
+}
@@ -0,0 +1,429 @@
+/*******************************************************************************
+ *
+ * File:        test_log.c
+ * Project:     PICLCD-Stopwatch
+ * Author:      Nicolas Pannwitz (https://pic-projekte.de/)
+ * Comment:     Host test of the measurement log (wear, reboot, power loss)
+ * Licence:     Copyrightn (C) 2018 Nicolas Pannwitz
+ *
+ *              This program is free software: You can redistribute it and/or
+ *              modify it under the terms of the GNU General Public License as
+ *              published by the Free Software Foundation, either version 3 of
+ *              the License, or (at your option) any later version.
+ *
+ *              This program is distributed in the hope that it will be useful,
+ *              but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *              MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *              GNU General Public License for more details.
+ *
+ *              You should have received a copy of the GNU General Public
+ *              License along with this program.
+ *              If not, see https://www.gnu.org/licenses/
+ *
+ ******************************************************************************/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "test.h"
+#include "sim.h"
+
+// the module under test (its static functions and variables are used)
+#include "../source/func.c"
+
+//*** define *******************************************************************
+
+// saved runs of the wear test and the power loss trials
+#define SAVES           1000000UL
+#define TRIALS          600
+#define TRIAL_OPS       40
+
+// measurements of a full ring (the oldest page is erased when it's reused)
+#define RING_MIN        ((LOG_PAGES - 1) * LOG_SLOTS)
+
+//*** typedef ******************************************************************
+
+// what a lane's log should hold: all measurements since it was cleared and
+// the record
+typedef struct model_s
+{
+    sw_t *pVal;
+    uint32_t cnt;
+    sw_t rec;
+
+} model_t;
+
+//*** static variables *********************************************************
+
+static model_t model[MAX_LANES];
+
+// runs done by a process that lost its power (shared with the parent)
+static volatile uint32_t *pRunsDone;
+
+//*** static functions *********************************************************
+
+/**
+ * This function appends a value to the model of a lane.
+ */
+
+static void __test_model_add (uint8_t ln, sw_t v)
+{
+    model[ln].pVal = realloc(model[ln].pVal, 
+                             (model[ln].cnt + 1) * sizeof(sw_t));
+    model[ln].pVal[model[ln].cnt++] = v;
+}
+
+//..............................................................................
+
+/**
+ * This function takes a measurement like the stop watch does (the record is
+ * updated and saved, otherwise the measurement is saved) or a lap, the buffer
+ * is flushed (the lane stops). Exactly one value is appended to the log.
+ */
+
+static void __test_run (uint8_t ln, sw_t v, bool lap)
+{
+    if( lap )
+    {
+        v |= SW_LAP_FLAG;
+        __func_log_append(ln, &v, 1);
+    }
+    else
+    {
+        lanes[ln].sw = v;
+        
+        if( !__func_is_new_record(ln) )
+        {
+            __func_save(ln);
+        }
+    }
+    
+    eeprom_25LC256_flush();
+}
+
+//..............................................................................
+
+/**
+ * This function updates the model like __test_run does with the log.
+ */
+
+static void __test_model_run (uint8_t ln, sw_t v, bool lap)
+{
+    if( lap )
+    {
+        v |= SW_LAP_FLAG;
+    }
+    else if( model[ln].rec == SW_EMPTY || v < model[ln].rec )
+    {
+        model[ln].rec = v;
+    }
+    
+    __test_model_add(ln, v);
+}
+
+//..............................................................................
+
+/**
+ * This function returns a random measurement (the saved runs only sometimes
+ * set a new record) and whether it's a lap.
+ */
+
+static sw_t __test_value (bool *pLap)
+{
+    *pLap = (rand() % 10 == 0);
+    
+    return 5000 + ((uint32_t)rand() % 600000UL);
+}
+
+//..............................................................................
+
+/**
+ * This function reads the measurements of a lane's log (oldest first) right
+ * out of the 25LC256 (nothing may be buffered).
+ * 
+ * @return Number of measurements.
+ */
+
+static uint16_t __test_read (uint8_t ln, sw_t *pVal)
+{
+    log_t *pLog = &logs[ln];
+    uint16_t cnt = __func_log_cnt(ln);
+    uint16_t tail = (pLog->head + LOG_PAGES + 1 - pLog->pages) % LOG_PAGES;
+    uint16_t i, addr;
+    
+    for(i=0; i<cnt; i++)
+    {
+        addr = LOG_PAGE_ADDR(ln, (tail + i / LOG_SLOTS) % LOG_PAGES) + 
+               LOG_HDR_SIZE + (i % LOG_SLOTS) * SIZE_OF_SW;
+        memcpy(&pVal[i], &sim.ee[addr], SIZE_OF_SW);
+    }
+    
+    return cnt;
+}
+
+//..............................................................................
+
+/**
+ * This function checks the log of a lane against its model: the newest 
+ * measurements of the model (all of them unless the ring is full), the 
+ * record and the number of measurements (laps not counted).
+ */
+
+static void __test_check (uint8_t ln)
+{
+    static sw_t val[LOG_PAGES * LOG_SLOTS];
+    uint16_t cnt = __test_read(ln, val);
+    uint16_t i, meas = 0;
+    
+    CHECK( cnt <= model[ln].cnt && 
+           cnt >= ((model[ln].cnt < RING_MIN) ? model[ln].cnt : RING_MIN) );
+    CHECK( memcmp(val, model[ln].pVal + model[ln].cnt - cnt, 
+                  cnt * sizeof(sw_t)) == 0 );
+    CHECK( logs[ln].rec == model[ln].rec );
+    
+    for(i=0; i<cnt; i++)
+    {
+        if( !(val[i] & SW_LAP_FLAG) )
+        {
+            meas++;
+        }
+    }
+    
+    CHECK( lanes[ln].measCnt == meas );
+}
+
+//..............................................................................
+
+/**
+ * This function rebuilds the logs like on boot and checks that nothing was
+ * lost (the RAM state before and after matches).
+ */
+
+static void __test_reboot (void)
+{
+    log_t before[MAX_LANES];
+    uint16_t measCnt;
+    uint8_t ln;
+    
+    memcpy(before, logs, sizeof(logs));
+    memset(logs, 0x5A, sizeof(logs));
+    
+    for(ln=0; ln<MAX_LANES; ln++)
+    {
+        measCnt = lanes[ln].measCnt;
+        lanes[ln].measCnt = 0x5A5A;
+        __func_log_scan(ln);
+        
+        CHECK( logs[ln].seq == before[ln].seq && 
+               logs[ln].pages == before[ln].pages &&
+               logs[ln].head == before[ln].head &&
+               logs[ln].used == before[ln].used &&
+               logs[ln].rec == before[ln].rec &&
+               lanes[ln].measCnt == measCnt );
+        
+        __test_check(ln);
+    }
+}
+
+//..............................................................................
+
+static void test_wear (void)
+{
+    uint32_t n, i, max = 0, passes;
+    uint8_t ln;
+    bool lap;
+    sw_t v;
+    
+    srand(9);
+    
+    for(ln=0; ln<MAX_LANES; ln++)
+    {
+        __func_log_scan(ln);
+        
+        CHECK( logs[ln].pages == 0 && __func_log_cnt(ln) == 0 &&
+               logs[ln].rec == SW_EMPTY && lanes[ln].measCnt == 0 );
+        
+        model[ln].rec = SW_EMPTY;
+    }
+    
+    // saved runs, most of them on lane 0 (its ring is passed ~300 times and
+    // the sequence numbers wrap around twice)
+    for(n=0; n<SAVES; n++)
+    {
+        ln = (rand() % 8 == 0) ? 1 : 0;
+        v = __test_value(&lap);
+        
+        __test_run(ln, v, lap);
+        __test_model_run(ln, v, lap);
+        
+        // lane 1 is cleared once
+        if( n == SAVES / 2 )
+        {
+            __func_clear_eeprom(1);
+            model[1].cnt = 0;
+            model[1].rec = SW_EMPTY;
+            eeprom_25LC256_flush();
+        }
+        
+        if( n % 997 == 0 )
+        {
+            __test_reboot();
+        }
+    }
+    
+    __test_reboot();
+    
+    // no cell is written per save: every cell of the ring once per pass for 
+    // the erase and once for the data
+    for(i=0; i<SIM_EE_SIZE; i++)
+    {
+        if( sim.eeWrites[i] > max )
+        {
+            max = sim.eeWrites[i];
+        }
+    }
+    
+    printf("%lu saved runs (%lu on lane 0): %lu write cycles, max. %lu writes "
+           "of a cell (old layout: %lu)\n", SAVES, (unsigned long)model[0].cnt,
+           (unsigned long)sim.eeCycles, (unsigned long)max, SAVES);
+    
+    passes = model[0].cnt / (LOG_PAGES * LOG_SLOTS) + 1;
+    
+    CHECK( max <= 2 * passes );
+    CHECK( sim.eeCycles < SAVES + SAVES / LOG_SLOTS + SAVES / 10 );
+}
+
+//..............................................................................
+
+static void test_power_loss (void)
+{
+    static sw_t val[LOG_PAGES * LOG_SLOTS];
+    uint32_t t, k, seed, lost = 0, found = 0;
+    uint16_t cnt, j;
+    uint8_t ln, b;
+    sw_t v, got;
+    bool lap;
+    int st;
+    pid_t pid;
+    
+    pRunsDone = mmap(NULL, sizeof(uint32_t), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    
+    for(t=0; t<TRIALS; t++)
+    {
+        ln = (uint8_t)(t % MAX_LANES);
+        seed = 100 + t;
+        *pRunsDone = 0;
+        
+        // the power is lost within one of the next write cycles: a part of
+        // the bytes (maybe all of them) is written
+        srand(seed);
+        sim.eeFailAt = sim.eeCycles + 1 + (uint32_t)(rand() % TRIAL_OPS);
+        sim.eeFailKeep = (uint8_t)(rand() % (SIM_EE_PAGE + 1));
+        
+        fflush(stdout);
+        pid = fork();
+        
+        if( pid == 0 )
+        {
+            for(k=0; k<TRIAL_OPS; k++)
+            {
+                v = __test_value(&lap);
+                __test_run(ln, v, lap);
+                *pRunsDone = k + 1;
+            }
+            
+            _exit(0);
+        }
+        
+        waitpid(pid, &st, 0);
+        sim.eeFailAt = 0;
+        
+        CHECK( WIFEXITED(st) && (WEXITSTATUS(st) == SIM_EXIT_POWER_LOSS ||
+                                 WEXITSTATUS(st) == 0) );
+        
+        lost += (WEXITSTATUS(st) == SIM_EXIT_POWER_LOSS);
+        
+        // the model gets the runs which were done (the same values)
+        srand(seed);
+        (void)rand();
+        (void)rand();
+        
+        for(k=0; k<*pRunsDone; k++)
+        {
+            v = __test_value(&lap);
+            __test_model_run(ln, v, lap);
+        }
+        
+        // reboot: the log ends with the runs which were done, maybe followed 
+        // by the interrupted one (it may be incomplete: each byte is the one
+        // of the measurement or still erased)
+        __func_log_scan(ln);
+        cnt = __test_read(ln, val);
+        
+        if( *pRunsDone < TRIAL_OPS )
+        {
+            v = __test_value(&lap);
+            
+            if( lap )
+            {
+                v |= SW_LAP_FLAG;
+            }
+            
+            if( cnt && (cnt > model[ln].cnt || 
+                        val[cnt - 1] != model[ln].pVal[model[ln].cnt - 1]) )
+            {
+                got = val[cnt - 1];
+                found++;
+                
+                for(b=0; b<SIZE_OF_SW; b++)
+                {
+                    j = (uint8_t)(got >> (8 * b));
+                    
+                    CHECK( j == 0xFF || j == (uint8_t)(v >> (8 * b)) );
+                }
+                
+                // an incomplete one is never taken as record
+                CHECK( got == v || (got & SW_LAP_FLAG) );
+                
+                __test_model_run(ln, got, (got & SW_LAP_FLAG) != 0);
+            }
+        }
+        
+        // (a new record is lost if the run is incomplete)
+        __test_check(ln);
+        
+        // the log goes on after the reboot
+        srand(seed + 1000);
+        
+        for(k=0; k<3; k++)
+        {
+            v = __test_value(&lap);
+            __test_run(ln, v, lap);
+            __test_model_run(ln, v, lap);
+        }
+        
+        __test_reboot();
+    }
+    
+    printf("%u trials: %lu power losses, %lu interrupted runs found in the "
+           "log\n", TRIALS, (unsigned long)lost, (unsigned long)found);
+    
+    CHECK( lost > TRIALS / 2 && found > 0 );
+}
+
+//*** main *********************************************************************
+
+int main (void)
+{
+    sim_reset();
+    spi_init();
+    
+    test_wear();
+    test_power_loss();
+    
+    return test_done("test_log");
+}
@@ -0,0 +1,583 @@
+/*******************************************************************************
+ *
+ * File:        test_spi.c
+ * Project:     PICLCD-Stopwatch
+ * Author:      Nicolas Pannwitz (https://pic-projekte.de/)
+ * Comment:     Host test of the spi driver (spi.c)
+ * Licence:     Copyrightn (C) 2018 Nicolas Pannwitz
+ *
+ *              This program is free software: You can redistribute it and/or
+ *              modify it under the terms of the GNU General Public License as
+ *              published by the Free Software Foundation, either version 3 of
+ *              the License, or (at your option) any later version.
+ *
+ *              This program is distributed in the hope that it will be useful,
+ *              but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *              MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *              GNU General Public License for more details.
+ *
+ *              You should have received a copy of the GNU General Public
+ *              License along with this program.
+ *              If not, see https://www.gnu.org/licenses/
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x86intrin.h>
+#include "test.h"
+#include "sim.h"
+
+// the module under test (its static variables are checked, too)
+#include "../source/spi.c"
+
+//*** define *******************************************************************
+
+// clock profile of the baseline (both devices at FOSC/64)
+#define SSPCON1_BASE    0b00110010
+
+// bursts of the cycle benchmark and their length
+#define BENCH_CNT       20000UL
+#define BENCH_LEN       64
+
+//*** static variables *********************************************************
+
+// completion callbacks so far
+static uint32_t doneCnt;
+
+//*** static functions *********************************************************
+
+static void __test_done (void)
+{
+    doneCnt++;
+}
+
+//..............................................................................
+
+/**
+ * This function is the polled transfer as it was before the burst kernels
+ * (the mode is decided per byte, a call per byte), kept as reference of the
+ * cycle benchmark.
+ */
+
+static uint8_t __test_rxtx_before (uint8_t val)
+{
+    SSPBUF = val;
+    while( !SSPSTATbits.BF );
+
+    return SSPBUF;
+}
+
+static void __test_transfer_before (uint8_t* pWr, uint8_t* pRd, uint8_t len)
+{
+    uint8_t i, dummy = 0;
+    
+    if(pWr == NULL && pRd == NULL)
+    {
+        return;
+    }
+    
+    for(i=0; i<len; i++)
+    {
+        if(pWr && pRd)
+        {
+            pRd[i] = __test_rxtx_before( pWr[i] );
+        }
+        else if(pWr == NULL)
+        {
+            pRd[i] = __test_rxtx_before(dummy);
+        }
+        else
+        {
+            __test_rxtx_before( pWr[i] );
+        }
+    }
+    
+    PIR1bits.SSPIF = 0;
+    busyTime[spiCur] += (uint16_t)len * spiDev[spiCur].usPerByte;
+}
+
+//..............................................................................
+
+/**
+ * This function measures the host cycles per byte of a polled transfer (the
+ * fastest of BENCH_CNT bursts).
+ *
+ * @param before Use the transfer as it was before the burst kernels.
+ * @param pWr Pointer to the write buffer.
+ * @param pRd Pointer to the read buffer.
+ * @return Cycles per byte.
+ */
+
+static double __test_cycles (bool before, uint8_t *pWr, uint8_t *pRd)
+{
+    uint64_t t, best = UINT64_MAX;
+    uint32_t n;
+    
+    for(n=0; n<BENCH_CNT; n++)
+    {
+        t = __rdtsc();
+        
+        if( before )
+        {
+            __test_transfer_before(pWr, pRd, BENCH_LEN);
+        }
+        else
+        {
+            spi_transfer(pWr, pRd, BENCH_LEN);
+        }
+        
+        t = __rdtsc() - t;
+        
+        if( t < best )
+        {
+            best = t;
+        }
+    }
+    
+    return (double)best / BENCH_LEN;
+}
+
+//..............................................................................
+
+/**
+ * This function returns the time a byte takes on the bus.
+ *
+ * @param sspcon1 Clock profile (SSPM: FOSC/4, FOSC/16 or FOSC/64).
+ * @return Time [ns].
+ */
+
+static uint32_t __test_byte_ns (uint8_t sspcon1)
+{
+    static const uint8_t div[3] = { 4, 16, 64 };
+
+    return 8UL * div[sspcon1 & 0x03] * 1000UL / (_XTAL_FREQ / 1000000UL);
+}
+
+//..............................................................................
+
+/**
+ * This function prints the bus time of the operation in the log: with the
+ * profiles used and with the baseline profile.
+ *
+ * @param pName Operation.
+ */
+
+static void __test_bus_time (const char *pName)
+{
+    uint32_t before = 0, after = 0;
+    uint16_t i;
+
+    for(i=0; i<sim.logCnt; i++)
+    {
+        after += __test_byte_ns(sim.log[i].sspcon1);
+        before += __test_byte_ns(SSPCON1_BASE);
+    }
+
+    printf("bus time of %s (%u bytes): %lu us before, %lu us after\n", pName,
+           sim.logCnt, (unsigned long)(before / 1000),
+           (unsigned long)(after / 1000));
+}
+
+//..............................................................................
+
+static void test_profile (void)
+{
+    uint8_t buf[4] = { 0x11, 0x22, 0x33, 0x44 };
+    uint16_t i;
+
+    spi_init();
+    sim_clear_log();
+
+    CHECK( SSPCON1 == spiDev[SPI_DEV_LCD].sspcon1 && spiCur == SPI_DEV_LCD );
+
+    // polled: each device with its own profile
+    spi_select(SPI_DEV_EEPROM);
+    spi_transfer(buf, NULL, 2);
+    spi_deselect(SPI_DEV_EEPROM);
+
+    spi_select(SPI_DEV_LCD);
+    spi_transfer(buf, NULL, 3);
+    spi_deselect(SPI_DEV_LCD);
+
+    spi_select(SPI_DEV_EEPROM);
+    spi_transfer(buf, NULL, 1);
+    spi_deselect(SPI_DEV_EEPROM);
+
+    CHECK( sim.logCnt == 6 );
+
+    for(i=0; i<sim.logCnt; i++)
+    {
+        CHECK( sim.log[i].dev >= 0 &&
+               sim.log[i].sspcon1 == spiDev[sim.log[i].dev].sspcon1 &&
+               sim.log[i].sspstat == spiDev[sim.log[i].dev].sspstat );
+    }
+
+    CHECK( sim.frames[SIM_DEV_EEPROM] == 2 && sim.frames[SIM_DEV_LCD] == 1 );
+    CHECK( (LATC & (LCD_CS_MASK | EEPROM_CS_MASK)) ==
+           (LCD_CS_MASK | EEPROM_CS_MASK) );
+}
+
+//..............................................................................
+
+static void test_queue (void)
+{
+    static uint8_t lcd[3] = { 0x01, 0x02, 0x03 };
+    static uint8_t ee[2] = { 0x04, 0x05 };
+    spi_job_t lcdJob = { .dev = SPI_DEV_LCD, .rs = SPI_RS_DATA, .len = 3,
+                         .pWr = lcd };
+    spi_job_t eeJob = { .dev = SPI_DEV_EEPROM, .len = 2, .pWr = ee };
+    uint16_t i;
+
+    sim.pollBytes = 0;
+    sim_clear_log();
+
+    // queued jobs switch the profile when they start (also in between)
+    spi_queue(&eeJob);
+    spi_queue(&lcdJob);
+    sim_spi_drain();
+    spi_queue(&eeJob);
+    sim_spi_drain();
+
+    CHECK( sim.logCnt == 7 );
+
+    for(i=0; i<sim.logCnt; i++)
+    {
+        CHECK( sim.log[i].dev == (i < 2 || i > 4 ? SIM_DEV_EEPROM :
+                                                   SIM_DEV_LCD) );
+        CHECK( sim.log[i].dev >= 0 &&
+               sim.log[i].sspcon1 == spiDev[sim.log[i].dev].sspcon1 );
+    }
+
+    CHECK( !lcdJob.busy && !eeJob.busy && pHead == NULL );
+
+    sim.pollBytes = 1;
+}
+
+//..............................................................................
+
+static void test_hold (void)
+{
+    static uint8_t cmd[3] = { 0x01, 0x01, 0x01 };
+    static uint8_t data[4];
+    static uint8_t lcd[2] = { 0x02, 0x02 };
+    static uint8_t ee[1] = { 0x03 };
+    spi_job_t cmdJob = { .dev = SPI_DEV_EEPROM, .hold = 1, .len = 3, 
+                         .pWr = cmd };
+    spi_job_t dataJob = { .dev = SPI_DEV_EEPROM, .len = 4, .pRd = data, 
+                          .cb = __test_done };
+    spi_job_t eeJob = { .dev = SPI_DEV_EEPROM, .len = 1, .pWr = ee };
+    spi_job_t lcdJob = { .dev = SPI_DEV_LCD, .rs = SPI_RS_DATA, .len = 2,
+                         .pWr = lcd };
+    static const uint8_t expect[] = { 1, 1, 1, 0, 0, 0, 0, 2, 2, 3 };
+    uint8_t i;
+    
+    sim.pollBytes = 0;
+    sim_clear_log();
+    doneCnt = 0;
+    (void)spi_get_busy_time(SPI_DEV_LCD);
+    (void)spi_get_busy_time(SPI_DEV_EEPROM);
+    
+    // a read (instruction + data) and a write are queued, the lcd job comes
+    // while the instruction of the read is on the bus
+    spi_queue(&cmdJob);
+    spi_queue(&dataJob);
+    spi_queue(&eeJob);
+    sim_spi_run(1);
+    spi_queue(&lcdJob);
+    sim_spi_drain();
+    spi_dispatch();
+    
+    // the lcd job goes ahead of the write but not into the read
+    CHECK( sim.logCnt == sizeof(expect) );
+    
+    for(i=0; i<sizeof(expect) && i<sim.logCnt; i++)
+    {
+        CHECK( sim.log[i].val == expect[i] );
+    }
+    
+    // the read is a single frame of the 25LC256
+    CHECK( sim.frames[SIM_DEV_EEPROM] == 2 && sim.frames[SIM_DEV_LCD] == 1 );
+    CHECK( !cmdJob.busy && !dataJob.busy && !eeJob.busy && !lcdJob.busy );
+    CHECK( doneCnt == 1 && data[0] == 0xFF && data[3] == 0xFF );
+    CHECK( pHead == NULL && pDone == NULL && PIE1bits.SSPIE == 0 );
+    CHECK( (LATC & (LCD_CS_MASK | EEPROM_CS_MASK)) == 
+           (LCD_CS_MASK | EEPROM_CS_MASK) );
+    
+    // the bus time of both devices
+    CHECK( spi_get_busy_time(SPI_DEV_LCD) == 2 * 32 );
+    CHECK( spi_get_busy_time(SPI_DEV_EEPROM) == 8 * 2 );
+    CHECK( spi_get_busy_time(SPI_DEV_LCD) == 0 );
+    
+    sim.pollBytes = 1;
+}
+
+//..............................................................................
+
+static void test_chunks (void)
+{
+    static uint8_t lcd[2] = { 0x02, 0x02 };
+    spi_job_t lcdJob = { .dev = SPI_DEV_LCD, .rs = SPI_RS_DATA, .len = 2,
+                         .pWr = lcd };
+    uint8_t buf[100];
+    uint16_t i, lcdAt = 0;
+    
+    for(i=0; i<sizeof(buf); i++)
+    {
+        sim.ee[0x1234 + i] = (uint8_t)i;
+    }
+    
+    sim.pollBytes = 0;
+    sim_clear_log();
+    doneCnt = 0;
+    
+    // an lcd job comes while the first chunk is on the bus
+    eeprom_25LC256_read_async(0x1234, buf, sizeof(buf), __test_done);
+    sim_spi_run(5);
+    spi_queue(&lcdJob);
+    
+    while( eeprom_25LC256_read_busy() )
+    {
+        sim_spi_drain();
+        spi_dispatch();
+    }
+    
+    CHECK( doneCnt == 1 && pHead == NULL );
+    
+    for(i=0; i<sizeof(buf); i++)
+    {
+        CHECK( buf[i] == (uint8_t)i );
+    }
+    
+    // a READ per chunk, the lcd gets the bus after the first one
+    CHECK( sim.frames[SIM_DEV_EEPROM] == 
+           (sizeof(buf) + EEPROM_CHUNK - 1) / EEPROM_CHUNK );
+    
+    for(i=0; i<sim.logCnt; i++)
+    {
+        if( sim.log[i].dev == SIM_DEV_LCD && !lcdAt )
+        {
+            lcdAt = i;
+        }
+    }
+    
+    CHECK( lcdAt == 3 + EEPROM_CHUNK );
+    
+    sim.pollBytes = 1;
+}
+
+//..............................................................................
+
+static void test_burst (void)
+{
+    uint8_t cmd[3], data[64], rd[64], buf[2];
+    uint16_t addr, i;
+    uint8_t n, k;
+    
+    srand(5);
+    
+    for(k=0; k<200; k++)
+    {
+        addr = (uint16_t)((rand() % (SIM_EE_SIZE / 64)) * 64);
+        n = (uint8_t)(1 + rand() % 64);
+        
+        for(i=0; i<n; i++)
+        {
+            data[i] = (uint8_t)rand();
+        }
+        
+        // WREN, WRITE + address and the data (spi_tx)
+        cmd[0] = EEPROM_25LC256_WREN;
+        spi_select(SPI_DEV_EEPROM);
+        spi_tx(cmd, 1);
+        spi_deselect(SPI_DEV_EEPROM);
+        
+        cmd[0] = EEPROM_25LC256_WRITE;
+        cmd[1] = (uint8_t)(addr >> 8);
+        cmd[2] = (uint8_t)addr;
+        sim_clear_log();
+        
+        spi_select(SPI_DEV_EEPROM);
+        spi_tx(cmd, 3);
+        spi_transfer(data, NULL, n);
+        spi_deselect(SPI_DEV_EEPROM);
+        
+        // the bytes are sent as given (the write is done with the next frame)
+        CHECK( sim.logCnt == 3 + n );
+        
+        for(i=0; i<n && i + 3 < sim.logCnt; i++)
+        {
+            CHECK( sim.log[3 + i].val == data[i] );
+        }
+        
+        // status register (spi_txrx in place): the write cycle reset WEL
+        buf[0] = EEPROM_25LC256_RDSR;
+        buf[1] = 0xAA;
+        spi_select(SPI_DEV_EEPROM);
+        spi_transfer(buf, buf, 2);
+        spi_deselect(SPI_DEV_EEPROM);
+        
+        CHECK( buf[1] == 0x00 );
+        CHECK( memcmp(sim.ee + addr, data, n) == 0 );
+        
+        // READ + address (spi_tx) and the data (spi_rx sends 0x00)
+        memset(rd, 0x55, sizeof(rd));
+        sim_clear_log();
+        
+        cmd[0] = EEPROM_25LC256_READ;
+        spi_select(SPI_DEV_EEPROM);
+        spi_tx(cmd, 3);
+        spi_transfer(NULL, rd, n);
+        spi_deselect(SPI_DEV_EEPROM);
+        
+        CHECK( memcmp(rd, data, n) == 0 );
+        CHECK( n == 64 || rd[n] == 0x55 );
+        CHECK( sim.logCnt == 3 + n && sim.log[3].val == 0x00 && 
+               sim.log[2 + n].val == 0x00 );
+        
+        // the next queued job must not see the flag of the polled bytes
+        CHECK( PIR1bits.SSPIF == 0 );
+    }
+    
+    // nothing to send: no clocks
+    sim_clear_log();
+    spi_select(SPI_DEV_EEPROM);
+    spi_tx(data, 0);
+    spi_rx(rd, 0);
+    spi_txrx(data, rd, 0);
+    spi_transfer(NULL, NULL, 4);
+    spi_deselect(SPI_DEV_EEPROM);
+    
+    CHECK( sim.logCnt == 0 );
+}
+
+//..............................................................................
+
+static void test_cycles (void)
+{
+    static const char *pName[3] = { "tx", "rx", "txrx" };
+    uint8_t wr[BENCH_LEN], rd[BENCH_LEN];
+    double before, after;
+    uint8_t m;
+    
+    // the loops alone: the SSP is ready at once, nothing is shifted
+    memset(wr, 0x5A, sizeof(wr));
+    sim.noBus = true;
+    spi_select(SPI_DEV_EEPROM);
+    
+    for(m=0; m<3; m++)
+    {
+        before = __test_cycles(true, (m != 1) ? wr : NULL, m ? rd : NULL);
+        after = __test_cycles(false, (m != 1) ? wr : NULL, m ? rd : NULL);
+        
+        printf("host cycles per polled %s byte: %.1f before, %.1f after\n",
+               pName[m], before, after);
+    }
+    
+    spi_deselect(SPI_DEV_EEPROM);
+    sim.noBus = false;
+    
+    (void)spi_get_busy_time(SPI_DEV_EEPROM);
+}
+
+//..............................................................................
+
+static void test_bus_time (void)
+{
+    uint8_t buf[16];
+
+    // the operations of the EEPROM and the lcd with the profiles used and
+    // with the baseline profile (FOSC/64 for both)
+    sim_clear_log();
+    eeprom_25LC256_read(0x0100, buf, 4);
+    __test_bus_time("a record read");
+    CHECK( sim.logCnt == 3 + 4 );
+
+    sim_clear_log();
+    eeprom_25LC256_read(0x0100, buf, 16);
+    __test_bus_time("a 16 byte read");
+    CHECK( sim.logCnt == 3 + 16 );
+
+    memset(buf, 0x5A, sizeof(buf));
+    sim_clear_log();
+    eeprom_25LC256_write(0x0100, buf, 4);
+    eeprom_25LC256_flush();
+    __test_bus_time("a record write");
+    CHECK( sim.ee[0x0100] == 0x5A && sim.ee[0x0103] == 0x5A );
+
+    sim_clear_log();
+    spi_select(SPI_DEV_LCD);
+    spi_transfer(buf, NULL, 2 + 3);
+    spi_deselect(SPI_DEV_LCD);
+    __test_bus_time("an lcd span");
+    CHECK( sim.log[0].sspcon1 == SSPCON1_BASE );
+}
+
+//..............................................................................
+
+static void test_write_back (void)
+{
+    uint8_t rec[4] = { 1, 2, 3, 4 };
+    uint8_t buf[EEPROM_PAGE + 8];
+    uint8_t ref[EEPROM_PAGE + 8];
+    uint8_t i;
+    
+    memset(&sim.ee[0x0200], 0x33, 2 * EEPROM_PAGE);
+    memcpy(ref, &sim.ee[0x0200], sizeof(ref));
+    sim_clear_log();
+    
+    // the records of a page and a pointer update share a write cycle
+    for(i=0; i<8; i++)
+    {
+        rec[0] = i;
+        eeprom_25LC256_write(0x0208 + 4 * i, rec, 4);
+        memcpy(&ref[8 + 4 * i], rec, 4);
+    }
+    
+    eeprom_25LC256_write(0x0200, rec, 2);
+    memcpy(ref, rec, 2);
+    CHECK( sim.eeCycles == 0 );
+    
+    // reads return the buffered data
+    eeprom_25LC256_read(0x0200, buf, sizeof(buf));
+    CHECK( memcmp(buf, ref, sizeof(ref)) == 0 );
+    
+    // a gap (0x0202..0x0207) is read back, the page is written at once
+    eeprom_25LC256_flush();
+    CHECK( sim.eeCycles == 1 );
+    CHECK( memcmp(&sim.ee[0x0200], ref, sizeof(ref)) == 0 );
+    
+    eeprom_25LC256_flush();
+    CHECK( sim.eeCycles == 1 );
+    
+    // a write across the page boundary: the first page is written as soon as
+    // the next one is buffered
+    memset(buf, 0x77, sizeof(buf));
+    eeprom_25LC256_write(0x0200 + EEPROM_PAGE - 4, buf, 8);
+    CHECK( sim.eeCycles == 2 );
+    eeprom_25LC256_flush();
+    CHECK( sim.eeCycles == 3 );
+    CHECK( sim.ee[0x0200 + EEPROM_PAGE - 5] == 0x33 );
+    CHECK( sim.ee[0x0200 + EEPROM_PAGE - 4] == 0x77 );
+    CHECK( sim.ee[0x0200 + EEPROM_PAGE + 3] == 0x77 );
+    CHECK( sim.ee[0x0200 + EEPROM_PAGE + 4] == 0x33 );
+}
+
+//*** main *********************************************************************
+
+int main (void)
+{
+    sim_reset();
+
+    test_profile();
+    test_queue();
+    test_hold();
+    test_chunks();
+    test_burst();
+    test_cycles();
+    test_bus_time();
+    test_write_back();
+
+    return test_done("test_spi");
+}
@@ -0,0 +1,416 @@
+/*******************************************************************************
+ *
+ * File:        test_timer.c
+ * Project:     PICLCD-Stopwatch
+ * Author:      Nicolas Pannwitz (https://pic-projekte.de/)
+ * Comment:     Host test of the tick counter, the timing wheel and the tickless idle
+ * Licence:     Copyrightn (C) 2018 Nicolas Pannwitz
+ *
+ *              This program is free software: You can redistribute it and/or
+ *              modify it under the terms of the GNU General Public License as
+ *              published by the Free Software Foundation, either version 3 of
+ *              the License, or (at your option) any later version.
+ *
+ *              This program is distributed in the hope that it will be useful,
+ *              but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *              MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *              GNU General Public License for more details.
+ *
+ *              You should have received a copy of the GNU General Public
+ *              License along with this program.
+ *              If not, see https://www.gnu.org/licenses/
+ *
+ ******************************************************************************/
+
+
+#include <stdlib.h>
+#include "test.h"
+#include "sim.h"
+
+// the module under test (its static variables are checked, too)
+#include "../source/timer.c"
+
+//*** define *******************************************************************
+
+// ticks of the random wheel test
+#define WHEEL_TICKS     200000UL
+
+//*** static variables *********************************************************
+
+// reference model of the software timers: expiry tick, period, active
+static uint32_t refDue[MAX_TIMER];
+static uint16_t refPeriod[MAX_TIMER];
+static bool refActive[MAX_TIMER];
+
+// callbacks (timer and tick) in the order they were called
+static uint8_t cbTimer[64];
+static uint32_t cbTick[64];
+static uint8_t cbCnt;
+
+// a callback of timer 3 restarts its timer with restartTicks (0: no restart)
+static uint16_t restartTicks;
+
+//*** static functions *********************************************************
+
+static void __test_cb (uint8_t i)
+{
+    if( cbCnt < sizeof(cbTimer) )
+    {
+        cbTimer[cbCnt] = i;
+        cbTick[cbCnt] = wheelTick;
+        cbCnt++;
+    }
+}
+
+static void __test_cb0 (void) { __test_cb(0); }
+static void __test_cb1 (void) { __test_cb(1); }
+static void __test_cb2 (void) { __test_cb(2); }
+
+static void __test_cb3 (void)
+{
+    __test_cb(3);
+    
+    if( restartTicks )
+    {
+        timer_start(3, restartTicks, 0);
+    }
+}
+
+//..............................................................................
+
+static void __test_ref_start (uint8_t i, uint16_t t, uint16_t period)
+{
+    refDue[i] = wheelTick + (t ? t : 1);
+    refPeriod[i] = period;
+    refActive[i] = true;
+}
+
+//..............................................................................
+
+static uint16_t __test_ref_next (void)
+{
+    uint32_t n, next = TIMER_IDLE_MAX;
+    uint8_t i;
+    
+    for(i=0; i<MAX_TIMER; i++)
+    {
+        n = refDue[i] - wheelTick;
+        
+        if( refActive[i] && n < next )
+        {
+            next = n;
+        }
+    }
+    
+    return (uint16_t)next;
+}
+
+//..............................................................................
+
+static void test_elapsed (void)
+{
+    static const uint16_t start[] = { 0, 1, 3999, 4000, 12345, 39968, 39999 };
+    ts_t a, b;
+    uint32_t ref, n;
+    uint8_t i, d;
+    
+    // all sub tick positions of the stop against some of the start, up to
+    // one tick of borrow
+    for(i=0; i<sizeof(start)/sizeof(start[0]); i++)
+    {
+        for(d=0; d<3; d++)
+        {
+            for(n=0; n<TIMER1_TICK_CNT; n++)
+            {
+                a.tick = 1000;
+                a.sub = start[i];
+                b.tick = 1000 + d + 1;
+                b.sub = (uint16_t)n;
+                
+                ref = ((b.tick - a.tick) * TIMER1_TICK_CNT + b.sub - a.sub) / 
+                      TIMER1_CNT_PER_MS;
+                
+                CHECK( timer1_elapsed_ms(&a, &b) == ref );
+            }
+        }
+    }
+    
+    // random timestamps, also far apart (a race over hours)
+    srand(1);
+    
+    for(n=0; n<1000000UL; n++)
+    {
+        a.tick = (uint32_t)rand();
+        a.sub = (uint16_t)(rand() % TIMER1_TICK_CNT);
+        b.tick = a.tick + (uint32_t)(rand() % 1000000);
+        b.sub = (uint16_t)(rand() % TIMER1_TICK_CNT);
+        
+        if( b.tick == a.tick && b.sub < a.sub )
+        {
+            b.tick++;
+        }
+        
+        ref = (uint32_t)((((uint64_t)(b.tick - a.tick)) * TIMER1_TICK_CNT + 
+                          b.sub - a.sub) / TIMER1_CNT_PER_MS);
+        
+        CHECK( timer1_elapsed_ms(&a, &b) == ref );
+    }
+}
+
+//..............................................................................
+
+static void test_ticks (void)
+{
+    ts_t ts;
+    uint32_t t0 = timer1_get_ticks();
+    uint8_t n;
+    
+    for(n=0; n<100; n++)
+    {
+        timer1_increase_ticks();
+    }
+    
+    CHECK( timer1_get_ticks() == t0 + 100 );
+    
+    // the interrupt is enabled again after reading the counter
+    CHECK( PIE1bits.CCP1IE == 1 );
+    
+    // TIMER1 was reset by the compare match, the tick not yet counted
+    TMR1L = 0x10;
+    TMR1H = 0x00;
+    PIR1bits.CCP1IF = 1;
+    timer1_get_timestamp(&ts);
+    
+    CHECK( ts.tick == t0 + 101 && ts.sub == 0x10 );
+    
+    // the flag is set but the match happened after TIMER1 was read
+    TMR1L = 0x3F;
+    TMR1H = 0x9C;
+    timer1_get_timestamp(&ts);
+    
+    CHECK( ts.tick == t0 + 100 && ts.sub == 0x9C3F );
+    
+    PIR1bits.CCP1IF = 0;
+}
+
+//..............................................................................
+
+static void test_wheel (void)
+{
+    static void (* const cb[MAX_TIMER])(void) = 
+    {
+        __test_cb0, __test_cb1, __test_cb2, __test_cb3
+    };
+    
+    uint32_t now, end;
+    uint16_t t, p;
+    uint8_t i, k, n;
+    
+    // the wheel starts with the current tick
+    timer_dispatch();
+    
+    for(i=0; i<MAX_TIMER; i++)
+    {
+        CHECK( timer_new(cb[i]) == (int8_t)i );
+    }
+    
+    CHECK( timer_new(__test_cb0) == -1 );
+    
+    srand(2);
+    end = wheelTick + WHEEL_TICKS;
+    
+    while( wheelTick < end )
+    {
+        // (re)start or stop a timer now and then: short, long (several 
+        // rounds, also more than 256 of them), one-shot and periodic ones
+        if( (rand() % 8) == 0 )
+        {
+            i = (uint8_t)(rand() % MAX_TIMER);
+            k = (uint8_t)(rand() % 10);
+            t = (uint16_t)((k < 5) ? rand() % 20 : 
+                           (k < 8) ? rand() % 2000 : rand() % 30000);
+            p = (uint16_t)((rand() % 2) ? 1 + rand() % 300 : 0);
+            
+            if( k == 9 )
+            {
+                timer_stop(i);
+                refActive[i] = false;
+            }
+            else
+            {
+                timer_start(i, t, p);
+                __test_ref_start(i, t, p);
+            }
+        }
+        
+        restartTicks = (uint16_t)(rand() % 3 ? 0 : 1 + rand() % 50);
+        
+        // the time until the next expiry (tickless idle)
+        CHECK( __timer_next_expiry() == __test_ref_next() );
+        
+        // the main loop may be late: several ticks per dispatch
+        n = (uint8_t)((rand() % 4) ? 1 : 1 + rand() % 30);
+        
+        while( n-- )
+        {
+            timer1_increase_ticks();
+        }
+        
+        now = timer1_get_ticks();
+        cbCnt = 0;
+        k = 0;
+        
+        timer_dispatch();
+        
+        CHECK( wheelTick == now );
+        
+        // the reference: expiries in the order of the ticks and (within a
+        // tick) of the timer index
+        {
+            uint32_t tk, first = now;
+            
+            for(i=0; i<MAX_TIMER; i++)
+            {
+                if( refActive[i] && refDue[i] < first )
+                {
+                    first = refDue[i];
+                }
+            }
+            
+            for(tk=first; tk<=now; tk++)
+            {
+                for(i=0; i<MAX_TIMER; i++)
+                {
+                    if( !refActive[i] || refDue[i] != tk )
+                    {
+                        continue;
+                    }
+                    
+                    CHECK( k < cbCnt && cbTimer[k] == i && cbTick[k] == tk );
+                    k++;
+                    
+                    if( refPeriod[i] )
+                    {
+                        refDue[i] += refPeriod[i];
+                    }
+                    else
+                    {
+                        refActive[i] = false;
+                    }
+                    
+                    if( i == 3 && restartTicks )
+                    {
+                        refDue[i] = tk + restartTicks;
+                        refPeriod[i] = 0;
+                        refActive[i] = true;
+                    }
+                }
+            }
+        }
+        
+        CHECK( k == cbCnt );
+    }
+}
+
+//..............................................................................
+
+/**
+ * This function lets the main loop run until the callback of a timer was 
+ * called: the cpu idles (timer_idle) or waits for the next tick.
+ * 
+ * @return Ticks when the callback was called.
+ */
+
+static uint32_t __test_idle_until_cb (void)
+{
+    uint32_t before;
+    uint16_t n;
+    
+    cbCnt = 0;
+    
+    for(n=0; n<10000 && !cbCnt; n++)
+    {
+        before = timer1_get_ticks();
+        
+        timer_idle();
+        
+        // not worth to idle: the tick interrupt
+        if( timer1_get_ticks() == before )
+        {
+            timer1_increase_ticks();
+        }
+        
+        timer_dispatch();
+    }
+    
+    return timer1_get_ticks();
+}
+
+//..............................................................................
+
+static void test_idle (void)
+{
+    uint32_t t0;
+    uint16_t w0;
+    uint8_t i;
+    
+    for(i=0; i<MAX_TIMER; i++)
+    {
+        timer_stop(i);
+    }
+    
+    restartTicks = 0;
+    timer_dispatch();
+    
+    // one idle period up to the expiry (the remainder of TIMER0 is kept for
+    // the next idle period, so the last tick may come from the tick 
+    // interrupt): the cpu wakes up once and never sleeps beyond the expiry
+    t0 = timer1_get_ticks();
+    w0 = timer_get_wakeups();
+    timer_start(0, 250, 0);
+    
+    CHECK( __test_idle_until_cb() == t0 + 250 );
+    CHECK( cbCnt == 1 && cbTimer[0] == 0 );
+    CHECK( timer_get_wakeups() == w0 + 1 );
+    
+    // beyond TIMER_IDLE_MAX: one wake up per idle period
+    t0 = timer1_get_ticks();
+    w0 = timer_get_wakeups();
+    timer_start(1, 1000, 0);
+    
+    CHECK( __test_idle_until_cb() == t0 + 1000 );
+    CHECK( cbCnt == 1 && cbTimer[0] == 1 );
+    CHECK( timer_get_wakeups() == w0 + 3 );
+    
+    // another interrupt wakes up the cpu early (10000 TIMER0 counts = 64 
+    // ticks): the ticks up to then are accounted, the next idle period takes
+    // them into account before the wheel was advanced
+    t0 = timer1_get_ticks();
+    w0 = timer_get_wakeups();
+    timer_start(2, 300, 0);
+    sim.wakeAfter = 10000;
+    timer_idle();
+    sim.wakeAfter = 0;
+    
+    CHECK( timer1_get_ticks() == t0 + 64 );
+    CHECK( timer_get_wakeups() == w0 + 1 );
+    CHECK( __test_idle_until_cb() == t0 + 300 );
+    
+    // the tick runs again
+    CHECK( T1CONbits.TMR1ON == 1 && PIE1bits.CCP1IE == 1 );
+    CHECK( INTCONbits.T0IE == 0 );
+}
+
+//*** main *********************************************************************
+
+int main (void)
+{
+    sim_reset();
+    
+    test_elapsed();
+    test_ticks();
+    test_wheel();
+    test_idle();
+    
+    return test_done("test_timer");
+}